@@ -1,15 +1,20 @@
 #pragma once
 
+#include <algorithm>
 #include <filesystem>
 #include <memory>
 #include <string>
 #include <sys/stat.h>
+#include <tuple>
 #include <unordered_map>
+#include <vector>
 
 #include "font.hpp"
 #include "material.hpp"
 #include "mesh.hpp"
+#include "mipStreamer.hpp"
 #include "texture.hpp"
+#include "textureStreamer.hpp"
 
 class AssetManager
 {
@@ -82,12 +87,17 @@ class AssetManager
         return fonts["default.ttf"];
     }
 
-    TexturePtr loadTexture(std::string filepath)
+    // returned right away with the placeholder bound, the pixels stream in over the next frames.
+    // keepData only counts for the first load of a file
+    TexturePtr loadTexture(std::string filepath, bool keepData = false)
     {
         std::string filename = stripPath(filepath);
         if (textures.find(filename) == textures.end())
         {
-            textures[filename] = std::make_shared<Texture>(filepath.c_str());
+            TexturePtr texture = std::make_shared<Texture>(filepath.c_str(), "", keepData);
+            getTextureStreamer().request(texture, filepath);
+            getMipStreamer().add(texture);
+            textures[filename] = texture;
         }
         return textures[filename];
     }
@@ -117,6 +127,41 @@ class AssetManager
         return loadTextureByName(filename);
     }
 
+    // textures of the same size and format become the layers of one array, materials drawing
+    // with them keep the same texture bound. Textures already in an array are left where they are.
+    void buildTextureArrays(const std::vector<TexturePtr> &arrayTextures)
+    {
+        std::vector<std::pair<std::tuple<i32, i32, GLenum>, std::vector<TexturePtr>>> groups;
+        for (const TexturePtr &texture : arrayTextures)
+        {
+            if (texture->getArray() || !texture->getTextureID())
+                continue;
+            // layers are copied whole, the array would miss the levels streamed in later
+            texture->pinLevels();
+
+            std::tuple<i32, i32, GLenum> format = {texture->getWidth(), texture->getHeight(), texture->getFormat()};
+            auto sameFormat = [&](const auto &group) { return group.first == format; };
+            auto it = std::find_if(groups.begin(), groups.end(), sameFormat);
+            if (it == groups.end())
+            {
+                groups.push_back({format, {}});
+                it = groups.end() - 1;
+            }
+            // the same texture referenced twice only takes one layer
+            if (std::find(it->second.begin(), it->second.end(), texture) == it->second.end())
+                it->second.push_back(texture);
+        }
+
+        for (auto &[format, group] : groups)
+        {
+            TextureArrayPtr array = std::make_shared<TextureArray>(group);
+            for (size_t i = 0; i < group.size(); i++)
+            {
+                group[i]->setArrayLayer(array, i);
+            }
+        }
+    }
+
     /*
         MaterialPtr loadMaterial(std::string shaderName)
     {
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <array>
+
+#include <GL/glew.h>
+
+#include "typedef.hpp"
+
+// Shadow copy of the OpenGL state the engine touches every frame (program, VAO, texture units,
+// framebuffers, depth/blend/cull toggles, polygon mode and viewport).
+// Every setter compares against the shadow first and only reaches the driver when the value
+// actually changes. Anything that changes this state behind our back (ImGui, raw gl calls)
+// must be followed by invalidate(), otherwise the next "redundant" call gets skipped for real.
+class GLState
+{
+  public:
+    enum Counter : u32
+    {
+        PROGRAM,
+        VERTEX_ARRAY,
+        ACTIVE_TEXTURE,
+        TEXTURE,
+        FRAMEBUFFER,
+        CAPABILITY,
+        DEPTH_MASK,
+        DEPTH_FUNC,
+        BLEND_FUNC,
+        POLYGON_MODE,
+        VIEWPORT,
+        COUNTER_N
+    };
+
+    static constexpr u32 MAX_TEXTURE_UNITS = 32;
+
+  private:
+    static constexpr u32 UNKNOWN = 0xffffffff;
+
+    // texture targets and capabilities we keep track of, anything else goes straight to the driver
+    enum TextureTarget : u32
+    {
+        TARGET_2D,
+        TARGET_CUBE_MAP,
+        TARGET_2D_ARRAY,
+        TARGET_3D,
+        TEXTURE_TARGET_N
+    };
+
+    enum Capability : u32
+    {
+        CAP_DEPTH_TEST,
+        CAP_BLEND,
+        CAP_CULL_FACE,
+        CAP_SCISSOR_TEST,
+        CAP_STENCIL_TEST,
+        CAPABILITY_N
+    };
+
+    u32 program;
+    u32 vertexArray;
+    u32 activeTextureUnit;
+    std::array<std::array<u32, TEXTURE_TARGET_N>, MAX_TEXTURE_UNITS> textures;
+    u32 drawFramebuffer;
+    u32 readFramebuffer;
+    std::array<i8, CAPABILITY_N> capabilities;
+    i8 depthMask;
+    GLenum depthFunc;
+    GLenum blendSrc;
+    GLenum blendDst;
+    GLenum polygonMode;
+    ivec4 viewport;
+
+    // counters for the frame being recorded, copied to the "last" arrays by endFrame()
+    std::array<i32, COUNTER_N> issued;
+    std::array<i32, COUNTER_N> skipped;
+    std::array<i32, COUNTER_N> lastIssued;
+    std::array<i32, COUNTER_N> lastSkipped;
+
+    static u32 toTargetIndex(GLenum target);
+    static u32 toCapabilityIndex(GLenum cap);
+
+    inline bool check(bool redundant, Counter counter)
+    {
+        if (redundant)
+        {
+            skipped[counter]++;
+            return false;
+        }
+        issued[counter]++;
+        return true;
+    }
+
+  public:
+    GLState();
+
+    // forget everything we know, the next call of each kind will always be issued
+    void invalidate();
+
+    // roll the per-frame counters over, call once per frame
+    void endFrame();
+
+    void useProgram(u32 id);
+    void bindVertexArray(u32 id);
+
+    // unit is an index (0, 1, 2...), not a GL_TEXTUREi enum
+    void activeTexture(u32 unit);
+    void bindTexture(GLenum target, u32 id);
+    void bindTexture(u32 unit, GLenum target, u32 id);
+
+    void bindFramebuffer(GLenum target, u32 id);
+
+    void setCapability(GLenum cap, bool enabled);
+    void setDepthMask(bool enabled);
+    void setDepthFunc(GLenum func);
+    void setBlendFunc(GLenum src, GLenum dst);
+    void setPolygonMode(GLenum mode);
+    void setViewport(i32 x, i32 y, i32 width, i32 height);
+
+    // deleting a bound object makes GL fall back to 0, the shadow has to follow
+    // or a recycled name would be considered already bound
+    void programDeleted(u32 id);
+    void vertexArrayDeleted(u32 id);
+    void textureDeleted(u32 id);
+    void framebufferDeleted(u32 id);
+
+    u32 getProgram() const
+    {
+        return program;
+    }
+
+    u32 getDrawFramebuffer() const
+    {
+        return drawFramebuffer;
+    }
+
+    // counters of the last finished frame
+    i32 *getIssuedCounter(Counter counter)
+    {
+        return &lastIssued[counter];
+    }
+
+    i32 *getSkippedCounter(Counter counter)
+    {
+        return &lastSkipped[counter];
+    }
+
+    static const char *getCounterName(Counter counter);
+};
+
+GLState &getGLState();
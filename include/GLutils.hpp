@@ -14,6 +14,7 @@
 #include "typedef.hpp"
 #include "utils.hpp"
 
+#include "GLState.hpp"
 #include "globals.hpp"
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_glfw.h"
@@ -59,7 +60,7 @@ inline void resizeCallback(GLFWwindow *window, i32 width, i32 height)
 {
     using namespace EngineGlobals;
     windowSize = ivec2(width, height);
-    glViewport(0, 0, width, height);
+    getGLState().setViewport(0, 0, width, height);
     refreshProjectionMatrix();
 }
 
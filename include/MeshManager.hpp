@@ -1,6 +1,9 @@
 #pragma once
 #include "renderLayer.hpp"
+#include "renderQueue.hpp"
+#include "staticGeometry.hpp"
 #include "typedef.hpp"
+#include <array>
 #include <memory>
 #include <vector>
 
@@ -10,6 +13,11 @@ class MeshManager
 {
   private:
     std::vector<MeshPtr> meshes;
+    StaticGeometry staticGeometry;
+
+    // scratch for the draw order of a layer
+    RenderQueue queue;
+    std::vector<Mesh *> queued;
 
   public:
     MeshManager() = default;
@@ -19,7 +27,18 @@ class MeshManager
         meshes.push_back(mesh);
     }
 
+    StaticGeometry &getStaticGeometry()
+    {
+        return staticGeometry;
+    }
+
+    // rebuilds the static batches if the set of static meshes changed since the last build
+    void buildStaticGeometry();
+
     void Update(RenderLayerPtr renderLayer = RenderLayer::DEFAULT);
+
+    // depth only draw of either the static or the dynamic shadow casters inside the planes
+    void drawShadowCasters(bool staticCasters, const std::array<vec4, 6> &planes);
 };
 
 using MeshManagerPtr = std::shared_ptr<MeshManager>;
@@ -13,13 +13,16 @@ using namespace glm;
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
+#include "meshOptimizer.hpp"
 #include "typedef.hpp"
 
 void loadMesh(const char *path, std::vector<uivec3> &indices, std::vector<vec3> &vertices, std::vector<vec3> &normals,
               std::vector<vec2> &uvs)
 {
     Assimp::Importer importer;
-    const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
+    // without the vertex welding every corner is its own vertex and there is nothing to cache
+    const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals |
+                                                       aiProcess_JoinIdenticalVertices);
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
     {
@@ -56,4 +59,7 @@ void loadMesh(const char *path, std::vector<uivec3> &indices, std::vector<vec3>
         }
         indices.push_back(uivec3(face.mIndices[0], face.mIndices[1], face.mIndices[2]));
     }
+
+    // file order is whatever the exporter did, reorder for the vertex cache, overdraw and fetch
+    optimizeMesh(path, indices, vertices, normals, uvs);
 }
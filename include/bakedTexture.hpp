@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+
+#include "typedef.hpp"
+
+// .btex, written by tools/bakeTextures.cpp (make bake-textures) next to the source image. Block
+// compressed, with the whole mip chain, so the runtime maps the file and uploads the levels as is:
+//   1 channel  -> BC4 (RGTC1)
+//   2 channels -> BC5 (RGTC2)
+//   3 channels -> BC1 (S3TC DXT1)
+//   4 channels -> BC3 (S3TC DXT5)
+// Layout: BakedTextureHeader, levelCount BakedTextureLevel, then the level data at their offsets.
+namespace BakedTexture
+{
+constexpr u32 MAGIC = 0x58455442; // "BTEX"
+constexpr u32 VERSION = 1;
+
+// the GL enums, so this header doesn't need GL
+constexpr u32 FORMAT_BC1 = 0x83F0; // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+constexpr u32 FORMAT_BC3 = 0x83F3; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+constexpr u32 FORMAT_BC4 = 0x8DBB; // GL_COMPRESSED_RED_RGTC1
+constexpr u32 FORMAT_BC5 = 0x8DBD; // GL_COMPRESSED_RG_RGTC2
+
+struct Header
+{
+    u32 magic;
+    u32 version;
+    u32 format;
+    u32 width;
+    u32 height;
+    u32 channels;
+    u32 levelCount;
+    u32 padding;
+};
+
+struct Level
+{
+    u64 offset;
+    u64 size;
+    u32 width;
+    u32 height;
+};
+
+inline u32 formatFor(i32 channels)
+{
+    switch (channels)
+    {
+    case 1:
+        return FORMAT_BC4;
+    case 2:
+        return FORMAT_BC5;
+    case 3:
+        return FORMAT_BC1;
+    default:
+        return FORMAT_BC3;
+    }
+}
+
+// bytes per 4x4 block
+inline u32 blockSize(u32 format)
+{
+    return format == FORMAT_BC1 || format == FORMAT_BC4 ? 8 : 16;
+}
+
+// res/tile.png -> res/tile.btex
+inline std::string bakedPath(const std::string &path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + ".btex";
+    return path.substr(0, dot) + ".btex";
+}
+} // namespace BakedTexture
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+#include "typedef.hpp"
+
+using namespace glm;
+
+// Shadows of the directional light. The view frustum up to shadowDistance is split in cascades,
+// each gets an orthographic map around the bounding sphere of its slice so it keeps the same size
+// when the camera turns, and moves by whole texels so edges don't shimmer when it moves.
+// Static casters of the far cascades are rendered in a cache array that is only redrawn when a
+// cascade or the light moved, dynamic casters are drawn over a copy of it every frame. The near
+// cascade, and any cascade that moved for MISS_LIMIT frames in a row, is drawn directly without
+// the cache. Sampled by shader/shadows.glsl.
+class CascadedShadowMap
+{
+  public:
+    static constexpr u32 MAX_CASCADES = 4;
+    // where shader/shadows.glsl expects the map
+    static constexpr u32 TEXTURE_UNIT = 15;
+    // frames in a row a cascade has to move before it stops going through the cache
+    static constexpr u32 MISS_LIMIT = 4;
+
+  private:
+    struct Cascade
+    {
+        mat4 viewProj;
+        f32 splitDepth;
+        f32 texelSize; // world size of a texel
+        // what the static cache was rendered with
+        mat4 cachedViewProj;
+        bool cacheValid = false;
+        // last frame's matrix, and for how many frames it kept changing
+        mat4 previousViewProj = mat4(0.0f);
+        u32 missStreak = 0;
+    };
+
+    ShaderProgramPtr depthShader;
+
+    GLuint fboID = 0;
+    GLuint shadowTextureID = 0;
+    GLuint staticTextureID = 0;
+    GLuint uboID = 0;
+    u32 resolution;
+
+    std::array<Cascade, MAX_CASCADES> cascades;
+    vec3 cachedLightDirection = vec3(0.0f);
+    u32 cachedStaticVersion = ~0u;
+
+    i32 staticRenders = 0;
+    i32 directRenders = 0;
+
+    void fitCascades(const mat4 &view, const mat4 &projection, vec3 lightDirection);
+    void renderCasters(GLuint textureID, u32 layer, const mat4 &viewProj, bool staticCasters, bool clear);
+    void uploadBlock();
+
+  public:
+    bool enabled = true;
+    bool cacheStatic = true;
+    i32 cascadeCount = MAX_CASCADES;
+    f32 shadowDistance = 100.0f;
+    // 0: evenly spaced splits, 1: logarithmic
+    f32 splitLambda = 0.75f;
+    // how far towards the light casters outside a cascade are still caught
+    f32 casterDistance = 100.0f;
+    // receivers are pushed along their normal by that many texels
+    f32 normalOffset = 1.5f;
+
+    explicit CascadedShadowMap(u32 resolution = 2048);
+    ~CascadedShadowMap();
+
+    CascadedShadowMap(const CascadedShadowMap &) = delete;
+    CascadedShadowMap &operator=(const CascadedShadowMap &) = delete;
+
+    // renders the cascades for the camera of this frame, before anything lit is drawn
+    void update(const mat4 &view, const mat4 &projection, vec3 lightDirection);
+
+    // cached cascades whose static casters had to be redrawn this frame
+    i32 *getStaticRenderCounter()
+    {
+        return &staticRenders;
+    }
+
+    // cascades drawn without the cache this frame
+    i32 *getDirectRenderCounter()
+    {
+        return &directRenders;
+    }
+};
+
+CascadedShadowMap &getCascadedShadowMap();
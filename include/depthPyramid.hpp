@@ -0,0 +1,57 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+#include "texture.hpp"
+#include "typedef.hpp"
+
+using namespace glm;
+
+// Max-depth mip chain of a framebuffer depth, used for hierarchical Z occlusion tests.
+// Level 0 is half the source resolution, every texel holds the farthest depth it covers.
+class DepthPyramid
+{
+  private:
+    GLuint pyramidTextureID = 0;
+
+    ivec2 sourceSize = ivec2(0);
+    ivec2 size = ivec2(0);
+    u32 levels = 0;
+
+    ShaderProgramPtr reduceShader;
+
+    void create(ivec2 _sourceSize);
+    void destroy();
+
+  public:
+    DepthPyramid();
+    ~DepthPyramid();
+
+    DepthPyramid(const DepthPyramid &) = delete;
+    DepthPyramid &operator=(const DepthPyramid &) = delete;
+
+    // rebuilds every level out of a depth texture of sourceSize
+    void update(GLuint depthTextureID, ivec2 _sourceSize);
+
+    bool isValid() const
+    {
+        return pyramidTextureID != 0;
+    }
+
+    GLuint getTextureID() const
+    {
+        return pyramidTextureID;
+    }
+
+    ivec2 getSize() const
+    {
+        return size;
+    }
+
+    u32 getLevels() const
+    {
+        return levels;
+    }
+};
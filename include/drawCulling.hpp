@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "depthPyramid.hpp"
+#include "ringBuffer.hpp"
+#include "shader.hpp"
+#include "typedef.hpp"
+
+using namespace glm;
+
+// std430 layout, mirrored by CullCandidate in shader/cull.comp
+struct CullCandidate
+{
+    vec4 sphere; // object space center + radius
+    u32 count;
+    u32 firstIndex;
+    i32 baseVertex;
+    u32 drawID;
+    u32 bucket;
+    u32 firstCommand; // first command slot of the bucket, relative to the cull() call
+    u32 slot;         // index of the candidate in its bucket
+    u32 padding;
+};
+
+// Visibility of indirect draws. In GPU mode a compute pass tests every candidate against the
+// frustum (and optionally the depth pyramid of the previous frame), compacts the visible ones into
+// the command buffer with an atomic counter per bucket and the buckets are drawn with
+// glMultiDrawElementsIndirectCount. CPU mode runs the same frustum test on the CPU, it is the
+// reference the GPU results can be checked against.
+class DrawCuller
+{
+  public:
+    enum Mode : i32
+    {
+        OFF = 0,
+        GPU = 1,
+        CPU = 2
+    };
+
+    static constexpr u32 MAX_CANDIDATES = DrawDataBuffer::MAX_DRAWS;
+    static constexpr u32 MAX_BUCKETS = 1024;
+
+  private:
+    ShaderProgramPtr cullShader;
+    RingBuffer candidateRing;
+
+    // GPU only buffers, written by the cull pass and read by the draws of the same frame
+    GLuint commandBufferID = 0;
+    GLuint counterBufferID = 0;
+    u32 commandHead = 0;
+    u32 counterHead = 0;
+
+    DepthPyramid depthPyramid;
+    mat4 pyramidViewProj = mat4(1.0f);
+
+    // frame being culled
+    std::array<vec4, 6> frustumPlanes;
+    mat4 frameViewProj = mat4(1.0f);
+    u32 firstCommand = 0;
+    u32 firstCounter = 0;
+    bool compact = true;
+
+    i32 candidateCount = 0;
+    i32 visibleCount = 0;
+    i32 lastCandidateCount = 0;
+    i32 lastVisibleCount = 0;
+    i32 mismatches = 0;
+
+    // CPU side results, used by the CPU mode and to verify the GPU
+    std::vector<DrawElementsIndirectCommand> cpuCommands;
+    std::vector<u32> cpuCounts;
+
+    void verify(const std::vector<CullCandidate> &candidates, u32 bucketCount);
+
+  public:
+    i32 mode = GPU;
+    bool useHiZ = false;
+    // reads the GPU results back every frame and compares them with the CPU reference, slow
+    bool verifyGPU = false;
+
+    DrawCuller();
+    ~DrawCuller();
+
+    DrawCuller(const DrawCuller &) = delete;
+    DrawCuller &operator=(const DrawCuller &) = delete;
+
+    void beginFrame();
+
+    // builds the depth pyramid of the next frame out of this frame's depth texture, if there is one
+    void endFrame(GLuint depthTextureID, ivec2 depthSize);
+
+    static std::array<vec4, 6> getFrustumPlanes(const mat4 &viewProj);
+    static bool isVisible(const std::array<vec4, 6> &planes, const mat4 &model, vec4 sphere);
+
+    // culls the candidates of bucketCount buckets, candidates of a bucket have to be contiguous.
+    // keepOrder skips the GPU compaction, culled draws stay in place with no instance
+    void cull(const std::vector<CullCandidate> &candidates, u32 bucketCount, const mat4 &viewProj,
+              const std::vector<mat4> &models, bool keepOrder = false);
+
+    // draws the surviving commands of a bucket out of the last cull() call, the VAO and
+    // program have to be bound
+    void drawBucket(u32 bucket, u32 bucketFirstCommand, u32 bucketCandidates, GLenum indexType = GL_UNSIGNED_INT);
+
+    i32 *getCandidateCounter()
+    {
+        return &lastCandidateCount;
+    }
+
+    i32 *getVisibleCounter()
+    {
+        return &lastVisibleCount;
+    }
+
+    i32 *getMismatchCounter()
+    {
+        return &mismatches;
+    }
+};
+
+DrawCuller &getDrawCuller();
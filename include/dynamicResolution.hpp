@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+#include "typedef.hpp"
+
+using namespace glm;
+
+// Render scale of the render graph targets, driven by the GPU time of the scene against a budget.
+// Below full resolution the projection is jittered by a subpixel offset every frame and the
+// temporal upsampler accumulates the jittered frames into a window sized history, reprojected with
+// the velocity target of the graph or, without one, the depth. Whatever draws after the graph (text, UI) stays native.
+class DynamicResolution
+{
+  public:
+    static constexpr u32 QUERY_N = 4;
+    static constexpr f32 SCALE_STEP = 0.05f;
+
+  private:
+    // GPU time of the last frames, read back a few frames late so we never wait on it
+    std::array<GLuint, QUERY_N> queryIDs = {};
+    std::array<bool, QUERY_N> queryPending = {};
+    u32 queryIndex = 0;
+    bool queryActive = false;
+    u32 framesSinceChange = 0;
+
+    ShaderProgramPtr upsampleShader;
+    // ping-ponged, one is read while the other is written
+    std::array<GLuint, 2> historyTextureIDs = {};
+    std::array<GLuint, 2> historyFBOIDs = {};
+    ivec2 historySize = ivec2(0);
+    u32 historyIndex = 0;
+    bool historyValid = false;
+
+    u32 frame = 0;
+    bool jittered = false;
+    vec2 jitter = vec2(0.0f);     // uv units
+    vec2 prevJitter = vec2(0.0f); // uv units
+    mat4 unjitteredProjection = mat4(1.0f);
+    mat4 viewProj = mat4(1.0f);
+    mat4 prevViewProj = mat4(1.0f);
+
+    f32 gpuTime = 0.0f;
+
+    void readQueries();
+    void allocateHistory(ivec2 size);
+    void releaseHistory();
+
+  public:
+    // adjusts scale, otherwise scale is left to whoever sets it
+    bool enabled = true;
+    bool temporalUpsample = true;
+    f32 budgetMs = 14.0f;
+    f32 minScale = 0.5f;
+    f32 scale = 1.0f;
+
+    DynamicResolution();
+    ~DynamicResolution();
+
+    DynamicResolution(const DynamicResolution &) = delete;
+    DynamicResolution &operator=(const DynamicResolution &) = delete;
+
+    // updates the scale out of the last measured frames and starts timing this one
+    void beginFrame();
+    void endFrame();
+
+    // once the render size is known, jitters EngineGlobals::projectionMatrix if the frame is going
+    // to be upsampled to outputSize
+    void prepareFrame(ivec2 renderSize, ivec2 outputSize);
+
+    // accumulates the color of the frame into the history, returns the framebuffer holding the
+    // outputSize result or 0 if the frame isn't upsampled
+    GLuint resolve(GLuint colorTextureID, GLuint depthTextureID, GLuint velocityTextureID, ivec2 renderSize,
+                   ivec2 outputSize);
+
+    // this frame's projection without the jitter, for whatever mustn't shake
+    const mat4 &getUnjitteredProjection() const
+    {
+        return unjitteredProjection;
+    }
+
+    // smoothed GPU time of the scene, in ms
+    f32 *getGPUTimeCounter()
+    {
+        return &gpuTime;
+    }
+};
+
+DynamicResolution &getDynamicResolution();
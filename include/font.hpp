@@ -6,6 +6,8 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include "GLState.hpp"
+
 #include <iostream>
 #include <memory>
 #include <string>
@@ -74,7 +76,7 @@ class Font
             // generate texture
             unsigned int texture;
             glGenTextures(1, &texture);
-            glBindTexture(GL_TEXTURE_2D, texture);
+            getGLState().bindTexture(GL_TEXTURE_2D, texture);
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, face->glyph->bitmap.width, face->glyph->bitmap.rows, 0, GL_RED,
                          GL_UNSIGNED_BYTE, face->glyph->bitmap.buffer);
             // set texture options
@@ -96,6 +98,7 @@ class Font
         for (auto &c : characters)
         {
             glDeleteTextures(1, &c.second.TextureID);
+            getGLState().textureDeleted(c.second.TextureID);
         }
     }
 
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "typedef.hpp"
+
+using namespace glm;
+
+// Screenshots and image sequences without stalling the frame. Framebuffers are read into a ring of
+// pixel buffers, mapped a few frames later once their fence signaled, and encoded to disk by
+// writer threads. The file extension picks the encoding: .png, .ppm or .raw (rgba8, bottom row first).
+class FrameCapture
+{
+  public:
+    static constexpr u32 RING_N = 4;
+    // frames waiting for a writer, past that the render thread waits for them to catch up
+    static constexpr u32 MAX_QUEUED = 16;
+
+  private:
+    struct Readback
+    {
+        GLuint bufferID = 0;
+        u64 bufferSize = 0;
+        GLsync fence = nullptr;
+        ivec2 size = ivec2(0);
+        std::string path;
+    };
+
+    struct Image
+    {
+        std::vector<u8> pixels; // rgba8, as glReadPixels returns them
+        ivec2 size;
+        std::string path;
+    };
+
+    std::array<Readback, RING_N> ring;
+    u32 next = 0;
+
+    std::vector<std::thread> writers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable drained;
+    std::deque<Image> queue;
+    u32 writing = 0;
+    bool stopping = false;
+
+    bool recording = false;
+    std::string sequencePattern;
+    u32 sequenceFrame = 0;
+
+    i32 stalls = 0;
+    // counted by the writers under the mutex, copied for the main thread by endFrame
+    i32 written = 0;
+    i32 writtenShown = 0;
+
+    // copies the finished readbacks out, waits for the one at slot if asked to
+    void collect(bool waitForNext);
+    void writerLoop();
+    static void write(Image &image);
+
+  public:
+    explicit FrameCapture(u32 writerCount);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    // color attachment 0 of fboID, 0 being the backbuffer, as it is when the call is made
+    void capture(GLuint fboID, ivec2 size, const std::string &path);
+
+    // backbuffer of every frame from now on, pattern goes through snprintf with the frame number
+    // ("capture/frame_%05u.png")
+    void startSequence(const std::string &pattern);
+    void stopSequence();
+    bool isRecording() const
+    {
+        return recording;
+    }
+
+    // queues the sequence frame if recording and hands the finished readbacks to the writers,
+    // once the frame is drawn and before the buffers are swapped
+    void endFrame();
+
+    // blocks until everything captured so far is on disk
+    void flush();
+
+    // frames the render thread had to wait on a readback or the writers
+    i32 *getStallCounter()
+    {
+        return &stalls;
+    }
+
+    i32 *getWrittenCounter()
+    {
+        return &writtenShown;
+    }
+};
+
+FrameCapture &getFrameCapture();
@@ -10,6 +10,8 @@ using namespace glm;
 namespace EngineGlobals
 {
 extern glm::ivec2 windowSize;
+// size the scene is rendered at, trails windowSize while a resize settles
+extern glm::ivec2 renderSize;
 extern f32 fov;
 
 extern mat4 projectionMatrix;
@@ -32,7 +34,4 @@ extern ScenePtr scene;
 
 mat4 getViewMatrix();
 
-extern std::vector<float> clearVelocitySSBO;
-extern u32 clearVelocitySSBOID;
-
 }; // namespace EngineGlobals
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+#include "typedef.hpp"
+
+using namespace glm;
+
+// Clustered forward lighting. The view frustum is cut in GRID_X * GRID_Y screen tiles and
+// GRID_Z exponential depth slices, a compute pass lists the point lights touching each cluster
+// every frame and the lit shaders only loop over the list of their fragment's cluster, see
+// shader/lights.glsl. Owns the Lights uniform block and the light/cluster storage buffers.
+class LightClusters
+{
+  public:
+    static constexpr u32 GRID_X = 16;
+    static constexpr u32 GRID_Y = 9;
+    static constexpr u32 GRID_Z = 24;
+    static constexpr u32 CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+    // lights past that in a single cluster are dropped
+    static constexpr u32 MAX_LIGHTS_PER_CLUSTER = 128;
+
+  private:
+    ShaderProgramPtr buildShader;
+
+    GLuint uboID = 0;
+    GLuint lightBufferID = 0;
+    GLuint countBufferID = 0;
+    GLuint indexBufferID = 0;
+
+    u32 lightCount = 0;
+    DirectionalLight directionalLight = {vec3(0.0f, -1.0f, 0.0f), vec3(0.0f), 0.0f};
+
+  public:
+    LightClusters();
+    ~LightClusters();
+
+    LightClusters(const LightClusters &) = delete;
+    LightClusters &operator=(const LightClusters &) = delete;
+
+    // world space lights, uploaded once
+    void setLights(const std::vector<Light> &lights, const DirectionalLight &_directionalLight);
+
+    // rebuilds the cluster lists for the camera of this frame, before anything lit is drawn
+    void update(const mat4 &view, const mat4 &projection);
+
+    u32 getLightCount() const
+    {
+        return lightCount;
+    }
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "typedef.hpp"
+
+// one level of detail, a range of the mesh index buffer
+struct MeshLOD
+{
+    u32 firstIndex;
+    u32 indexCount;
+    f32 error; // geometric error against the full mesh, object units
+};
+
+// spatial piece of a mesh with levels of its own, so the parts far from the camera lose detail while
+// the part around it stays fine. The seams between clusters are kept at every level
+struct MeshCluster
+{
+    vec4 sphere; // object space
+    std::vector<MeshLOD> lods;
+    u32 currentLOD = 0;
+};
+
+// Levels are picked on the error they show on screen. An error e seen from a distance d covers
+// e / d * screenHeight / (2 tan(fov / 2)) pixels, so a wider fov or a smaller window lowers the detail.
+namespace LODSettings
+{
+extern f32 maxPixelError;
+// a coarser level is only taken once its error is this fraction under the limit, otherwise an
+// object sitting right at the threshold would swap levels every frame
+extern f32 hysteresis;
+
+// pixels covered by one unit seen from a distance of one unit, with the current fov and render size
+f32 pixelsPerUnit();
+
+// level to draw out of levels, errorOf(i) being the error of level i (growing with i) and
+// current the level drawn last frame
+template <typename ErrorOf> u32 select(u32 levels, u32 current, f32 distance, ErrorOf errorOf)
+{
+    f32 scale = pixelsPerUnit() / max(distance, 0.1f);
+    current = min(current, levels - 1);
+
+    u32 coarsest = 0;
+    while (coarsest + 1 < levels && errorOf(coarsest + 1) * scale <= maxPixelError)
+        coarsest++;
+
+    // too coarse for the distance, refine right away
+    if (coarsest < current)
+        return coarsest;
+
+    u32 next = current;
+    while (next < coarsest && errorOf(next + 1) * scale <= maxPixelError * (1.0f - hysteresis))
+        next++;
+    return next;
+}
+} // namespace LODSettings
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+
+#include "typedef.hpp"
+
+// Read only view of a whole file through the OS page cache, nothing is copied until it's touched
+class MappedFile
+{
+  private:
+    const u8 *bytes = nullptr;
+    u64 length = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+
+  public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool isOpen() const
+    {
+        return bytes != nullptr;
+    }
+
+    const u8 *data() const
+    {
+        return bytes;
+    }
+
+    u64 size() const
+    {
+        return length;
+    }
+};
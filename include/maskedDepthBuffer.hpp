@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "typedef.hpp"
+
+using namespace glm;
+
+// Low resolution, conservative depth buffer in the way of Masked Software Occlusion Culling
+// (Andersson, Hasselgren & Akenine-Möller 2015). The screen is cut in 8x4 pixel tiles, every tile
+// keeps a far depth for the whole tile plus a coverage mask with the far depth of the pixels it
+// covers. Triangles only ever update whole tiles, so pixels never store a depth and the tiles are
+// the coarse level queries go through.
+// Pure CPU: screen space in pixels with y up, depth in [0, 1] with 0 at the near plane.
+class MaskedDepthBuffer
+{
+  public:
+    static constexpr u32 TILE_WIDTH = 8;
+    static constexpr u32 TILE_HEIGHT = 4;
+    static constexpr u32 FULL_MASK = ~0u;
+
+    struct Tile
+    {
+        u32 mask;   // pixels of the working layer, bit x + y * TILE_WIDTH
+        f32 zMax0;  // nothing in the tile is further than this
+        f32 zMax1;  // nothing under the mask is further than this
+    };
+
+  private:
+    u32 width = 0;
+    u32 height = 0;
+    u32 tilesX = 0;
+    u32 tilesY = 0;
+    std::vector<Tile> tiles;
+
+    void updateTile(Tile &tile, u32 coverage, f32 z);
+
+  public:
+    MaskedDepthBuffer() = default;
+    MaskedDepthBuffer(u32 _width, u32 _height)
+    {
+        resize(_width, _height);
+    }
+
+    // rounded up to whole tiles
+    void resize(u32 _width, u32 _height);
+    void clear();
+
+    u32 getWidth() const
+    {
+        return width;
+    }
+
+    u32 getHeight() const
+    {
+        return height;
+    }
+
+    u32 getTilesX() const
+    {
+        return tilesX;
+    }
+
+    u32 getTilesY() const
+    {
+        return tilesY;
+    }
+
+    const Tile &getTile(u32 x, u32 y) const
+    {
+        return tiles[x + y * tilesX];
+    }
+
+    // counter-clockwise triangles only, the others are back faces. Only the tile rows in
+    // [firstTileRow, endTileRow) are written, disjoint row ranges can be filled from different threads
+    void rasterizeTriangle(vec3 v0, vec3 v1, vec3 v2, u32 firstTileRow = 0, u32 endTileRow = ~0u);
+
+    // false when every tile under the pixel rectangle [rectMin, rectMax] is closer than zMin
+    bool testRect(vec2 rectMin, vec2 rectMax, f32 zMin) const;
+
+    // what the buffer knows about one pixel, for debugging
+    f32 getPixelDepth(u32 x, u32 y) const;
+};
+
+// Scalar reference of MaskedDepthBuffer, one exact depth per pixel and no SIMD. Same pixel centers
+// and edge rules, the edge functions are stepped in the same order so both agree on the pixels lying
+// on an edge. Wherever the masked buffer is right, its depth is never in front of this one.
+class ReferenceDepthBuffer
+{
+  public:
+    // float noise between the tile depth of the masked buffer and the per pixel depth here
+    static constexpr f32 DEPTH_EPSILON = 1e-5f;
+
+  private:
+    u32 width = 0;
+    u32 height = 0;
+    std::vector<f32> depths;
+
+  public:
+    // same size as the masked buffer, whole tiles
+    void resize(u32 _width, u32 _height);
+    void clear();
+
+    u32 getPixelCount() const
+    {
+        return depths.size();
+    }
+
+    void rasterizeTriangle(vec3 v0, vec3 v1, vec3 v2);
+    bool testRect(vec2 rectMin, vec2 rectMax, f32 zMin) const;
+
+    f32 getPixelDepth(u32 x, u32 y) const
+    {
+        return depths[x + y * width];
+    }
+
+    // pixels where the masked buffer claims something closer than what was drawn
+    u32 countMismatches(const MaskedDepthBuffer &masked) const;
+};
@@ -2,6 +2,9 @@
 
 #include <vector>
 
+#include "GLState.hpp"
+#include "materialParams.hpp"
+#include "mipStreamer.hpp"
 #include "shader.hpp"
 #include "texture.hpp"
 #include "typedef.hpp"
@@ -11,38 +14,85 @@ class Material
   private:
     ShaderProgramPtr shader;
     std::vector<TexturePtr> textures;
+    // name of each texture slot, slot i is bound to texture unit i (empty for unnamed slots)
+    std::vector<std::string> textureNames;
+    MaterialParams params;
+    // shaders built with TEXTURE_ARRAYS sample sampler2DArray, the textures are bound through their array
+    bool textureArrays = false;
+
+    void bindTexture(u32 unit)
+    {
+        TexturePtr &texture = textures[unit];
+        if (!textureArrays)
+        {
+            texture->bind(unit);
+            return;
+        }
+
+        // added after the scene grouped its textures, gets an array of its own. Pinned first like
+        // AssetManager::buildTextureArrays does, the layer is copied with every level
+        if (!texture->getArray())
+        {
+            texture->pinLevels();
+            texture->setArrayLayer(std::make_shared<TextureArray>(std::vector<TexturePtr>{texture}), 0);
+        }
+        texture->getArray()->bind(unit);
+        shader->setTextureLayer(unit, texture->getLayer());
+    }
 
   public:
-    Material(ShaderProgramPtr shader) : shader(shader)
+    Material(ShaderProgramPtr shader) : shader(shader), textureArrays(shader->hasDefine("TEXTURE_ARRAYS"))
     {
     }
 
     ~Material() = default;
 
-    void addTexture(TexturePtr texture)
+    void addTexture(TexturePtr texture, const std::string &slotName = "")
     {
         textures.push_back(texture);
+        textureNames.push_back(slotName);
     }
-    void use() const
+
+    // swaps the texture of a named slot
+    void setTexture(const std::string &slotName, TexturePtr texture)
     {
-        shader->use();
-        for (size_t i = 0; i < textures.size(); i++)
+        for (size_t i = 0; i < textureNames.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i);
-            textures[i]->bind();
-
-            shader->setUniform(UNIFORM_LOCATIONS::TEXTURE0 + i, (i32)i);
+            if (textureNames[i] == slotName)
+            {
+                textures[i] = texture;
+                return;
+            }
         }
+        std::cerr << "Material has no texture slot " << slotName << std::endl;
     }
 
-    void stop() const
+    void use()
     {
-        shader->stop();
+        shader->use();
+        shader->setTextureUnits(textures.size());
         for (size_t i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i);
-            textures[i]->unbind();
+            bindTexture(i);
         }
+        params.bind();
+    }
+
+    // equal for materials drawing with the same program and first texture, the render queues keep
+    // them next to each other (collisions only cost a rebind)
+    u16 getStateKey() const
+    {
+        u32 textureID = 0;
+        if (!textures.empty())
+            textureID = textureArrays && textures[0]->getArray() ? textures[0]->getArray()->getTextureID()
+                                                                   : textures[0]->getTextureID();
+        return (u16)((shader->getID() << 8) ^ textureID);
+    }
+
+    void stop() const
+    {
+        // program and textures are left bound on purpose, the next material using
+        // the same ones won't have to rebind anything (see GLState)
     }
 
     ShaderProgramPtr getShader() const
@@ -54,6 +104,31 @@ class Material
     {
         return textures.size();
     }
+
+    // one pixel of a draw covers uvPerPixel uv units, see MipStreamer
+    void requestTextureMips(f32 uvPerPixel)
+    {
+        for (const TexturePtr &texture : textures)
+        {
+            getMipStreamer().request(*texture, uvPerPixel);
+        }
+    }
+
+    const std::vector<TexturePtr> &getTextures() const
+    {
+        return textures;
+    }
+
+    bool usesTextureArrays() const
+    {
+        return textureArrays;
+    }
+
+    // shared by every mesh of the material, meshes override values in their own copy (see Mesh::setParam)
+    MaterialParams &getParams()
+    {
+        return params;
+    }
 };
 
 using MaterialPtr = std::shared_ptr<::Material>;
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "typedef.hpp"
+
+using namespace glm;
+
+enum class MaterialParamType
+{
+    FLOAT,
+    VEC2,
+    VEC3,
+    VEC4,
+    COLOR, // vec4 in the block, only differs in how scene.xml parses it
+};
+
+// All the parameter blocks in one uniform buffer, each block gets its own slice bound with
+// glBindBufferRange at BUFFER_OBJECT_BINDINGS::MATERIAL. Grows by copying to a bigger buffer.
+class MaterialParamBuffer
+{
+  private:
+    struct Slice
+    {
+        u32 offset;
+        u32 size;
+    };
+
+    GLuint bufferID = 0;
+    u32 capacity = 0;
+    u32 top = 0;
+    GLint alignment = 256;
+    // sorted by offset, never two touching ones
+    std::vector<Slice> freeSlices;
+
+    // range bound at the material binding, the same block drawn again doesn't rebind
+    GLuint boundBufferID = 0;
+    u32 boundOffset = 0;
+
+    i32 uploads = 0;
+
+    void grow(u32 minCapacity);
+
+  public:
+    static constexpr u32 INITIAL_CAPACITY = 64 * 1024;
+
+    MaterialParamBuffer();
+    ~MaterialParamBuffer();
+
+    MaterialParamBuffer(const MaterialParamBuffer &) = delete;
+    MaterialParamBuffer &operator=(const MaterialParamBuffer &) = delete;
+
+    u32 allocate(u32 size);
+    void free(u32 offset, u32 size);
+    void upload(u32 offset, const void *data, u32 size);
+    void bind(u32 offset, u32 size);
+
+    // blocks uploaded so far, stays put while no value changes
+    i32 *getUploadCounter()
+    {
+        return &uploads;
+    }
+};
+
+MaterialParamBuffer &getMaterialParamBuffer();
+
+// Named, typed values of a material packed in std140 order, the shader declares the same members
+// in the same order in a "layout(std140, binding = 1) uniform MaterialParams" block. The values
+// are only uploaded to their slice when one of them changes.
+// An instance block is a mesh's copy of its material's block: the values it sets are its own, the
+// others follow the material.
+class MaterialParams
+{
+  public:
+    struct Param
+    {
+        std::string name;
+        MaterialParamType type;
+        u32 offset;
+        u32 size;
+    };
+
+  private:
+    // declarations are shared with the instances, a material declares everything before they exist
+    std::shared_ptr<std::vector<Param>> params = std::make_shared<std::vector<Param>>();
+    std::vector<u8> data;
+    u32 sliceOffset = 0;
+    u32 sliceSize = 0;
+    bool dirty = false;
+    u32 version = 0;
+
+    // instance blocks only
+    const MaterialParams *parent = nullptr;
+    u32 parentVersion = 0;
+    std::vector<bool> overridden;
+
+    const Param *find(const std::string &name, MaterialParamType type) const;
+    void write(const std::string &name, MaterialParamType type, const void *value, u32 size);
+    void resize();
+
+  public:
+    MaterialParams() = default;
+    ~MaterialParams();
+
+    MaterialParams(const MaterialParams &) = delete;
+    MaterialParams &operator=(const MaterialParams &) = delete;
+
+    // a block following this one until it overrides a value
+    std::unique_ptr<MaterialParams> makeInstance() const;
+
+    // appended at the next std140 offset, with its initial value
+    void declare(const std::string &name, f32 value);
+    void declare(const std::string &name, vec2 value);
+    void declare(const std::string &name, vec3 value);
+    void declare(const std::string &name, vec4 value, MaterialParamType type = MaterialParamType::VEC4);
+
+    void set(const std::string &name, f32 value);
+    void set(const std::string &name, vec2 value);
+    void set(const std::string &name, vec3 value);
+    // vec4 and color params alike
+    void set(const std::string &name, vec4 value);
+
+    bool empty() const
+    {
+        return params->empty();
+    }
+
+    const std::vector<Param> &getParams() const
+    {
+        return *params;
+    }
+
+    // uploads the values if they changed and binds the slice for the next draws
+    void bind();
+};
@@ -4,13 +4,17 @@
 #include <type_traits>
 #include <vector>
 
+#include "GLState.hpp"
 #include "camera.hpp"
 #include "globals.hpp"
+#include "lod.hpp"
 #include "material.hpp"
 #include "renderLayer.hpp"
+#include "ringBuffer.hpp"
 #include "texture.hpp"
 #include "transform3D.hpp"
 #include "typedef.hpp"
+#include "vertexFormat.hpp"
 
 #include "component.hpp"
 #include "gameObject.hpp"
@@ -30,129 +34,6 @@
 
 using namespace glm;
 
-class ShadowMappedDirectionalLight
-{
-  private:
-    Transform3D transform;
-    u32 shadowMapFBOID;
-    u32 shadowMapTextureID;
-    u32 shadowMapWidth;
-    u32 shadowMapHeight;
-    mat4 lightSpaceMatrix;
-    vec3 color;
-    f32 intensity;
-
-    void genShadowMapFBO()
-    {
-        glGenFramebuffers(1, &shadowMapFBOID);
-        glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBOID);
-
-        glGenTextures(1, &shadowMapTextureID);
-        glBindTexture(GL_TEXTURE_2D, shadowMapTextureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, shadowMapWidth, shadowMapHeight, 0, GL_DEPTH_COMPONENT,
-                     GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        GLfloat borderColor[] = {1.0, 1.0, 1.0, 1.0};
-        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMapTextureID, 0);
-        glDrawBuffer(GL_NONE);
-        glReadBuffer(GL_NONE);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
-
-    void calculateLightSpaceMatrix()
-    {
-        f32 near_plane = 0.01f, far_plane = 100.0f;
-        f32 orthoSize = 50.0f;
-        lightSpaceMatrix =
-            ortho(-orthoSize, orthoSize, -orthoSize, orthoSize, near_plane, far_plane) * transform.getModel();
-    }
-
-  public:
-    ShadowMappedDirectionalLight(Transform3D _transform, u32 _shadowMapWidth, u32 _shadowMapHeight,
-                                 vec3 _color = vec3(1.0f), f32 _intensity = 1.0f)
-        : transform(_transform), shadowMapWidth(_shadowMapWidth), shadowMapHeight(_shadowMapHeight), color(_color),
-          intensity(_intensity)
-    {
-        genShadowMapFBO();
-        calculateLightSpaceMatrix();
-    }
-
-    void bind()
-    {
-        glViewport(0, 0, shadowMapWidth, shadowMapHeight);
-        glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBOID);
-        glClear(GL_DEPTH_BUFFER_BIT);
-    }
-
-    void unbind()
-    {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
-
-    u32 getShadowMapTextureID()
-    {
-        return shadowMapTextureID;
-    }
-
-    mat4 getLightSpaceMatrix()
-    {
-        return lightSpaceMatrix;
-    }
-
-    vec3 getColor()
-    {
-        return color;
-    }
-
-    f32 getIntensity()
-    {
-        return intensity;
-    }
-
-    Transform3D getTransform()
-    {
-        return transform;
-    }
-
-    void saveShadowMapToPPM(std::string filename)
-    {
-        u32 size = shadowMapWidth * shadowMapHeight;
-        f32 *dataFloat = new f32[size];
-        u8 *data = new u8[size];
-        glBindTexture(GL_TEXTURE_2D, shadowMapTextureID);
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, GL_FLOAT, dataFloat);
-        f32 min = 1.0f;
-        f32 max = 0.0f;
-
-        for (u32 i = 0; i < size; i++)
-        {
-            if (dataFloat[i] < min)
-                min = dataFloat[i];
-            if (dataFloat[i] > max)
-                max = dataFloat[i];
-        }
-
-        for (u32 i = 0; i < size; i++)
-        {
-            data[i] = (u8)(255.0f * (dataFloat[i] - min) / (max - min));
-        }
-
-        std::ofstream file(filename, std::ios::binary);
-
-        std::string header =
-            "P5\n" + std::to_string(shadowMapWidth) + " " + std::to_string(shadowMapHeight) + "\n255\n";
-        file.write(header.c_str(), header.size());
-        file.write((char *)data, size);
-
-        delete[] dataFloat;
-    }
-};
-
 std::shared_ptr<DirectionalLight> getSun();
 
 class ElementBufferObject
@@ -171,11 +52,11 @@ class ElementBufferObject
 
     GLuint bufferID;
 
+    // DSA: creating the buffer must not touch the element binding of whatever VAO is currently bound
     inline void genBuffer()
     {
-        glGenBuffers(1, &bufferID);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferID);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, dataLength * elementSize, data, GL_STATIC_DRAW);
+        glCreateBuffers(1, &bufferID);
+        glNamedBufferData(bufferID, dataLength * elementSize, data, usage);
     }
 
   public:
@@ -197,19 +78,21 @@ class ElementBufferObject
         glDeleteBuffers(1, &bufferID);
     }
 
-    inline void bind()
+    inline GLuint getBufferID() const
     {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferID);
+        return bufferID;
     }
 
-    inline void unbind()
+    // drawID ends up in gl_BaseInstance, the shaders use it to fetch their DrawData
+    inline void draw(u32 drawID = 0) const
     {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glDrawElementsInstancedBaseInstance(mode, dataLength, type, (void *)offset, 1, drawID);
     }
 
-    inline void draw() const
+    // only count elements from first on, picks a level of detail out of the buffer
+    inline void draw(u32 drawID, u32 first, u32 count) const
     {
-        glDrawElements(mode, dataLength, type, (void *)offset);
+        glDrawElementsInstancedBaseInstance(mode, count, type, (void *)(offset + first * elementSize), 1, drawID);
     }
 
     void update(void *_data)
@@ -243,6 +126,18 @@ class VertexBufferObject
     {
     }
 
+    // stream packed with a VertexFormat
+    VertexBufferObject(const VertexAttribute &attribute, GLuint _location, void *_data, u64 _dataLength)
+        : elementCount(attribute.components), elementSize(0), location(_location), type(attribute.type),
+          normalized(attribute.normalized), stride(attribute.stride), data(_data), dataLength(_dataLength)
+    {
+    }
+
+    inline u64 getVertexSize() const
+    {
+        return stride ? stride : elementCount * elementSize;
+    }
+
     inline void deleteBuffer()
     {
         glDeleteBuffers(1, &bufferID);
@@ -252,35 +147,29 @@ class VertexBufferObject
     {
         // go look there
         // https://stackoverflow.com/questions/21652546/what-is-the-role-of-glbindvertexarrays-vs-glbindbuffer-and-what-is-their-relatio
-        glGenBuffers(1, &bufferID);
+        glCreateBuffers(1, &bufferID);
         if (bufferID == 0)
         {
             std::cerr << "Failed to create Vertex Attrib Object.\n";
             exit(EXIT_FAILURE);
         }
-        glBindBuffer(GL_ARRAY_BUFFER, bufferID);
-        glBufferData(GL_ARRAY_BUFFER, dataLength * elementCount * elementSize, data, GL_STATIC_DRAW);
+        glNamedBufferData(bufferID, dataLength * getVertexSize(), data, usage);
     }
 
-    inline void bind()
+    // record the attribute in the VAO once, drawing then only needs the VAO to be bound
+    inline void attach(GLuint vaoID)
     {
-        glEnableVertexAttribArray(location);
-        glBindBuffer(GL_ARRAY_BUFFER, bufferID);
-        glVertexAttribPointer(location, elementCount, type, normalized, stride, (void *)offset);
-    }
-
-    inline void unbind()
-    {
-        glDisableVertexAttribArray(location);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glEnableVertexArrayAttrib(vaoID, location);
+        glVertexArrayVertexBuffer(vaoID, location, bufferID, offset, getVertexSize());
+        glVertexArrayAttribFormat(vaoID, location, elementCount, type, normalized, 0);
+        glVertexArrayAttribBinding(vaoID, location, location);
     }
 
     void update(void *_data)
     {
         data = _data;
 
-        glBindBuffer(GL_ARRAY_BUFFER, bufferID);
-        glBufferData(GL_ARRAY_BUFFER, dataLength * elementCount, data, GL_STATIC_DRAW);
+        glNamedBufferData(bufferID, dataLength * getVertexSize(), data, usage);
     }
 };
 
@@ -307,7 +196,30 @@ class Mesh : public ComponentBase<Mesh>, public std::enable_shared_from_this<Mes
     std::vector<vec3> normals;
     std::vector<vec2> uvs;
 
+    // what the GPU buffers were made from, see VertexFormat
+    PackedVertices packed;
+
+    // level 0 of every cluster comes first in lodIndices and the EBO, together they are the whole
+    // mesh. The simplified levels follow. Collisions and picking keep using the full indices
+    std::vector<MeshCluster> clusters;
+    std::vector<uivec3> lodIndices;
+
+    vec4 boundingSphere = vec4(0.0f);
+    vec3 boundingBoxMin = vec3(0.0f);
+    vec3 boundingBoxMax = vec3(0.0f);
+    bool boundingSphereValid = false;
+    // uv units per object unit, negative until computed
+    f32 uvDensity = -1.0f;
+
     bool wireframe = false;
+    // drawn by the MeshManager static geometry batches instead of one draw call at a time
+    bool staticGeometry = false;
+    bool castShadows = true;
+    vec4 materialOverride = vec4(1.0f);
+    // made on the first setParam
+    std::unique_ptr<MaterialParams> params;
+    MaterialParams &getInstanceParams();
+    u32 drawID = 0;
     RenderLayerPtr renderLayer;
     std::string name;
     static u32 nameCounter;
@@ -316,66 +228,39 @@ class Mesh : public ComponentBase<Mesh>, public std::enable_shared_from_this<Mes
     Mesh(MaterialPtr _mat, RenderLayerPtr renderLayer = RenderLayer::DEFAULT)
         : material(_mat), renderLayer(renderLayer), name(std::to_string(nameCounter++))
     {
-        glGenVertexArrays(1, &vaoID);
+        glCreateVertexArrays(1, &vaoID);
     }
-    Mesh(MaterialPtr _mat, std::string filename, RenderLayerPtr renderLayer = RenderLayer::DEFAULT)
+    Mesh(MaterialPtr _mat, std::string filename, RenderLayerPtr renderLayer = RenderLayer::DEFAULT,
+         bool quantizePositions = false)
         : material(_mat), renderLayer(renderLayer), name(stripPath(filename))
     {
-        glGenVertexArrays(1, &vaoID);
+        glCreateVertexArrays(1, &vaoID);
 
         FromFile(filename.c_str(), indices, vertices, normals, uvs);
 
-        EBOptr ebo = std::make_unique<ElementBufferObject>((void *)indices.data(), indices.size() * 3);
-
-        VertexBufferObject vbo1(3, sizeof(f32), 0, GL_FLOAT, (void *)vertices.data(), vertices.size());
-        VertexBufferObject vbo2(3, sizeof(f32), 1, GL_FLOAT, (void *)normals.data(), normals.size());
-        VertexBufferObject vbo3(2, sizeof(f32), 2, GL_FLOAT, (void *)uvs.data(), uvs.size());
-
-        setEBO(ebo);
-
-        addVBO(vbo1);
-        addVBO(vbo2);
-        addVBO(vbo3);
+        uploadVertices(quantizePositions);
     }
 
     Mesh(MaterialPtr _mat, std::vector<uivec3> _indices, std::vector<vec3> _vertices, std::vector<vec3> _normals,
          std::vector<vec2> _uvs, RenderLayerPtr renderLayer = RenderLayer::DEFAULT)
         : material(_mat), indices(_indices), vertices(_vertices), normals(_normals), uvs(_uvs), renderLayer(renderLayer)
     {
-        glGenVertexArrays(1, &vaoID);
-
-        EBOptr ebo = std::make_unique<ElementBufferObject>((void *)indices.data(), indices.size() * 3);
-
-        VertexBufferObject vbo1(3, sizeof(f32), 0, GL_FLOAT, (void *)vertices.data(), vertices.size());
-        VertexBufferObject vbo2(3, sizeof(f32), 1, GL_FLOAT, (void *)normals.data(), normals.size());
-        VertexBufferObject vbo3(2, sizeof(f32), 2, GL_FLOAT, (void *)uvs.data(), uvs.size());
-
-        setEBO(ebo);
+        glCreateVertexArrays(1, &vaoID);
 
-        addVBO(vbo1);
-        addVBO(vbo2);
-        addVBO(vbo3);
+        uploadVertices();
     }
 
     Mesh(MaterialPtr _mat, std::vector<uivec3> _indices, std::vector<vec3> _vertices, std::vector<vec3> _normals)
         : material(_mat), indices(_indices), vertices(_vertices), normals(_normals)
     {
-        glGenVertexArrays(1, &vaoID);
-
-        EBOptr ebo = std::make_unique<ElementBufferObject>((void *)indices.data(), indices.size() * 3);
-
-        VertexBufferObject vbo1(3, sizeof(f32), 0, GL_FLOAT, (void *)vertices.data(), vertices.size());
-        VertexBufferObject vbo2(3, sizeof(f32), 1, GL_FLOAT, (void *)normals.data(), normals.size());
-
-        setEBO(ebo);
+        glCreateVertexArrays(1, &vaoID);
 
-        addVBO(vbo1);
-        addVBO(vbo2);
+        uploadVertices();
     }
 
     Mesh(MaterialPtr _mat, EBOptr &_ebo, std::vector<VertexBufferObject> _vbos) : material(_mat)
     {
-        glGenVertexArrays(1, &vaoID);
+        glCreateVertexArrays(1, &vaoID);
 
         setEBO(_ebo);
 
@@ -391,47 +276,58 @@ class Mesh : public ComponentBase<Mesh>, public std::enable_shared_from_this<Mes
 
     void setEBO(EBOptr &_ebo);
 
+    // packs the CPU copies into the vertex format and (re)creates the GPU buffers out of them
+    void uploadVertices(bool quantizePositions = false);
+    void uploadIndices();
+
     virtual void bind();
 
     virtual void draw();
 
     virtual void unbind();
 
-    template <typename T, std::enable_if_t<std::is_same<T, mat4>::value || std::is_same<T, vec3>::value ||
-                                               std::is_same<T, vec4>::value || std::is_same<T, f32>::value ||
-                                               std::is_same<T, i32>::value || std::is_same<T, u32>::value,
-                                           bool> = true>
-    MeshPtr setUniform(u32 location, const T &value);
-
-    template <typename T, std::enable_if_t<std::is_same<T, f64>::value, bool> = true>
-    MeshPtr setUniform(u32 location, const T &value);
-
-    template <typename T,
-              std::enable_if_t<std::is_same<T, i64>::value || std::is_same<T, i16>::value || std::is_same<T, i8>::value,
-                               bool> = true>
-    MeshPtr setUniform(u32 location, const T &value);
+    // values of this mesh only, in its own copy of the material's parameter block. The other
+    // values keep following the material
+    MeshPtr setParam(const std::string &name, f32 value);
+    MeshPtr setParam(const std::string &name, vec2 value);
+    MeshPtr setParam(const std::string &name, vec3 value);
+    MeshPtr setParam(const std::string &name, vec4 value);
 
-    template <typename T,
-              std::enable_if_t<std::is_same<T, u64>::value || std::is_same<T, u16>::value || std::is_same<T, u8>::value,
-                               bool> = true>
-    MeshPtr setUniform(u32 location, const T &value);
+    // the block the mesh is drawn with, its own if it overrode anything
+    MaterialParams *getParams() const
+    {
+        return params ? params.get() : &material->getParams();
+    }
 
     MeshPtr addTexture(TexturePtr &texture);
     MeshPtr addTexture(std::string filename);
 
-    void bind(mat4 objMat)
+    // camera uniforms shared by every draw of the frame
+    static void setViewUniforms(const ShaderProgramPtr &shader)
     {
         using namespace EngineGlobals;
-        material->use();
-        material->getShader()->setUniform(UNIFORM_LOCATIONS::MODEL_MATRIX, objMat);
-        material->getShader()->setUniform(UNIFORM_LOCATIONS::VIEW_MATRIX, getViewMatrix());
-        material->getShader()->setUniform(UNIFORM_LOCATIONS::PROJECTION_MATRIX, projectionMatrix);
-        material->getShader()->setUniform(UNIFORM_LOCATIONS::PREV_MVP, getGameObject()->getPrevMVP());
+        shader->setUniform(UNIFORM_LOCATIONS::VIEW_MATRIX, getViewMatrix());
+        shader->setUniform(UNIFORM_LOCATIONS::PROJECTION_MATRIX, projectionMatrix);
+        shader->setUniform(UNIFORM_LOCATIONS::SCREEN_RESOLUTION, vec2(EngineGlobals::renderSize));
+        shader->setUniform(UNIFORM_LOCATIONS::VIEW_POS, camera->getTransform().getPosition());
+    }
+
+    // per-draw data for this frame, also rolls the previous MVP over
+    DrawData makeDrawData(mat4 objMat)
+    {
+        using namespace EngineGlobals;
+        DrawData data = {objMat, getGameObject()->getPrevMVP(), materialOverride, packed.positionScale,
+                         packed.positionOffset};
         mat4 mvp = projectionMatrix * getViewMatrix() * objMat;
         getGameObject()->setPrevMVP(mvp);
+        return data;
+    }
 
-        material->getShader()->setUniform(UNIFORM_LOCATIONS::SCREEN_RESOLUTION, vec2(EngineGlobals::windowSize));
-        material->getShader()->setUniform(UNIFORM_LOCATIONS::VIEW_POS, camera->getTransform().getPosition());
+    void bind(mat4 objMat)
+    {
+        material->use();
+        setViewUniforms(material->getShader());
+        drawID = getDrawDataBuffer().push(makeDrawData(objMat));
 
         Mesh::bind();
     }
@@ -447,13 +343,34 @@ class Mesh : public ComponentBase<Mesh>, public std::enable_shared_from_this<Mes
 
     void draw(mat4 objMat)
     {
-        if (wireframe)
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        getGLState().setPolygonMode(wireframe ? GL_LINE : GL_FILL);
 
         bind(objMat);
-        ebo->draw();
+        if (clusters.empty())
+        {
+            ebo->draw(drawID);
+        }
+        else
+        {
+            for (u32 c = 0; c < clusters.size(); c++)
+            {
+                const MeshLOD &lod = clusters[c].lods[selectLOD(objMat, c)];
+                ebo->draw(drawID, lod.firstIndex, lod.indexCount);
+            }
+        }
         unbind();
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    }
+
+    // depth only draw of the finest level for the shadow maps, the depth shader has to be bound already
+    void drawDepth(mat4 objMat)
+    {
+        u32 id = getDrawDataBuffer().push(
+            {objMat, mat4(1.0f), materialOverride, packed.positionScale, packed.positionOffset});
+        getGLState().bindVertexArray(vaoID);
+        if (clusters.empty())
+            ebo->draw(id);
+        else
+            ebo->draw(id, 0, getFullIndexCount());
     }
 
     void ManualUpdate()
@@ -468,6 +385,86 @@ class Mesh : public ComponentBase<Mesh>, public std::enable_shared_from_this<Mes
         return renderLayer;
     }
 
+    // per-draw tint handed to the shader through DrawData::materialOverride, multiplies the color of
+    // the shaders drawn through shader/3D.vert, white leaves it as is
+    void setMaterialOverride(vec4 value)
+    {
+        materialOverride = value;
+    }
+
+    vec4 getMaterialOverride() const
+    {
+        return materialOverride;
+    }
+
+    // static meshes never move relative to their object and get merged with the other static
+    // meshes sharing their vertex format, see StaticGeometry
+    void setStatic(bool value);
+
+    bool isStatic() const
+    {
+        return staticGeometry;
+    }
+
+    // drawn in the shadow maps, unless its layer doesn't depth test
+    void setCastShadows(bool value)
+    {
+        castShadows = value;
+    }
+
+    bool getCastShadows() const
+    {
+        return castShadows;
+    }
+
+    MaterialPtr getMaterial() const
+    {
+        return material;
+    }
+
+    // object space sphere around the vertices, centered on their bounding box
+    vec4 getBoundingSphere();
+
+    // average uv units per object unit over the surface, how stretched or tiled the textures are
+    f32 getUVDensity();
+
+    // tells the mip streamer which levels of the material's textures this draw needs
+    void requestTextureMips(const mat4 &view, const mat4 &objMat);
+
+    // object space box around the vertices
+    void getBoundingBox(vec3 &boxMin, vec3 &boxMax)
+    {
+        getBoundingSphere();
+        boxMin = boundingBoxMin;
+        boxMax = boundingBoxMax;
+    }
+
+    // how far in front of the camera the bounding sphere center is, for the render queue
+    f32 getViewDepth(const mat4 &view, const mat4 &objMat)
+    {
+        return -(view * objMat * vec4(vec3(getBoundingSphere()), 1.0f)).z;
+    }
+
+    // simplifies the mesh into count more levels, each with ratio times the triangles of the
+    // previous one. Stops early once the simplifier can't remove anything more. Clustered, the mesh
+    // is first cut in spatial clusters (see splitIntoClusters) that each get their own levels, for
+    // meshes the camera moves around in like the static level geometry
+    void generateLODs(u32 count, f32 ratio = 0.5f, bool clustered = false);
+
+    // level of the cluster to draw this frame given where the object is, see LODSettings
+    u32 selectLOD(const mat4 &objMat, u32 cluster);
+
+    const std::vector<MeshCluster> &getClusters() const
+    {
+        return clusters;
+    }
+
+    // indices of the finest level of every cluster, from the start of the EBO
+    u32 getFullIndexCount() const
+    {
+        return indices.size() * 3;
+    }
+
     std::string getName()
     {
         return name;
@@ -482,6 +479,8 @@ class Mesh : public ComponentBase<Mesh>, public std::enable_shared_from_this<Mes
     friend class GameObject;
     friend class Helper;
     friend class rp3dTriangleMeshHelper;
+    friend class StaticGeometry;
+    friend class OcclusionCuller;
 
     friend rp3d::TriangleMesh *toRP3DMesh(const MeshPtr &mesh);
 };
@@ -492,12 +491,19 @@ class LODMesh : public ComponentBase<LODMesh>
 {
   private:
     std::vector<MeshPtr> meshes;
-    std::vector<f32> distances;
+    // geometric error of each mesh, object units
+    std::vector<f32> errors;
     u32 currentMesh = 0;
 
   public:
-    LODMesh(std::vector<MeshPtr> _meshes, std::vector<f32> _distances) : meshes(_meshes), distances(_distances)
+    // hand made levels come with the distance they stop being used at. That becomes the error
+    // reaching the pixel limit at this distance with the starting fov, the fov is followed from there
+    LODMesh(std::vector<MeshPtr> _meshes, std::vector<f32> _distances) : meshes(_meshes), errors(meshes.size(), 0.0f)
     {
+        for (size_t i = 1; i < meshes.size() && i <= _distances.size(); i++)
+        {
+            errors[i] = LODSettings::maxPixelError * _distances[i - 1] / LODSettings::pixelsPerUnit();
+        }
     }
 
     void Update() override
@@ -505,17 +511,8 @@ class LODMesh : public ComponentBase<LODMesh>
         using namespace EngineGlobals;
         vec3 cameraPosition = camera->getTransform().getPosition();
         f32 d = distance(getGameObject()->getTransform().getPosition(), cameraPosition);
-        for (size_t i = 0; i < distances.size(); i++)
-        {
-            if (d < distances[i])
-            {
-                currentMesh = i;
-                meshes[i]->draw(getGameObject()->getObjectMatrix());
-                return;
-            }
-        }
-        currentMesh = distances.size() - 1;
-        meshes.back()->draw(getGameObject()->getObjectMatrix());
+        currentMesh = LODSettings::select(meshes.size(), currentMesh, d, [this](u32 i) { return errors[i]; });
+        meshes[currentMesh]->draw(getGameObject()->getObjectMatrix());
     }
 
     MeshPtr getCurrentMesh()
@@ -533,8 +530,6 @@ class Skybox : public Mesh
   public:
     Skybox(MaterialPtr _mat, CubeMapPtr _cubeMap) : Mesh(_mat), cubeMap(_cubeMap)
     {
-        glGenVertexArrays(1, &vaoID);
-
         std::vector<uivec3> indices;
         std::vector<vec3> vertices;
         std::vector<vec3> normals;
@@ -563,13 +558,11 @@ class Skybox : public Mesh
         view[3] = vec4(0, 0, 0, 1);
         material->getShader()->setUniform(UNIFORM_LOCATIONS::VIEW_MATRIX, view);
         material->getShader()->setUniform(UNIFORM_LOCATIONS::PROJECTION_MATRIX, projectionMatrix);
-        material->getShader()->setUniform(UNIFORM_LOCATIONS::MODEL_MATRIX, mat4(1.0f));
-        material->getShader()->setUniform(UNIFORM_LOCATIONS::PREV_MVP, prevMVP);
-        material->getShader()->setUniform(UNIFORM_LOCATIONS::SCREEN_RESOLUTION, vec2(EngineGlobals::windowSize));
+        material->getShader()->setUniform(UNIFORM_LOCATIONS::SCREEN_RESOLUTION, vec2(EngineGlobals::renderSize));
+        drawID = getDrawDataBuffer().push({mat4(1.0f), prevMVP, materialOverride});
         prevMVP = projectionMatrix * view * mat4(1.0f);
 
-        glActiveTexture(GL_TEXTURE0);
-        cubeMap->bind();
+        cubeMap->bind(0);
         // setUniform(500, cubeMap->getTextureID());
 
         Mesh::bind();
@@ -580,14 +573,16 @@ class Skybox : public Mesh
 
     void draw() override
     {
-        glDepthMask(GL_FALSE);
-        glDepthFunc(GL_LEQUAL);
-        glDisable(GL_CULL_FACE);
+        GLState &gl = getGLState();
+        gl.setDepthMask(false);
+        gl.setDepthFunc(GL_LEQUAL);
+        gl.setCapability(GL_CULL_FACE, false);
+        gl.setPolygonMode(GL_FILL);
         bind();
-        ebo->draw();
-        glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LESS);
-        glEnable(GL_CULL_FACE);
+        ebo->draw(drawID);
+        gl.setDepthMask(true);
+        gl.setDepthFunc(GL_LESS);
+        gl.setCapability(GL_CULL_FACE, true);
         unbind();
     }
 };
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "typedef.hpp"
+
+using namespace glm;
+
+// post-transform cache efficiency of an index order, simulated with a FIFO cache
+struct VertexCacheStats
+{
+    f32 acmr; // cache misses per triangle, 0.5 is the ideal for a large regular grid, 3 a triangle soup
+    f32 atvr; // cache misses per referenced vertex, 1 being each vertex transformed once
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<uivec3> &indices, u32 vertexCount, u32 cacheSize = 16);
+
+// Tipsify (Sander, Nehab & Barczak 2007) triangle reordering for the post-transform cache.
+// clusters, if given, receives the first triangle of every run started after a dead end, where
+// locality is already broken and the runs can be moved around without losing much
+void optimizeVertexCache(std::vector<uivec3> &indices, u32 vertexCount, std::vector<u32> *clusters = nullptr,
+                         u32 cacheSize = 16);
+
+// Reorders the clusters of a cache optimized index order so the outer, outward facing ones come
+// first, they are the likeliest to hide the rest whatever the view. Clusters are split further as
+// long as their ACMR stays under threshold times the one of the whole cluster.
+void optimizeOverdraw(std::vector<uivec3> &indices, const std::vector<vec3> &positions,
+                      const std::vector<u32> &clusters, f32 threshold = 1.05f, u32 cacheSize = 16);
+
+// Renumbers the vertices in the order the triangles first use them so the vertex fetch reads
+// memory linearly. Unused vertices are dropped, attribute arrays which don't match the vertex
+// count are left alone
+void optimizeVertexFetch(std::vector<uivec3> &indices, std::vector<vec3> &vertices, std::vector<vec3> &normals,
+                         std::vector<vec2> &uvs);
+
+// all of the above, prints the ACMR/ATVR before and after for name
+void optimizeMesh(const std::string &name, std::vector<uivec3> &indices, std::vector<vec3> &vertices,
+                  std::vector<vec3> &normals, std::vector<vec2> &uvs);
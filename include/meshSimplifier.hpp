@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "typedef.hpp"
+
+using namespace glm;
+
+// Edge collapse simplification driven by quadric error metrics (Garland & Heckbert), with the
+// normal and uv differences of the merged vertices added to the cost so seams and hard edges
+// survive longer. Vertices sharing a position are welded for connectivity, the collapses only
+// ever move a vertex onto one of its neighbours so the returned triangles index the input
+// vertices and no new vertex data is needed.
+//
+// error receives the largest geometric error of the collapses done, in object units. Positions of
+// the vertices flagged in lockedVertices never move nor go away.
+std::vector<uivec3> simplifyMesh(const std::vector<uivec3> &indices, const std::vector<vec3> &vertices,
+                                 const std::vector<vec3> &normals, const std::vector<vec2> &uvs, u32 targetTriangles,
+                                 f32 &error, const std::vector<bool> &lockedVertices = {});
+
+// Cuts the triangles in spatial clusters on a grid over their bounding box, up to CLUSTER_GRID cells
+// along the longest side and fewer along the shorter ones or when there isn't MIN_CLUSTER_TRIANGLES
+// per cell on average. Triangles go to the cell of their center, empty cells are dropped.
+// lockedVertices receives the vertices whose position is used by more than one cluster: simplified
+// with those locked, the clusters keep meeting whatever level each of them is drawn at.
+constexpr u32 CLUSTER_GRID = 4;
+constexpr u32 MIN_CLUSTER_TRIANGLES = 32;
+std::vector<std::vector<uivec3>> splitIntoClusters(const std::vector<uivec3> &indices,
+                                                   const std::vector<vec3> &vertices,
+                                                   std::vector<bool> &lockedVertices);
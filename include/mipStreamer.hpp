@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "texture.hpp"
+#include "typedef.hpp"
+
+// Keeps only the mip levels of the baked textures that the screen needs. The visible meshes report
+// how many uv units one of their pixels covers (Mesh::requestTextureMips), which gives the finest
+// level each texture needs this frame. At the end of the frame the textures are moved to those
+// levels (Texture::setBaseLevel), finer levels being read back from their baked file. Past the
+// memory budget, the least recently seen textures give up their finest levels first.
+class MipStreamer
+{
+  private:
+    std::vector<std::weak_ptr<Texture>> textures;
+    u64 frame = 1;
+
+    i32 residentKB = 0;
+    i32 loads = 0;
+    i32 evictions = 0;
+
+  public:
+    // the size levels start at before anything asked for them
+    static constexpr i32 INITIAL_SIZE = 64;
+
+    // read on load, textures loaded while off keep every level
+    bool enabled = true;
+    i32 budgetMB = 256;
+    // added to the computed level, positive trades sharpness for memory
+    f32 bias = 0.0f;
+    // loads are the expensive changes, dropping levels is always done right away
+    i32 maxLoadsPerFrame = 2;
+
+    void add(const TexturePtr &texture);
+
+    i32 initialLevel(Texture &texture);
+
+    // the texture is drawn this frame with one pixel covering uvPerPixel uv units
+    void request(Texture &texture, f32 uvPerPixel)
+    {
+        if (!texture.streamed)
+            return;
+
+        f32 texelsPerPixel = uvPerPixel * std::max(texture.width, texture.height);
+        i32 level = (i32)std::floor(std::log2(std::max(texelsPerPixel, 1e-6f)) + bias);
+        texture.wantedLevel = std::min(texture.wantedLevel, level);
+        texture.lastUsedFrame = frame;
+    }
+
+    // moves the textures to the levels asked for during the frame, within the budget
+    void endFrame();
+
+    i32 *getResidentKBCounter()
+    {
+        return &residentKB;
+    }
+
+    i32 *getLoadCounter()
+    {
+        return &loads;
+    }
+
+    i32 *getEvictionCounter()
+    {
+        return &evictions;
+    }
+};
+
+MipStreamer &getMipStreamer();
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "maskedDepthBuffer.hpp"
+#include "renderLayer.hpp"
+#include "typedef.hpp"
+
+using namespace glm;
+
+typedef std::shared_ptr<class Mesh> MeshPtr;
+
+// Software occlusion culling. The largest static meshes of the depth writing layers are the
+// occluders, drawn through their largest full resolution triangles under a triangle budget. A
+// subset of the real surface can only hide less than the mesh does, the simplified levels could
+// bulge out of it and hide what is visible. At the start of each layer its occluders are
+// rasterized into a MaskedDepthBuffer on the worker threads, then every draw of the layer tests
+// its bounding box against it before being submitted. verifyReference runs a scalar
+// ReferenceDepthBuffer next to it and counts where the two disagree.
+// Occluders only hide draws of their own layer, the layers can end up in different framebuffers.
+class OcclusionCuller
+{
+  private:
+    struct Occluder
+    {
+        MeshPtr mesh;
+        u32 layerID;
+        std::vector<uivec3> triangles;
+    };
+
+    MaskedDepthBuffer depthBuffer;
+    ReferenceDepthBuffer referenceBuffer;
+    std::vector<Occluder> occluders;
+
+    // scratch for beginLayer(), occluders of the layer and their screen space vertices.
+    // z < 0 marks vertices behind the near plane
+    std::vector<const Occluder *> layerOccluders;
+    std::vector<mat4> layerMVPs;
+    std::vector<std::vector<vec3>> screenVertices;
+
+    mat4 viewProj = mat4(1.0f);
+    bool active = false;
+
+    i32 occluderTriangles = 0;
+    i32 testedCount = 0;
+    i32 culledCount = 0;
+    i32 lastOccluderTriangles = 0;
+    i32 lastTestedCount = 0;
+    i32 lastCulledCount = 0;
+    i32 mismatches = 0;
+    i32 lastMismatches = 0;
+
+    GLuint debugTextureID = 0;
+    std::vector<u8> debugPixels;
+
+    void updateDebugTexture();
+    // the occluders of the layer again in referenceBuffer, compared with the masked buffer
+    void rasterizeReference();
+
+  public:
+    bool enabled = true;
+    bool showDepth = false;
+    // rasterizes the occluders a second time without SIMD and checks the masked buffer against it, slow
+    bool verifyReference = false;
+    i32 maxOccluders = 16;
+    // per occluder, the largest triangles in world space are kept
+    i32 maxOccluderTriangles = 1024;
+    // world space bounding sphere radius a static mesh needs to become an occluder
+    f32 minOccluderRadius = 2.0f;
+
+    OcclusionCuller(u32 width = 256, u32 height = 128);
+    ~OcclusionCuller();
+
+    OcclusionCuller(const OcclusionCuller &) = delete;
+    OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+    // picks the occluders among the static meshes, when the static geometry gets rebuilt
+    void setOccluders(const std::vector<MeshPtr> &meshes);
+
+    // rasterizes the occluders of the layer, isVisible() answers for this layer until the next call
+    void beginLayer(const RenderLayerPtr &renderLayer, const mat4 &_viewProj);
+
+    void endFrame();
+
+    // object space box, true unless the depth buffer proves it hidden
+    bool isVisible(const mat4 &model, vec3 boxMin, vec3 boxMax);
+
+    const MaskedDepthBuffer &getDepthBuffer() const
+    {
+        return depthBuffer;
+    }
+
+    // ImGui::Image of the depth buffer of the last layer which had occluders, when showDepth is on
+    void drawDebugImage();
+
+    i32 *getOccluderTriangleCounter()
+    {
+        return &lastOccluderTriangles;
+    }
+
+    i32 *getTestedCounter()
+    {
+        return &lastTestedCount;
+    }
+
+    i32 *getCulledCounter()
+    {
+        return &lastCulledCount;
+    }
+
+    // pixels of the masked buffer in front of the reference, and boxes it hid that the reference
+    // sees, while verifyReference is on
+    i32 *getMismatchCounter()
+    {
+        return &lastMismatches;
+    }
+};
+
+OcclusionCuller &getOcclusionCuller();
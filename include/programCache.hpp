@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "typedef.hpp"
+
+// On-disk cache of linked program binaries, so later runs skip compiling and linking. A program's
+// file is named after its stage paths and keeps the hash of the preprocessed sources and of the driver
+// it was built with, editing a shader or updating the driver just rebuilds and overwrites it.
+class ProgramCache
+{
+  private:
+    std::string directory = "shaderCache";
+    // vendor, renderer and version, a binary is only good for the driver that produced it
+    std::string driver;
+    bool supported = false;
+    bool initialized = false;
+
+    i32 hits = 0;
+    i32 misses = 0;
+
+    void init();
+    std::string filePath(const std::vector<std::string> &paths) const;
+
+  public:
+    bool enabled = true;
+
+    // hash of the preprocessed stage sources and the driver string
+    u64 key(const std::vector<std::string> &sources);
+
+    // loads the binary stored for paths into programID, false if there is none, it is stale or the
+    // driver refused it, the program has to be linked from source then
+    bool load(GLuint programID, const std::vector<std::string> &paths, u64 key);
+
+    // call before glLinkProgram on a program that is going to be stored
+    void prepare(GLuint programID);
+    void store(GLuint programID, const std::vector<std::string> &paths, u64 key);
+
+    i32 *getHitCounter()
+    {
+        return &hits;
+    }
+
+    i32 *getMissCounter()
+    {
+        return &misses;
+    }
+};
+
+ProgramCache &getProgramCache();
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "renderLayer.hpp"
+#include "typedef.hpp"
+
+using namespace glm;
+
+// Frame layout declared in the scene file: render targets and passes, each pass drawing one render
+// layer and naming the targets it samples and renders to. compile() orders the passes by what they
+// read and write, drops the ones nothing visible depends on and lets targets whose lifetimes don't
+// overlap share a texture. Passes writing the same target share its texture as attachment, the only
+// copies left are the ones asked for and the final blit to the screen.
+class RenderGraph
+{
+  public:
+    // the default framebuffer, can only be written as color
+    static constexpr const char *SCREEN = "screen";
+
+    struct Target
+    {
+        std::string name;
+        GLenum format;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        u32 layerID = 0;
+        // sampled through the fbo<slot> uniforms, on texture unit 16 + slot
+        std::vector<std::pair<std::string, u32>> inputs;
+        std::string color;
+        std::string depth;
+        // motion vectors, second color attachment next to color
+        std::string velocity;
+        bool clearColor = false;
+        bool clearDepth = false;
+        bool clearVelocity = false;
+        // copied into color before the pass, for passes sampling what they draw over
+        std::string colorSource;
+    };
+
+  private:
+    struct CompiledPass
+    {
+        u32 pass;
+        RenderLayerPtr layer;
+        std::vector<std::pair<i32, u32>> inputs;
+        i32 color = -1; // -1: none, -2: screen
+        i32 depth = -1;
+        i32 velocity = -1;
+        i32 colorSource = -1;
+        GLuint fboID = 0;
+    };
+
+    struct Texture
+    {
+        GLenum format;
+        GLuint textureID = 0;
+        u32 lastUse = 0;
+    };
+
+    std::vector<Target> targets;
+    std::vector<Pass> passes;
+    std::string output = SCREEN;
+    std::string depthTarget;
+    std::string velocityTarget;
+
+    std::vector<CompiledPass> order;
+    // texture of each target, several targets can point to the same one
+    std::vector<i32> targetTextures;
+    std::vector<Texture> textures;
+    std::vector<GLuint> fboIDs;
+    GLuint outputFBOID = 0;
+    ivec2 allocatedSize = ivec2(0);
+    // window size waiting to settle before the targets follow it
+    ivec2 pendingSize = ivec2(0);
+    f64 pendingTime = 0.0;
+    // settled window size, the targets are allocated at a scale of it
+    ivec2 outputSize = ivec2(0);
+
+    i32 findTarget(const std::string &name) const;
+    GLuint getTargetTexture(const std::string &name) const;
+    void allocate(ivec2 size);
+    void release();
+
+  public:
+    // seconds the window has to keep its size before the targets are reallocated, until then
+    // frames are rendered at the old size and stretched to the window
+    f32 resizeDelay = 0.2f;
+
+    RenderGraph() = default;
+    ~RenderGraph();
+
+    RenderGraph(const RenderGraph &) = delete;
+    RenderGraph &operator=(const RenderGraph &) = delete;
+
+    // rgb8, rgba8, rgba16f, rg16f, r32f, depth24stencil8 or depth32f
+    static GLenum parseFormat(const std::string &name);
+
+    void addTarget(const Target &target);
+    void addPass(const Pass &pass);
+
+    // target shown at the end of the frame, blitted unless it's the screen itself
+    void setOutput(const std::string &name)
+    {
+        output = name;
+    }
+
+    // scene depth, kept alive until the end of the frame for the Hi-Z culling
+    void setDepthTarget(const std::string &name)
+    {
+        depthTarget = name;
+    }
+
+    // scene motion vectors, kept alive until the end of the frame for the temporal upsampler
+    void setVelocityTarget(const std::string &name)
+    {
+        velocityTarget = name;
+    }
+
+    // resolves the pass order, culls and assigns textures. Errors in the description are fatal
+    void compile(const std::vector<RenderLayerPtr> &layers);
+
+    // picks the size the frame is rendered at, out of the window and the dynamic resolution scale,
+    // and sets EngineGlobals::renderSize before anything depending on it is updated
+    void beginFrame();
+
+    // without passes every layer is drawn straight to the screen
+    void execute(const std::vector<RenderLayerPtr> &layers);
+
+    // depth texture of this frame, 0 if there is none
+    GLuint getDepthTexture() const
+    {
+        return getTargetTexture(depthTarget);
+    }
+
+    // velocity texture of this frame, 0 if there is none
+    GLuint getVelocityTexture() const
+    {
+        return getTargetTexture(velocityTarget);
+    }
+};
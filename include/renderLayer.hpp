@@ -1,12 +1,12 @@
 #pragma once
-#include <bitset>
 #include <memory>
 
+#include "GLState.hpp"
+#include "renderQueue.hpp"
 #include "texture.hpp"
 #include "typedef.hpp"
 
 using RenderLayerPtr = std::shared_ptr<class RenderLayer>;
-using PostProcessLayerPtr = std::shared_ptr<class PostProcessLayer>;
 
 class RenderLayer : public std::enable_shared_from_this<RenderLayer>
 {
@@ -14,11 +14,17 @@ class RenderLayer : public std::enable_shared_from_this<RenderLayer>
     u32 ID;
     bool depthWrite = false;
     bool depthTest = true;
-    PostProcessLayerPtr postProcessLayer = nullptr;
+    // layers writing depth are opaque, the others get blended
+    RenderQueue::SortMode sortMode;
+
+    // depth/cull state for this layer, goes through GLState so consecutive layers
+    // sharing the same settings don't toggle anything
+    void applyState();
 
   public:
-    RenderLayer(u32 id, bool depthWrite, bool depthTest, PostProcessLayerPtr ppLayer = nullptr)
-        : ID(id), depthWrite(depthWrite), depthTest(depthTest), postProcessLayer(ppLayer)
+    RenderLayer(u32 id, bool depthWrite, bool depthTest)
+        : ID(id), depthWrite(depthWrite), depthTest(depthTest),
+          sortMode(depthWrite ? RenderQueue::FRONT_TO_BACK : RenderQueue::BACK_TO_FRONT)
     {
     }
 
@@ -37,100 +43,28 @@ class RenderLayer : public std::enable_shared_from_this<RenderLayer>
         return depthTest;
     }
 
-    virtual void render();
+    RenderQueue::SortMode getSortMode() const
+    {
+        return sortMode;
+    }
 
-    void setPostProcessLayer(PostProcessLayerPtr ppLayer)
+    void setSortMode(RenderQueue::SortMode mode)
     {
-        postProcessLayer = ppLayer;
+        sortMode = mode;
     }
 
+    // draws the meshes of the layer into whatever framebuffer the render graph bound
+    virtual void render();
+
     static RenderLayerPtr DEFAULT;
 };
 
 class DefaultRenderLayer : public RenderLayer
 {
   public:
-    DefaultRenderLayer(PostProcessLayerPtr pplayer = nullptr) : RenderLayer(0, true, true, pplayer)
+    DefaultRenderLayer() : RenderLayer(0, true, true)
     {
     }
 
     void render() override;
 };
-
-class PostProcessLayer
-{
-  private:
-    u8 fboInputMask;
-    u32 fboOutputID;
-    u32 fboBlitMask;
-    bool clear = false;
-
-  public:
-    PostProcessLayer(u8 fboInputMask, u32 fboOutputID, u32 fboBlitMask, bool clear = false)
-        : fboInputMask(fboInputMask), fboOutputID(fboOutputID), fboBlitMask(fboBlitMask), clear(clear)
-    {
-        if (fboOutputID >= FBO_N)
-        {
-            std::cerr << "Invalid FBO ID: " << fboOutputID << std::endl;
-            exit(1);
-        }
-    }
-
-    void bind()
-    {
-        fbos[fboOutputID]->bind();
-        if (clear)
-        {
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        }
-
-        for (u8 i = 0; i < 8; i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i + 16);
-            if (fboInputMask & (1 << i))
-            {
-                // std::cout << "binding fbo " << (int)i << " to texture unit " << (int)(i + 16) << std::endl;
-                fbos[i]->bindTexture();
-            }
-            else
-            {
-                glBindTexture(GL_TEXTURE_2D, 0);
-            }
-        }
-        glActiveTexture(GL_TEXTURE0);
-    }
-
-    void blit()
-    {
-        for (u8 i = 0; i < 8; i++)
-        {
-            u32 masked = fboBlitMask & (0b111 << (i * 3));
-            u32 value = masked >> (i * 3);
-            if (value)
-            {
-                // std::cout << "supposed to blit to layer " << (int)i << " here" << std::endl;
-                // std::cout << "value: " << std::bitset<3>(value) << std::endl;
-                fbos[fboOutputID]->blit(fbos[i], ((value & 0b001) ? GL_COLOR_BUFFER_BIT : 0) |
-                                                     ((value & 0b010) ? GL_DEPTH_BUFFER_BIT : 0) |
-                                                     ((value & 0b100) ? GL_STENCIL_BUFFER_BIT : 0));
-            }
-        }
-
-        // blit to screen
-        u32 masked = fboBlitMask & (0b111 << 24);
-        u32 value = masked >> 24;
-        if (value)
-        {
-            // std::cout << "bliting fbo " << fboOutputID << " to screen" << std::endl;
-            // std::cout << "value: " << std::bitset<3>(value) << std::endl;
-            fbos[fboOutputID]->blit(((value & 0b001) ? GL_COLOR_BUFFER_BIT : 0) |
-                                    ((value & 0b010) ? GL_DEPTH_BUFFER_BIT : 0) |
-                                    ((value & 0b100) ? GL_STENCIL_BUFFER_BIT : 0));
-        }
-    }
-
-    void unbind()
-    {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
-};
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include "typedef.hpp"
+
+// Draw order of the items of a layer. The view depths are quantized to 16 bits over the range of
+// the queue and sorted with a stable two pass radix sort, items at the same depth keep the order
+// they were pushed in.
+// Opaque items also carry a state key (program and texture, see Material::getStateKey) sorted above
+// the depth, draws sharing their state end up next to each other and front to back among themselves.
+class RenderQueue
+{
+  public:
+    enum SortMode : u8
+    {
+        NONE = 0,
+        FRONT_TO_BACK = 1, // opaque, grouped by state, lets early-Z reject what is behind
+        BACK_TO_FRONT = 2  // blended, far things have to be under the near ones
+    };
+
+  private:
+    std::vector<f32> depths;
+    std::vector<u16> stateKeys;
+    bool hasStateKeys = false;
+    std::vector<u32> keys;
+    std::vector<u32> order;
+    std::vector<u32> scratch;
+
+  public:
+    void clear()
+    {
+        depths.clear();
+        stateKeys.clear();
+        hasStateKeys = false;
+    }
+
+    // the item index is the push order, the state key is ignored back to front
+    void push(f32 viewDepth, u16 stateKey = 0)
+    {
+        depths.push_back(viewDepth);
+        stateKeys.push_back(stateKey);
+        hasStateKeys |= stateKey != 0;
+    }
+
+    u32 size() const
+    {
+        return depths.size();
+    }
+
+    // item indices in drawing order, valid until the next sort
+    const std::vector<u32> &sort(SortMode mode);
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "typedef.hpp"
+
+using namespace glm;
+
+// Textures render targets are drawn to, keyed by format and size. Released textures are handed
+// back to the next request with the same key, so a graph recompiled or resized back doesn't
+// reallocate, and deleted once nothing asked for them for a while.
+class RenderTargetPool
+{
+  private:
+    struct Entry
+    {
+        GLuint textureID;
+        GLenum format;
+        ivec2 size;
+        bool inUse;
+        u64 releaseFrame;
+    };
+
+    std::vector<Entry> entries;
+    u64 frame = 0;
+
+    i32 textureCount = 0;
+    f32 allocatedMB = 0.0f;
+
+    void refreshCounters();
+
+  public:
+    // frames a released texture waits for a taker before being deleted
+    i32 maxIdleFrames = 30;
+
+    RenderTargetPool() = default;
+    ~RenderTargetPool();
+
+    RenderTargetPool(const RenderTargetPool &) = delete;
+    RenderTargetPool &operator=(const RenderTargetPool &) = delete;
+
+    // an idle texture of that format and size, or a new one
+    GLuint acquire(GLenum format, ivec2 size);
+    void release(GLuint textureID);
+
+    // deletes what stayed idle for too long
+    void endFrame();
+
+    i32 *getTextureCounter()
+    {
+        return &textureCount;
+    }
+
+    // video memory held by the pool, idle textures included
+    f32 *getAllocatedMBCounter()
+    {
+        return &allocatedMB;
+    }
+};
+
+RenderTargetPool &getRenderTargetPool();
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "typedef.hpp"
+
+using namespace glm;
+
+// Persistently mapped buffer split in REGION_N regions, one per frame in flight.
+// The CPU writes the current region with plain memcpy while the GPU is still reading the
+// previous ones; a fence per region makes sure we never overwrite data a frame still uses.
+class RingBuffer
+{
+  public:
+    static constexpr u32 REGION_N = 3;
+
+  private:
+    GLuint bufferID = 0;
+    GLenum target;
+    GLuint binding;
+
+    u8 *mapped = nullptr;
+    u64 regionSize;
+    u64 head = 0;
+    u32 region = 0;
+
+    std::array<GLsync, REGION_N> fences = {};
+
+    // number of frames we had to wait on the GPU before reusing a region
+    i32 stalls = 0;
+
+  public:
+    // for GL_SHADER_STORAGE_BUFFER and GL_UNIFORM_BUFFER the current region gets bound to binding,
+    // other targets (GL_DRAW_INDIRECT_BUFFER...) are bound by the user with getBufferID/getRegionOffset
+    RingBuffer(GLenum _target, GLuint _binding, u64 _regionSize);
+    ~RingBuffer();
+
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    // waits for the GPU to be done with the region we are about to write, then binds it if indexed
+    void beginFrame();
+
+    // fences the region written this frame and moves on to the next one
+    void endFrame();
+
+    // reserves size bytes in the current region, returns the offset from the region start
+    // or -1 when the region is full
+    i64 allocate(u64 size, u64 alignment);
+
+    void *getPointer(u64 offset)
+    {
+        return mapped + region * regionSize + offset;
+    }
+
+    u64 getRegionSize() const
+    {
+        return regionSize;
+    }
+
+    u64 getRegionOffset() const
+    {
+        return region * regionSize;
+    }
+
+    GLuint getBufferID() const
+    {
+        return bufferID;
+    }
+
+    i32 *getStallCounter()
+    {
+        return &stalls;
+    }
+};
+
+// std430 layout, mirrored by DrawData in shader/drawData.glsl
+struct DrawData
+{
+    mat4 model;
+    mat4 prevMVP;
+    vec4 materialOverride;
+    // dequantization of the positions, see VertexFormat::quantizedPositions
+    vec4 positionScale = vec4(1.0f);
+    vec4 positionOffset = vec4(0.0f);
+};
+
+// layout fixed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    u32 count;
+    u32 instanceCount;
+    u32 firstIndex;
+    i32 baseVertex;
+    u32 baseInstance;
+};
+
+// Per-draw data of the frame, indexed in the shaders with gl_BaseInstance + gl_DrawID: single draws
+// pass their draw ID as base instance, multi-draws pass the ID of their first draw and let gl_DrawID
+// walk the following ones. Indirect commands of the frame live in a second ring.
+class DrawDataBuffer
+{
+  public:
+    static constexpr u32 MAX_DRAWS = 16384;
+
+  private:
+    RingBuffer ring;
+    RingBuffer commandRing;
+    u32 drawCount = 0;
+    i32 lastDrawCount = 0;
+    i32 multiDrawCount = 0;
+    i32 lastMultiDrawCount = 0;
+
+  public:
+    DrawDataBuffer();
+
+    void beginFrame();
+    void endFrame();
+
+    // copies data into the current region and returns its draw ID
+    u32 push(const DrawData &data);
+
+    // copies the commands, binds the command buffer to GL_DRAW_INDIRECT_BUFFER and returns the
+    // byte offset to hand to glMultiDrawElementsIndirect
+    u64 pushCommands(const DrawElementsIndirectCommand *commands, u32 count);
+
+    i32 *getDrawCounter()
+    {
+        return &lastDrawCount;
+    }
+
+    i32 *getMultiDrawCounter()
+    {
+        return &lastMultiDrawCount;
+    }
+
+    i32 *getStallCounter()
+    {
+        return ring.getStallCounter();
+    }
+};
+
+DrawDataBuffer &getDrawDataBuffer();
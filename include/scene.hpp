@@ -12,9 +12,11 @@
 #include "gameObject.hpp"
 #include "globals.hpp"
 #include "inputManager.hpp"
+#include "lightClusters.hpp"
 #include "material.hpp"
 #include "mesh.hpp"
 #include "rapidxml/rapidxml.hpp"
+#include "renderGraph.hpp"
 #include "shader.hpp"
 #include "typedef.hpp"
 #include "utils.hpp"
@@ -33,16 +35,13 @@ class Scene
     std::unordered_map<std::string, SkyboxPtr> skyboxes;
 
     std::vector<RenderLayerPtr> renderLayers = {RenderLayer::DEFAULT};
+    RenderGraph renderGraph;
 
-    constexpr static size_t MAX_LIGHTS = 10;
-    Light lights[MAX_LIGHTS];
-    size_t lightCount = 0;
+    std::vector<Light> lights;
+    LightClusters lightClusters;
     GameObjectPtr root;
     std::string name;
 
-    u32 uboLights;
-    u32 lightsIndex = 0;
-
     CameraPtr sceneCamera = std::make_shared<Camera>();
     SkyboxPtr sceneSkybox = nullptr;
 
@@ -93,6 +92,11 @@ class Scene
         return renderLayers[index];
     }
 
+    RenderGraph &getRenderGraph()
+    {
+        return renderGraph;
+    }
+
     SkyboxPtr getSkybox()
     {
         return sceneSkybox;
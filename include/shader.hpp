@@ -24,7 +24,8 @@ enum class ShaderType
 {
     VERTEX,
     FRAGMENT,
-    GEOMETRY
+    GEOMETRY,
+    COMPUTE
 };
 
 using ShaderPtr = std::unique_ptr<class Shader>;
@@ -40,6 +41,8 @@ class Shader
     ShaderType type;
     std::string path;
     std::string source;
+    // file behind each source string number of the info log
+    std::vector<std::string> sourceFiles;
     std::string shaderName;
     u32 _isCompiled = GL_FALSE;
 
@@ -53,7 +56,11 @@ class Shader
 
     static ShaderPtr load(std::string filename);
     static ShaderPtr load(std::string filename, ShaderType _type);
+    // reads the source and resolves its includes, once
+    void preprocess(const std::vector<std::string> &defines = {});
+    // issues the compile, checkCompiled waits for it and exits on errors
     void compile();
+    void checkCompiled();
 
     u32 getID()
     {
@@ -83,24 +90,56 @@ class ShaderProgram
     ShaderPtr vert = nullptr;
     ShaderPtr frag = nullptr;
     ShaderPtr geom = nullptr;
+    ShaderPtr comp = nullptr;
     u32 _isLinked = GL_FALSE;
+    u32 textureUnitsSet = 0;
+    // last layer written to each TEXTURE_LAYER0 + i uniform, -1 if never
+    std::vector<i32> textureLayers;
+    std::vector<std::string> defines;
+    // submitted to the driver, link status not checked yet
+    bool pending = false;
+    std::vector<std::string> cachePaths;
+    u64 cacheKey = 0;
 
     // not an ideal solution, maybe should read the shader source and check for a define or something
     bool hasAccesstoFramebuffers = false;
 
     void _delete();
+    void onLinked();
 
   public:
     ShaderProgram() {};
-    ShaderProgram(std::string vertPath, std::string fragPath, bool hasAccesstoFramebuffers = false);
+    // defines are "NAME" or "NAME=value", each combination is its own permutation of the sources
+    ShaderProgram(std::string vertPath, std::string fragPath, bool hasAccesstoFramebuffers = false,
+                  const std::vector<std::string> &defines = {});
     ShaderProgram(std::string vertPath, std::string fragPath, std::string geomPath,
-                  bool hasAccesstoFramebuffers = false);
+                  bool hasAccesstoFramebuffers = false, const std::vector<std::string> &defines = {});
+    // compute only program
+    explicit ShaderProgram(std::string compPath, const std::vector<std::string> &defines = {});
     ~ShaderProgram();
 
+    // programs are only submitted on construction, compiling and linking can go on in the driver
+    // (in parallel with KHR_parallel_shader_compile) until finalize, which any use of the program calls
+    void submit();
+    // true once finalize won't wait, always false without parallel compile support
+    bool isReady();
+    // waits for the link, exits on errors
+    void finalize();
     void link();
     void use();
+
+    // once after context creation
+    static void enableParallelCompile();
     void stop();
 
+    // point the TEXTURE0 + i sampler uniforms at texture unit i, skipping the ones already set
+    void setTextureUnits(u32 count);
+    // point the TEXTURE_LAYER0 + unit uniform at a layer, skipped when it already is
+    void setTextureLayer(u32 unit, i32 layer);
+
+    // defined as "NAME" or "NAME=value" for this permutation
+    bool hasDefine(const std::string &name) const;
+
     u32 getID()
     {
         return ID;
@@ -119,11 +158,13 @@ class ShaderProgram
     };
     u32 isLinked()
     {
+        finalize();
         return _isLinked;
     };
 
     i32 getUniformLocation(std::string name)
     {
+        finalize();
         return glGetUniformLocation(ID, name.c_str());
     }
 
@@ -131,6 +172,7 @@ class ShaderProgram
     void setUniform(i32 location, const vec2 &value);
     void setUniform(i32 location, const vec3 &value);
     void setUniform(i32 location, const vec4 &value);
+    void setUniform(i32 location, const ivec2 &value);
     void setUniform(i32 location, const f32 &value);
     void setUniform(i32 location, const i32 &value);
     void setUniform(i32 location, const u32 &value);
@@ -138,4 +180,6 @@ class ShaderProgram
 
 ShaderProgramPtr newShaderProgram();
 
-ShaderProgramPtr newShaderProgram(std::string vertPath, std::string fragPath, bool hasAccesstoFramebuffers = false);
\ No newline at end of file
+// shared between everything asking for the same stages and defines
+ShaderProgramPtr newShaderProgram(std::string vertPath, std::string fragPath, bool hasAccesstoFramebuffers = false,
+                                  const std::vector<std::string> &defines = {});
\ No newline at end of file
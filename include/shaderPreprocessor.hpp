@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "typedef.hpp"
+
+struct PreprocessedShader
+{
+    std::string source;
+    // file of each source string number used by the #line directives, for reading the info logs
+    std::vector<std::string> files;
+};
+
+// Expands the #include "file" directives of the shaders (relative to shader/), files are read from
+// disk once and kept in memory. A file with #pragma once is only expanded the first time a shader
+// includes it. #line directives keep the line numbers of the info logs pointing at the right file,
+// and the defines of a permutation ("NAME" or "NAME=value") go right after #version.
+class ShaderPreprocessor
+{
+  private:
+    struct File
+    {
+        std::vector<std::string> lines;
+        bool once = false;
+    };
+
+    std::unordered_map<std::string, File> files;
+
+    const File &getFile(const std::string &path);
+    void expand(const std::string &path, std::vector<std::string> &included, PreprocessedShader &output,
+                const std::vector<std::string> &defines);
+
+  public:
+    std::string includeDirectory = "shader/";
+
+    PreprocessedShader process(const std::string &path, const std::vector<std::string> &defines = {});
+
+    // forget the cached files, the next shaders built see the changes on disk
+    void clear()
+    {
+        files.clear();
+    }
+};
+
+ShaderPreprocessor &getShaderPreprocessor();
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "drawCulling.hpp"
+#include "material.hpp"
+#include "renderLayer.hpp"
+#include "renderQueue.hpp"
+#include "typedef.hpp"
+#include "vertexFormat.hpp"
+
+typedef std::shared_ptr<class Mesh> MeshPtr;
+
+// All static meshes (position/normal/uv, triangles) merged in a single set of vertex and index
+// buffers behind one VAO, in the most compact VertexFormat every one of them fits in. Each material/render layer pair becomes a bucket that is submitted with
+// one glMultiDrawElementsIndirect, per-draw data being fetched with gl_DrawID. Meshes with their own
+// material parameters (Mesh::setParam) get a bucket of their own. Clustered meshes are one draw
+// per cluster, each culled and given its level of detail on its own.
+class StaticGeometry
+{
+  private:
+    struct Range
+    {
+        MeshPtr mesh;
+        u32 firstIndex; // start of the mesh clusters and their levels, see Mesh::getClusters
+        u32 indexCount;
+        i32 baseVertex;
+        vec4 sphere; // object space bounding sphere, for culling
+        vec4 positionScale;
+        vec4 positionOffset;
+    };
+
+    struct Bucket
+    {
+        MaterialPtr material;
+        // the material's, or the instance block of the one mesh of the bucket
+        MaterialParams *params;
+        u32 layerID;
+        std::vector<u32> ranges;
+    };
+
+    GLuint vaoID = 0;
+    GLuint positionBufferID = 0;
+    GLuint normalBufferID = 0;
+    GLuint uvBufferID = 0;
+    GLuint indexBufferID = 0;
+    VertexFormat format;
+
+    std::vector<Range> ranges;
+    std::vector<Bucket> buckets;
+
+    // scratch for draw(), kept around to avoid reallocating every frame
+    std::vector<CullCandidate> candidates;
+    std::vector<mat4> models;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<u32> enabledRanges;
+    std::vector<f32> rangeDepths;
+    std::vector<u32> sortedRanges;
+    RenderQueue rangeQueue;
+    RenderQueue bucketQueue;
+
+    bool dirty = false;
+    // bumped on every build, caches made out of the static meshes compare against it
+    u32 version = 0;
+
+    void deleteBuffers();
+
+  public:
+    StaticGeometry() = default;
+    ~StaticGeometry();
+
+    StaticGeometry(const StaticGeometry &) = delete;
+    StaticGeometry &operator=(const StaticGeometry &) = delete;
+
+    static bool isCompatible(const Mesh &mesh);
+
+    // the set of static meshes changed, rebuild before the next draw
+    void setDirty()
+    {
+        dirty = true;
+    }
+
+    bool isDirty() const
+    {
+        return dirty;
+    }
+
+    u32 getVersion() const
+    {
+        return version;
+    }
+
+    // merges the static meshes of the list into fresh buffers
+    void build(const std::vector<MeshPtr> &meshes);
+
+    // draws every enabled static mesh of the layer, one multi-draw per bucket, culled by the DrawCuller
+    // and in the order asked by the layer
+    void draw(const RenderLayerPtr &renderLayer);
+
+    // depth only multi-draw of the enabled shadow casters inside the planes, finest level of detail.
+    // The depth shader has to be bound already
+    void drawShadowCasters(const std::array<vec4, 6> &planes);
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include "GLState.hpp"
 #include "globals.hpp"
 #include "stb_image.h"
 #include "typedef.hpp"
@@ -8,27 +9,101 @@
 
 #include <array>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
+
+// 1x1 grey bound in place of the textures the streamer hasn't uploaded yet
+GLuint getPlaceholderTexture();
+
+// Same sized, same format textures as the layers of a single GL_TEXTURE_2D_ARRAY, so materials
+// that only differ by their textures keep the same texture bound, see AssetManager::buildTextureArrays
+class TextureArray
+{
+  private:
+    GLuint textureID = 0;
+    GLenum format = 0;
+    i32 width = 0, height = 0, layerCount = 0, levelCount = 0;
+
+  public:
+    // every texture has to match the first one's size and format. Layers start out grey (undefined for
+    // compressed formats), each texture copies itself in once it's resident
+    TextureArray(const std::vector<std::shared_ptr<class Texture>> &textures);
+    ~TextureArray();
+
+    TextureArray(const TextureArray &) = delete;
+    TextureArray &operator=(const TextureArray &) = delete;
+
+    inline GLuint getTextureID()
+    {
+        return textureID;
+    }
+
+    inline i32 getLayerCount()
+    {
+        return layerCount;
+    }
+
+    // GPU side copy of every mip level of a resident texture
+    void copyLayer(i32 layer, Texture &texture);
+
+    inline void bind(u32 unit)
+    {
+        getGLState().bindTexture(unit, GL_TEXTURE_2D_ARRAY, textureID);
+    }
+};
+
+using TextureArrayPtr = std::shared_ptr<TextureArray>;
 
 class Texture
 {
   private:
-    // image data
-    i32 width, height, nrChannels;
-    u8 *data;
+    // image data, the size is read from the file header before the pixels are decoded
+    i32 width = 0, height = 0, nrChannels = 0;
+    // only kept once uploaded when asked for, see keepData
+    u8 *data = nullptr;
+    bool keepData = false;
+    // the placeholder is bound until the pixels are uploaded
+    bool resident = false;
 
     // opengl stuff
-    GLuint textureID;
+    GLuint textureID = 0;
+    GLenum format = 0;
+    i32 levels = 0;
+    // block compressed, loaded from a baked .btex
+    bool compressed = false;
+
+    // mip streaming (see MipStreamer), baked textures only hold the levels from baseLevel on
+    std::string bakedPath;
+    i32 baseLevel = 0;
+    bool streamed = false;
+    i32 wantedLevel = INT32_MAX;
+    u64 lastUsedFrame = 0;
+
+    // the array holding a copy of this texture, if it was put in one
+    TextureArrayPtr array;
+    i32 layer = -1;
 
     const std::string name;
 
     void genTexture();
+    // maps the .btex baked from path and uploads its mips, false if there is none or it's stale
+    bool loadBaked(const std::string &path);
+    // pixels of level 0 were just uploaded by the streamer
+    void onUploaded(u8 *pixels);
+
+    friend class TextureStreamer;
+    friend class MipStreamer;
 
   public:
-    Texture(const char *path, const std::string &name = "") : name(name)
+    // resident right away when baked (see bakedTexture.hpp). Otherwise only reads the file header and
+    // allocates the storage, the pixels come from TextureStreamer::request (AssetManager::loadTexture
+    // does both). keepData keeps the decoded pixels around after the upload, baked textures have none
+    Texture(const char *path, const std::string &name = "", bool keepData = false) : keepData(keepData), name(name)
     {
-        data = stbi_load(path, &width, &height, &nrChannels, 0);
-        if (!data)
+        if (loadBaked(path))
+            return;
+        if (!stbi_info(path, &width, &height, &nrChannels))
         {
             std::cerr << "Failed to load texture at path: " << path << std::endl;
             return;
@@ -40,9 +115,17 @@ class Texture
     {
         stbi_image_free(data);
 
-        glDeleteTextures(1, &textureID);
+        if (textureID)
+        {
+            glDeleteTextures(1, &textureID);
+            getGLState().textureDeleted(textureID);
+        }
     }
 
+    static GLenum internalFormat(i32 nrChannels);
+    static GLenum pixelFormat(i32 nrChannels);
+    static i32 levelCount(i32 width, i32 height);
+
     inline i32 getWidth()
     {
         return width;
@@ -58,6 +141,7 @@ class Texture
         return nrChannels;
     }
 
+    // null unless the texture was loaded with keepData and is resident
     inline u8 *getData()
     {
         return data;
@@ -68,19 +152,79 @@ class Texture
         return textureID;
     }
 
+    inline bool isResident()
+    {
+        return resident;
+    }
+
+    inline GLenum getFormat()
+    {
+        return format;
+    }
+
+    inline i32 getLevelCount()
+    {
+        return levels;
+    }
+
+    inline bool isCompressed()
+    {
+        return compressed;
+    }
+
+    // drops the levels finer than level, or loads them back from the baked file
+    void setBaseLevel(i32 level);
+
+    inline i32 getBaseLevel()
+    {
+        return baseLevel;
+    }
+
+    // every level stays resident from now on, the mip streamer leaves the texture alone
+    void pinLevels();
+
+    inline bool isStreamed()
+    {
+        return streamed;
+    }
+
+    // memory taken by the levels from fromLevel on
+    u64 residentBytes(i32 fromLevel);
+
     inline const std::string &getName()
     {
         return name;
     }
 
+    void setArrayLayer(TextureArrayPtr _array, i32 _layer)
+    {
+        array = _array;
+        layer = _layer;
+    }
+
+    inline const TextureArrayPtr &getArray()
+    {
+        return array;
+    }
+
+    inline i32 getLayer()
+    {
+        return layer;
+    }
+
     inline void bind()
     {
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        getGLState().bindTexture(GL_TEXTURE_2D, resident ? textureID : getPlaceholderTexture());
+    }
+
+    inline void bind(u32 unit)
+    {
+        getGLState().bindTexture(unit, GL_TEXTURE_2D, resident ? textureID : getPlaceholderTexture());
     }
 
     inline void unbind()
     {
-        glBindTexture(GL_TEXTURE_2D, 0);
+        getGLState().bindTexture(GL_TEXTURE_2D, 0);
     }
 };
 
@@ -127,211 +271,43 @@ class Image
     {
         return data;
     }
-
-    std::unique_ptr<Image> slice(i32 x, i32 y, i32 w, i32 h)
-    {
-        if (x < 0 || y < 0 || x + w > width || y + h > height)
-        {
-            return nullptr;
-        }
-
-        u8 *newData = new u8[w * h * nrChannels];
-        for (i32 i = 0; i < h; i++)
-        {
-            for (i32 j = 0; j < w; j++)
-            {
-                for (i32 k = 0; k < nrChannels; k++)
-                {
-                    newData[(i * w + j) * nrChannels + k] = data[((i + y) * width + (j + x)) * nrChannels + k];
-                }
-            }
-        }
-
-        return std::make_unique<Image>(newData, w, h, nrChannels);
-    }
-
-    std::unique_ptr<Image> slice(f32 x, f32 y, f32 w, f32 h)
-    {
-        return slice((i32)(x * width), (i32)(y * height), (i32)(w * width), (i32)(h * height));
-    }
 };
 
+// Faces come from six files decoded in parallel, or from a horizontal cross in a single file uploaded
+// in place. The mips are generated on the first load and cached with the faces in textureCache/, the
+// next loads map that file and upload it without decoding anything.
 class CubeMap
 {
   private:
-    std::array<u8 *, 6> faces;
-    std::unique_ptr<Image> image;
-    GLuint textureID;
-
-    enum LoadType
-    {
-        MULTIPLE_FILES,
-        SINGLE_FILE
-    } loadType;
-
-  public:
-    CubeMap(std::array<std::string, 6> faces_filenames)
-    {
-        loadType = LoadType::MULTIPLE_FILES;
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-        for (size_t i = 0; i < faces_filenames.size(); i++)
-        {
-            i32 width, height, nrChannels;
-            faces[i] = stbi_load(faces_filenames[i].c_str(), &width, &height, &nrChannels, 0);
-            if (faces[i])
-            {
-                if (nrChannels == 3)
-                    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB,
-                                 GL_UNSIGNED_BYTE, faces[i]);
-                else if (nrChannels == 4)
-                    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, width, height, 0, GL_RGBA,
-                                 GL_UNSIGNED_BYTE, faces[i]);
-                else
-                {
-                    std::cerr << "Unsupported number of channels: " << nrChannels << std::endl;
-                    std::cerr << "Program will probably crash" << std::endl;
-                }
-            }
-            else
-            {
-                std::cerr << "Cubemap texture failed to load at path: " << faces_filenames[i] << std::endl;
-            }
-        }
+    GLuint textureID = 0;
+    i32 size = 0, nrChannels = 0, levels = 0;
 
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    }
-
-    CubeMap(std::string filename)
-    {
-        loadType = LoadType::SINGLE_FILE;
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-        image = std::make_unique<Image>(filename.c_str());
-        i32 width = image->getWidth() / 4;
-        i32 height = image->getHeight() / 3;
-        i32 nrChannels = image->getNrChannels();
-
-        for (size_t i = 0; i < 6; i++)
-        {
-            faces[i] = new u8[width * height * nrChannels];
-        }
+    std::string cachePath;
+    u64 cacheKey = 0;
 
-        std::unique_ptr<Image> front = image->slice(width, height, width, height);
-        std::unique_ptr<Image> left = image->slice(0, height, width, height);
-        std::unique_ptr<Image> right = image->slice(2 * width, height, width, height);
-        std::unique_ptr<Image> back = image->slice(3 * width, height, width, height);
-        std::unique_ptr<Image> top = image->slice(width, 0, width, height);
-        std::unique_ptr<Image> bottom = image->slice(width, 2 * height, width, height);
+    bool loadCached(const std::vector<std::string> &sources);
+    void allocate(i32 faceSize, i32 channels);
+    // mips from level 0, then written to the cache
+    void finish();
 
-        for (i32 i = 0; i < width * height * nrChannels; i++)
-        {
-            faces[0][i] = front->getData()[i];
-            faces[1][i] = back->getData()[i];
-            faces[2][i] = top->getData()[i];
-            faces[3][i] = bottom->getData()[i];
-            faces[4][i] = right->getData()[i];
-            faces[5][i] = left->getData()[i];
-        }
-
-        for (size_t i = 0; i < 6; i++)
-        {
-            if (nrChannels == 3)
-                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE,
-                             faces[i]);
-            else if (nrChannels == 4)
-                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, width, height, 0, GL_RGBA,
-                             GL_UNSIGNED_BYTE, faces[i]);
-            else
-            {
-                std::cerr << "Unsupported number of channels: " << nrChannels << std::endl;
-                std::cerr << "Program will probably crash" << std::endl;
-            }
-        }
+  public:
+    static inline std::string cacheDirectory = "textureCache";
 
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    }
+    // +X, -X, +Y, -Y, +Z, -Z
+    CubeMap(std::array<std::string, 6> faces_filenames);
+    CubeMap(std::string filename);
 
     ~CubeMap()
     {
-        glDeleteTextures(1, &textureID);
-
-        if (loadType == LoadType::SINGLE_FILE)
-        {
-            for (size_t i = 0; i < 6; i++)
-            {
-                delete[] faces[i];
-            }
-        }
-    }
-
-    inline GLuint getTextureID()
-    {
-        return textureID;
-    }
-
-    inline void bind()
-    {
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-    }
-};
-
-using CubeMapPtr = std::shared_ptr<CubeMap>;
-CubeMapPtr loadCubeMap(std::array<std::string, 6> faces_filenames);
-CubeMapPtr loadCubeMap(std::string filename);
-
-class FBO
-{
-  private:
-    GLuint fboID;
-    GLuint rboID;
-    GLuint textureID;
-    i32 width, height;
-
-  public:
-    FBO(i32 _width, i32 _height) : width(_width), height(_height)
-    {
-        glGenFramebuffers(1, &fboID);
-        glBindFramebuffer(GL_FRAMEBUFFER, fboID);
-
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureID, 0);
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-        glGenRenderbuffers(1, &rboID);
-        glBindRenderbuffer(GL_RENDERBUFFER, rboID);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rboID);
-
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        if (textureID)
         {
-            std::cerr << "Framebuffer is not complete!" << std::endl;
+            glDeleteTextures(1, &textureID);
+            getGLState().textureDeleted(textureID);
         }
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
-    ~FBO()
-    {
-        glDeleteFramebuffers(1, &fboID);
-        glDeleteRenderbuffers(1, &rboID);
-        glDeleteTextures(1, &textureID);
-    }
+    CubeMap(const CubeMap &) = delete;
+    CubeMap &operator=(const CubeMap &) = delete;
 
     inline GLuint getTextureID()
     {
@@ -340,56 +316,18 @@ class FBO
 
     inline void bind()
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, fboID);
-        glViewport(0, 0, width, height);
+        getGLState().bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
     }
 
-    inline void unbind()
+    inline void bind(u32 unit)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
-
-    inline void blit(GLbitfield mask = GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT)
-    {
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, fboID);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-        glBlitFramebuffer(0, 0, width, height, 0, 0, EngineGlobals::windowSize.x, EngineGlobals::windowSize.y, mask,
-                          GL_NEAREST);
-    }
-
-    inline void blit(FBOPtr fbo, GLbitfield mask = GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT)
-    {
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, fboID);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo->fboID);
-        glBlitFramebuffer(0, 0, width, height, 0, 0, fbo->width, fbo->height, mask, GL_NEAREST);
-    }
-
-    inline void bindTexture()
-    {
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        // glBindRenderbuffer(GL_RENDERBUFFER, rboID);
-    }
-
-    void drawToPPM(std::string filename, std::string depthFilename = "")
-    {
-        u8 *data = new u8[width * height * 3];
-        bindTexture();
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        unbind();
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-        FILE *f = fopen(filename.c_str(), "wb");
-        fprintf(f, "P6\n%d %d\n255\n", width, height);
-        fwrite(data, 1, width * height * 3, f);
-        fclose(f);
-
-        delete[] data;
+        getGLState().bindTexture(unit, GL_TEXTURE_CUBE_MAP, textureID);
     }
 };
 
-using FBOPtr = std::shared_ptr<FBO>;
-
-#define FBO_N 8
-extern std::array<FBOPtr, FBO_N> fbos;
+using CubeMapPtr = std::shared_ptr<CubeMap>;
+CubeMapPtr loadCubeMap(std::array<std::string, 6> faces_filenames);
+CubeMapPtr loadCubeMap(std::string filename);
 
-void initializeFBOs();
\ No newline at end of file
+// fbo0..fbo7 sampler slots the render graph passes bind their inputs to, on texture units 16 and up
+#define FBO_N 8
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "texture.hpp"
+#include "typedef.hpp"
+
+// Texture loads off the main thread. Decoder threads run stb_image on the requested files, the
+// main thread copies what they finished into a ring of persistently mapped pixel buffers and
+// uploads from there, within a per frame time budget. A slot of the ring is only written again
+// once the fence of its uploads signaled, a busy ring delays uploads to the next frame rather than
+// waiting on the GPU. Textures show the placeholder until their pixels are in.
+class TextureStreamer
+{
+  public:
+    static constexpr u32 RING_N = 3;
+    static constexpr u64 INITIAL_STAGING_SIZE = 8 * 1024 * 1024;
+
+  private:
+    struct Request
+    {
+        TexturePtr texture;
+        std::string path;
+    };
+
+    struct Decoded
+    {
+        TexturePtr texture;
+        u8 *pixels = nullptr;
+        i32 width = 0, height = 0;
+        std::string path;
+    };
+
+    struct Staging
+    {
+        GLuint bufferID = 0;
+        u64 size = 0;
+        u8 *mapped = nullptr;
+        GLsync fence = nullptr;
+    };
+
+    std::array<Staging, RING_N> ring;
+    u32 next = 0;
+
+    std::vector<std::thread> decoders;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Request> requests;
+    std::deque<Decoded> decoded;
+    bool stopping = false;
+
+    // main thread only, taken out of decoded at the start of each frame
+    std::deque<Decoded> ready;
+
+    i32 pending = 0;
+    i32 uploaded = 0;
+    i32 busyFrames = 0;
+
+    void decoderLoop();
+    // reserves a slot that's done being read by the GPU, null if the next one still is
+    Staging *acquire(u64 bytes);
+
+  public:
+    // upload time per frame, at least one texture goes through whatever it costs
+    f32 budgetMs = 2.0f;
+
+    explicit TextureStreamer(u32 decoderCount);
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    // decodes the file in the background, the texture has to come from the same file's header
+    void request(TexturePtr texture, const std::string &path);
+
+    // uploads what the decoders finished, once per frame before anything is drawn
+    void beginFrame();
+
+    // requested textures not resident yet
+    i32 *getPendingCounter()
+    {
+        return &pending;
+    }
+
+    i32 *getUploadedCounter()
+    {
+        return &uploaded;
+    }
+
+    // frames that had decoded textures but found the next staging buffer still in use
+    i32 *getBusyFrameCounter()
+    {
+        return &busyFrames;
+    }
+};
+
+TextureStreamer &getTextureStreamer();
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "typedef.hpp"
+
+// A few long lived worker threads for the data parallel parts of a frame, spawning threads
+// every frame costs more than the work itself
+class ThreadPool
+{
+  private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    // loop being run, only written while no worker is in it
+    const std::function<void(u32)> *job = nullptr;
+    u32 jobCount = 0;
+    std::atomic<u32> next = 0;
+    u32 active = 0;
+    u64 generation = 0;
+    bool stopping = false;
+
+    void workerLoop();
+    void runJobs();
+
+  public:
+    explicit ThreadPool(u32 threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // workers plus the calling thread
+    u32 getThreadCount() const
+    {
+        return workers.size() + 1;
+    }
+
+    // runs fn(0) to fn(count - 1) across the workers and the caller, returns once all are done.
+    // fn must not call parallelFor itself
+    void parallelFor(u32 count, const std::function<void(u32)> &fn);
+};
+
+// one worker less than the hardware threads, the main thread takes part in every loop
+ThreadPool &getThreadPool();
@@ -54,11 +54,14 @@ GameObjectPtr createGameObject();
 
 typedef vec<3, u32, highp> uivec3;
 
+// std430 layout, see shader/lights.glsl
 struct Light
 {
-    vec3 position;
-    vec3 color;
-    f32 intensity;
+    vec3 position = vec3(0.0f);
+    // where the light fades out, 0 for a light reaching everything without falloff
+    f32 radius = 0.0f;
+    vec3 color = vec3(1.0f);
+    f32 intensity = 1.0f;
 };
 
 struct DirectionalLight
@@ -67,6 +70,3 @@ struct DirectionalLight
     vec3 color;
     f32 intensity;
 };
-
-typedef std::shared_ptr<class FBO> FBOPtr;
-FBOPtr getFBO();
\ No newline at end of file
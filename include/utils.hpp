@@ -197,6 +197,8 @@ enum UNIFORM_LOCATIONS : GLint
     FONT_OUTLINE = 106,
 
     TEXTURE0 = 500,
+    // layer of the texture array bound to unit i, see Material::use
+    TEXTURE_LAYER0 = 600,
 
     ENVIRONMENT_MAP = 749,
     FRAMEBUFFER0 = 750,
@@ -205,7 +207,16 @@ enum UNIFORM_LOCATIONS : GLint
 enum BUFFER_OBJECT_BINDINGS : GLint
 {
     LIGHTS = 0,
-    VELOCITY_BUFFER = 1,
+    // parameter block of the material being drawn, see MaterialParams
+    MATERIAL = 1,
+    DRAW_DATA = 2,
+    CULL_CANDIDATES = 3,
+    CULL_COMMANDS = 4,
+    CULL_COUNTERS = 5,
+    POINT_LIGHTS = 6,
+    LIGHT_CLUSTER_COUNTS = 7,
+    LIGHT_CLUSTER_INDICES = 8,
+    SHADOWS = 9,
 };
 
 inline constexpr vec3 rgb(u8 r, u8 g, u8 b)
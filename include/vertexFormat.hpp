@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "typedef.hpp"
+
+using namespace glm;
+
+// how one attribute is read out of its buffer, see glVertexArrayAttribFormat
+struct VertexAttribute
+{
+    GLint components;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride;
+};
+
+// GPU side layout of the mesh streams (position, normal, uv at locations 0, 1, 2). The CPU copies
+// of the meshes stay in floats for the physics, picking and simplification.
+struct VertexFormat
+{
+    GLenum indexType = GL_UNSIGNED_INT;
+    // GL_INT_2_10_10_10_REV, the shaders still read a vec3
+    bool packedNormals = true;
+    bool halfUVs = true;
+    // unorm16 inside the bounding box, dequantized in the vertex shader with DrawData::positionScale
+    // and positionOffset. Only for the shaders going through drawData.glsl
+    bool quantizedPositions = false;
+
+    u32 getIndexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(u16) : sizeof(u32);
+    }
+
+    std::array<VertexAttribute, 3> getAttributes() const;
+
+    // 16 bit indices whenever every vertex can be reached with them
+    static VertexFormat choose(u32 vertexCount, bool quantizePositions = false);
+};
+
+// mesh streams converted to a VertexFormat, ready to upload
+struct PackedVertices
+{
+    VertexFormat format;
+    std::vector<u8> positions;
+    std::vector<u8> normals;
+    std::vector<u8> uvs;
+    std::vector<u8> indices;
+    u32 vertexCount = 0;
+    u32 indexCount = 0;
+
+    // object space position = stored position * positionScale + positionOffset
+    vec4 positionScale = vec4(1.0f);
+    vec4 positionOffset = vec4(0.0f);
+
+    PackedVertices() = default;
+    PackedVertices(const VertexFormat &_format, const std::vector<uivec3> &_indices, const std::vector<vec3> &vertices,
+                   const std::vector<vec3> &normals, const std::vector<vec2> &uvs);
+
+    void setIndices(const std::vector<uivec3> &_indices);
+
+    u64 getSize() const
+    {
+        return positions.size() + normals.size() + uvs.size() + indices.size();
+    }
+};
@@ -1,16 +1,28 @@
 #include "DFAUtils.hpp"
+#include "GLState.hpp"
 #include "GLutils.hpp"
 #include "UI.hpp"
 #include "camera.hpp"
+#include "cascadedShadowMap.hpp"
+#include "drawCulling.hpp"
+#include "dynamicResolution.hpp"
+#include "frameCapture.hpp"
 #include "gameObject.hpp"
 #include "globals.hpp"
 #include "imgui/imgui.h"
 #include "inputManager.hpp"
+#include "lod.hpp"
 #include "mesh.hpp"
+#include "mipStreamer.hpp"
+#include "occlusionCulling.hpp"
+#include "programCache.hpp"
+#include "renderTargetPool.hpp"
+#include "ringBuffer.hpp"
 #include "reactphysics3d/reactphysics3d.h"
 #include "scene.hpp"
 #include "shader.hpp"
 #include "texture.hpp"
+#include "textureStreamer.hpp"
 #include "typedef.hpp"
 #include "utils.hpp"
 
@@ -24,8 +36,6 @@ i32 main()
     // Initialize OpenGL, GLFW and GLEW
     OpenGLInit();
 
-    initializeFBOs();
-
     // Set up projection matrix
     projectionMatrix = perspective(radians(45.0f), (f32)windowSize.x / (f32)windowSize.y, 0.1f, 1000.0f);
 
@@ -40,9 +50,123 @@ i32 main()
     scene->Start();
     auto w = getUI().add_window("FPS", {});
     w->add_watcher("FPS", &fps, UIWindow::WatcherMode::READONLY);
+
+    // GL calls issued/skipped by the state cache during the last frame
+    auto glStateWindow = getUI().add_window("GL State", {});
+    for (u32 c = 0; c < GLState::COUNTER_N; c++)
+    {
+        GLState::Counter counter = (GLState::Counter)c;
+        std::string name = GLState::getCounterName(counter);
+        glStateWindow->add_watcher(name + " issued", getGLState().getIssuedCounter(counter),
+                                   UIWindow::WatcherMode::READONLY);
+        glStateWindow->add_watcher(name + " skipped", getGLState().getSkippedCounter(counter),
+                                   UIWindow::WatcherMode::READONLY);
+    }
+    glStateWindow->add_watcher("draws", getDrawDataBuffer().getDrawCounter(), UIWindow::WatcherMode::READONLY);
+    glStateWindow->add_watcher("multi-draws", getDrawDataBuffer().getMultiDrawCounter(),
+                               UIWindow::WatcherMode::READONLY);
+    glStateWindow->add_watcher("draw buffer stalls", getDrawDataBuffer().getStallCounter(),
+                               UIWindow::WatcherMode::READONLY);
+    glStateWindow->add_watcher("material uploads", getMaterialParamBuffer().getUploadCounter(),
+                               UIWindow::WatcherMode::READONLY);
+
+    // 0: off, 1: GPU, 2: CPU reference
+    DrawCuller &culler = getDrawCuller();
+    auto cullingWindow = getUI().add_window("Culling", {});
+    cullingWindow->add_watcher("mode", &culler.mode, UIWindow::WatcherMode::SLIDER, 0, 2);
+    cullingWindow->add_watcher("Hi-Z", &culler.useHiZ);
+    cullingWindow->add_watcher("verify GPU", &culler.verifyGPU);
+    cullingWindow->add_watcher("candidates", culler.getCandidateCounter(), UIWindow::WatcherMode::READONLY);
+    cullingWindow->add_watcher("visible", culler.getVisibleCounter(), UIWindow::WatcherMode::READONLY);
+    cullingWindow->add_watcher("mismatches", culler.getMismatchCounter(), UIWindow::WatcherMode::READONLY);
+
+    OcclusionCuller &occlusion = getOcclusionCuller();
+    auto occlusionWindow = getUI().add_window("Occlusion", {[&occlusion] { occlusion.drawDebugImage(); }});
+    occlusionWindow->add_watcher("enabled", &occlusion.enabled);
+    occlusionWindow->add_watcher("show depth", &occlusion.showDepth);
+    occlusionWindow->add_watcher("occluder triangles", occlusion.getOccluderTriangleCounter(),
+                                 UIWindow::WatcherMode::READONLY);
+    occlusionWindow->add_watcher("tested", occlusion.getTestedCounter(), UIWindow::WatcherMode::READONLY);
+    occlusionWindow->add_watcher("occluded", occlusion.getCulledCounter(), UIWindow::WatcherMode::READONLY);
+    occlusionWindow->add_watcher("verify reference", &occlusion.verifyReference);
+    occlusionWindow->add_watcher("mismatches", occlusion.getMismatchCounter(), UIWindow::WatcherMode::READONLY);
+
+    CascadedShadowMap &shadows = getCascadedShadowMap();
+    auto shadowWindow = getUI().add_window("Shadows", {});
+    shadowWindow->add_watcher("enabled", &shadows.enabled);
+    shadowWindow->add_watcher("cache static", &shadows.cacheStatic);
+    shadowWindow->add_watcher("cascades", &shadows.cascadeCount, UIWindow::WatcherMode::SLIDER, 1,
+                              (i32)CascadedShadowMap::MAX_CASCADES);
+    shadowWindow->add_watcher("distance", &shadows.shadowDistance, UIWindow::WatcherMode::SLIDER, 10.0f, 500.0f);
+    shadowWindow->add_watcher("split lambda", &shadows.splitLambda, UIWindow::WatcherMode::SLIDER, 0.0f, 1.0f);
+    shadowWindow->add_watcher("normal offset", &shadows.normalOffset, UIWindow::WatcherMode::SLIDER, 0.0f, 4.0f);
+    shadowWindow->add_watcher("static redraws", shadows.getStaticRenderCounter(), UIWindow::WatcherMode::READONLY);
+    shadowWindow->add_watcher("direct cascades", shadows.getDirectRenderCounter(), UIWindow::WatcherMode::READONLY);
+
+    RenderTargetPool &targetPool = getRenderTargetPool();
+    auto targetWindow = getUI().add_window("Render targets", {});
+    targetWindow->add_watcher("render size", &renderSize, UIWindow::WatcherMode::READONLY);
+    targetWindow->add_watcher("textures", targetPool.getTextureCounter(), UIWindow::WatcherMode::READONLY);
+    targetWindow->add_watcher("MB", targetPool.getAllocatedMBCounter(), UIWindow::WatcherMode::READONLY);
+    targetWindow->add_watcher("max idle frames", &targetPool.maxIdleFrames, UIWindow::WatcherMode::SLIDER, 0, 600);
+
+    // scale is only left to the slider while dynamic is off
+    DynamicResolution &resolution = getDynamicResolution();
+    auto resolutionWindow = getUI().add_window("Resolution", {});
+    resolutionWindow->add_watcher("dynamic", &resolution.enabled);
+    resolutionWindow->add_watcher("temporal upsample", &resolution.temporalUpsample);
+    resolutionWindow->add_watcher("budget (ms)", &resolution.budgetMs, UIWindow::WatcherMode::SLIDER, 4.0f, 33.0f);
+    resolutionWindow->add_watcher("min scale", &resolution.minScale, UIWindow::WatcherMode::SLIDER, 0.25f, 1.0f);
+    resolutionWindow->add_watcher("scale", &resolution.scale, UIWindow::WatcherMode::SLIDER, 0.25f, 1.0f);
+    resolutionWindow->add_watcher("GPU (ms)", resolution.getGPUTimeCounter(), UIWindow::WatcherMode::READONLY);
+
+    // read back through pixel buffers and written by background threads, the frame doesn't wait
+    FrameCapture &frameCapture = getFrameCapture();
+    u32 screenshotCount = 0;
+    auto captureWindow = getUI().add_window("Capture", {[&] {
+        if (ImGui::Button("screenshot"))
+            frameCapture.capture(0, windowSize, "screenshot_" + std::to_string(screenshotCount++) + ".png");
+        if (ImGui::Button(frameCapture.isRecording() ? "stop sequence" : "record sequence"))
+        {
+            if (frameCapture.isRecording())
+                frameCapture.stopSequence();
+            else
+                frameCapture.startSequence("capture/frame_%05u.png");
+        }
+    }});
+    captureWindow->add_watcher("written", frameCapture.getWrittenCounter(), UIWindow::WatcherMode::READONLY);
+    captureWindow->add_watcher("stalls", frameCapture.getStallCounter(), UIWindow::WatcherMode::READONLY);
+
+    // programs loaded from shaderCache/ rather than built from source
+    auto programCacheWindow = getUI().add_window("Program cache", {});
+    programCacheWindow->add_watcher("hits", getProgramCache().getHitCounter(), UIWindow::WatcherMode::READONLY);
+    programCacheWindow->add_watcher("misses", getProgramCache().getMissCounter(), UIWindow::WatcherMode::READONLY);
+
+    // decoded by background threads, uploaded a few milliseconds worth per frame
+    TextureStreamer &textureStreamer = getTextureStreamer();
+    auto streamingWindow = getUI().add_window("Texture streaming", {});
+    streamingWindow->add_watcher("pending", textureStreamer.getPendingCounter(), UIWindow::WatcherMode::READONLY);
+    streamingWindow->add_watcher("uploaded", textureStreamer.getUploadedCounter(), UIWindow::WatcherMode::READONLY);
+    streamingWindow->add_watcher("busy frames", textureStreamer.getBusyFrameCounter(), UIWindow::WatcherMode::READONLY);
+    streamingWindow->add_watcher("budget (ms)", &textureStreamer.budgetMs, UIWindow::WatcherMode::SLIDER, 0.5f, 16.0f);
+
+    // levels of the baked textures kept to what the screen needs
+    MipStreamer &mipStreamer = getMipStreamer();
+    auto mipWindow = getUI().add_window("Mip streaming", {});
+    mipWindow->add_watcher("resident KB", mipStreamer.getResidentKBCounter(), UIWindow::WatcherMode::READONLY);
+    mipWindow->add_watcher("loads", mipStreamer.getLoadCounter(), UIWindow::WatcherMode::READONLY);
+    mipWindow->add_watcher("evictions", mipStreamer.getEvictionCounter(), UIWindow::WatcherMode::READONLY);
+    mipWindow->add_watcher("budget (MB)", &mipStreamer.budgetMB, UIWindow::WatcherMode::SLIDER, 1, 1024);
+    mipWindow->add_watcher("bias", &mipStreamer.bias, UIWindow::WatcherMode::SLIDER, -2.0f, 4.0f);
+
+    auto lodWindow = getUI().add_window("LOD", {});
+    lodWindow->add_watcher("max pixel error", &LODSettings::maxPixelError, UIWindow::WatcherMode::SLIDER, 0.1f,
+                           16.0f);
+    lodWindow->add_watcher("hysteresis", &LODSettings::hysteresis, UIWindow::WatcherMode::SLIDER, 0.0f, 0.9f);
     while (!glfwWindowShouldClose(window))
     {
         // Clear the screen
+        getGLState().setDepthMask(true);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         camera->needsUpdate = true;
@@ -62,10 +186,24 @@ i32 main()
             glfwSetWindowShouldClose(window, true);
 
         // draw the scene
+        textureStreamer.beginFrame();
+        getDrawDataBuffer().beginFrame();
+        culler.beginFrame();
         scene->Update();
+        culler.endFrame(scene->getRenderGraph().getDepthTexture(), renderSize);
+        occlusion.endFrame();
+        mipStreamer.endFrame();
+        getDrawDataBuffer().endFrame();
+        targetPool.endFrame();
+        // before the UI is drawn over the frame
+        frameCapture.endFrame();
 
         getUI().render();
 
+        // ImGui sets its own state, don't trust the cache past this point
+        getGLState().invalidate();
+        getGLState().endFrame();
+
         // Swap buffers and poll IO events
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -78,6 +216,7 @@ i32 main()
         }
     }
 
+    frameCapture.flush();
     getUI().shutdown();
     glfwTerminate();
     return 0;
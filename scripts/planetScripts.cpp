@@ -62,7 +62,7 @@ class EarthScript : public Script
     void Update() override
     {
         gameObject->setTransform(gameObject->getTransform().rotateBy(vec3(0, speed, 0)));
-        mesh->setUniform(UNIFORM_LOCATIONS::VIEW_POS, vec3(gameObject->getObjectMatrix()[3]));
+        mesh->setParam("position", vec3(gameObject->getObjectMatrix()[3]));
     }
 };
 
@@ -90,7 +90,7 @@ class MoonScript : public Script
     void Update() override
     {
         gameObject->setTransform(gameObject->getTransform().rotateBy(vec3(0, speed, 0)));
-        mesh->setUniform(UNIFORM_LOCATIONS::VIEW_POS, vec3(gameObject->getObjectMatrix()[3]));
+        mesh->setParam("position", vec3(gameObject->getObjectMatrix()[3]));
     }
 };
 
@@ -4,12 +4,12 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
 
-layout(location = 1) uniform mat4 model;
+#include "drawData.glsl"
+
 layout(location = 2) uniform mat4 view;
 layout(location = 3) uniform mat4 projection;
 layout(location = 4) uniform vec3 viewPos;
 layout(location = 6) uniform vec2 resolution;
-layout(location = 8) uniform mat4 prevMVP;
 
 layout(location = 750) uniform sampler2D fbo0;
 layout(location = 751) uniform sampler2D fbo1;
@@ -27,12 +27,22 @@ out vec2 uv;
 out float depth;
 out vec4 prevFragPos;
 out vec4 glFragPos;
+flat out uint drawID;
+// per object color from Mesh::setMaterialOverride, multiplied in by the fragment shaders
+flat out vec4 objectTint;
 
 void main() {
-    gl_Position = projection * view * model * vec4(position, 1.0);
-    fragPos = vec3(model * vec4(position, 1.0));
-    fragPosWorld = vec3(view * model * vec4(position, 1.0));
-    prevFragPos = prevMVP * vec4(position, 1.0);
+    drawID = uint(gl_BaseInstance + gl_DrawID);
+    mat4 model = draws[drawID].model;
+    mat4 prevMVP = draws[drawID].prevMVP;
+    objectTint = draws[drawID].materialOverride;
+    // identity unless the mesh positions are quantized
+    vec3 objectPosition = position * draws[drawID].positionScale.xyz + draws[drawID].positionOffset.xyz;
+
+    gl_Position = projection * view * model * vec4(objectPosition, 1.0);
+    fragPos = vec3(model * vec4(objectPosition, 1.0));
+    fragPosWorld = vec3(view * model * vec4(objectPosition, 1.0));
+    prevFragPos = prevMVP * vec4(objectPosition, 1.0);
     glFragPos = gl_Position;
 
     normalDir = transpose(inverse(mat3(model))) * normal;
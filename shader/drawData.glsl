@@ -0,0 +1,17 @@
+#pragma once
+
+struct DrawData {
+                            // base alignment  | aligned offset
+    mat4 model;             // 64 bytes        | 0
+    mat4 prevMVP;           // 64 bytes        | 64
+    vec4 materialOverride;  // 16 bytes        | 128, per object tint, white by default
+    vec4 positionScale;     // 16 bytes        | 144
+    vec4 positionOffset;    // 16 bytes        | 160
+                            // total: 176 bytes
+};
+
+// filled by DrawDataBuffer, index with gl_BaseInstance + gl_DrawID: single draws pass their draw ID
+// as base instance, multi-draws pass the ID of their first draw
+layout(std430, binding = 2) readonly buffer DrawDataBuffer {
+    DrawData draws[];
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+// Point lights are binned into clusters, screen tiles cut in exponential depth slices, by
+// shader/lightCluster.comp every frame. Fragments only go through the lights of their cluster.
+
+struct Light {
+                     // base alignment  | aligned offset
+    vec3 position;   // 12 bytes        | 0
+    float radius;    //  4 bytes        | 12  (0: reaches everything, no falloff)
+    vec3 color;      // 12 bytes        | 16
+    float intensity; //  4 bytes        | 28
+                     // total: 32 bytes
+};
+
+struct DirectionalLight {
+                        // base alignment  | aligned offset
+    vec3 direction;  // 12 bytes        | 0
+    vec3 color;      // 12 bytes        | 16
+    float intensity; //  4 bytes        | 28
+                        // total: 32 bytes
+};
+
+layout(std140, binding = 0) uniform Lights {
+                               // base alignment  | aligned offset
+    DirectionalLight dirLight; // 32 bytes        | 0
+    uvec4 clusterGrid;         // 16 bytes        | 32  (tiles x, tiles y, slices, lights per cluster)
+    vec4 clusterDepth;         // 16 bytes        | 48  (near, far, slice scale, slice bias)
+    vec2 clusterScreenSize;    //  8 bytes        | 64
+    int numLights;             //  4 bytes        | 72
+                               // total: 80 bytes
+};
+
+layout(std430, binding = 6) readonly buffer PointLights {
+    Light lights[];
+};
+
+#ifdef LIGHT_CLUSTER_BUILD
+#define LIGHT_CLUSTER_ACCESS writeonly
+#else
+#define LIGHT_CLUSTER_ACCESS readonly
+#endif
+
+layout(std430, binding = 7) LIGHT_CLUSTER_ACCESS buffer LightClusterCounts {
+    uint clusterLightCount[];
+};
+
+// clusterGrid.w slots per cluster
+layout(std430, binding = 8) LIGHT_CLUSTER_ACCESS buffer LightClusterIndices {
+    uint clusterLightIndex[];
+};
+
+#ifndef LIGHT_CLUSTER_BUILD
+// view depth back out of the depth buffer value
+float getFragViewDepth() {
+    float near = clusterDepth.x;
+    float far = clusterDepth.y;
+    float ndcDepth = gl_FragCoord.z * 2.0 - 1.0;
+    return 2.0 * near * far / (far + near - ndcDepth * (far - near));
+}
+
+#include "shadows.glsl"
+
+uint getLightCluster() {
+    float viewDepth = getFragViewDepth();
+
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterScreenSize * vec2(clusterGrid.xy)), clusterGrid.xy - 1u);
+    uint slice = min(uint(max(log(viewDepth) * clusterDepth.z + clusterDepth.w, 0.0)), clusterGrid.z - 1u);
+    return tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice);
+}
+
+uint getClusterLightCount(uint cluster) {
+    return clusterLightCount[cluster];
+}
+
+Light getClusterLight(uint cluster, uint i) {
+    return lights[clusterLightIndex[cluster * clusterGrid.w + i]];
+}
+
+// smooth falloff reaching 0 at the radius, the clusters stop there
+float lightAttenuation(Light light, vec3 fragPos) {
+    if (light.radius <= 0.0)
+        return 1.0;
+
+    float d = distance(light.position, fragPos) / light.radius;
+    float window = clamp(1.0 - d * d * d * d, 0.0, 1.0);
+    return window * window / (1.0 + d * d * 16.0);
+}
+#endif
@@ -4,32 +4,11 @@ in vec2 uv;
 in vec3 normalDir;
 in vec3 fragPos;
 
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor;
+#include "velocity.glsl"
 layout(location = 4) uniform vec3 viewPos;
 
-struct Light {
-                     // base alignment  | aligned offset
-    vec3 position;   // 12 bytes        | 0
-    vec3 color;      // 12 bytes        | 16
-    float intensity; //  4 bytes        | 32
-                     // total: 32 bytes
-};
-
-struct DirectionalLight {
-                        // base alignment  | aligned offset
-    vec3 direction;  // 12 bytes        | 0
-    vec3 color;      // 12 bytes        | 16
-    float intensity; //  4 bytes        | 32
-                        // total: 32 bytes
-};
-
-layout(std140, binding = 0) uniform Lights {
-                               // base alignment  | aligned offset
-    Light lights[10];          // 320 bytes       | 0
-    DirectionalLight dirLight; // 32 bytes        | 320
-    int numLights;             //   4 bytes       | 352
-                               // total: 356 bytes
-};
+#include "lights.glsl"
 
 layout(location = 500) uniform sampler2D TextureDay;
 layout(location = 501) uniform sampler2D TextureNight;
@@ -40,14 +19,17 @@ void main() {
 
     float sunIntensity = 0.0;
     vec3 tint = vec3(0.0);
-    for(int i = 0; i < numLights; i++) {
-        Light light = lights[i];
+    uint cluster = getLightCluster();
+    for(uint i = 0; i < getClusterLightCount(cluster); i++) {
+        Light light = getClusterLight(cluster, i);
         vec3 lightDir = normalize(light.position - fragPos);
-        sunIntensity += max(dot(lightDir, normalDir), 0.0) * light.intensity;
+        sunIntensity += max(dot(lightDir, normalDir), 0.0) * light.intensity * lightAttenuation(light, fragPos);
         tint += sunIntensity * light.color;
     }
 
     FragColor = mix(nightColor, dayColor * vec4(tint, 1), sunIntensity);
 
     // FragColor = vec4(uv, 1.0, 1.0);
+
+    writeVelocity();
 }
\ No newline at end of file
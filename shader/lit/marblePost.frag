@@ -1,34 +1,13 @@
 #version 460 core
 
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor;
+#include "velocity.glsl"
 
 in vec2 uv;
 in vec3 fragPos;
 in vec3 normalDir;
 
-struct Light {
-                     // base alignment  | aligned offset
-    vec3 position;   // 12 bytes        | 0
-    vec3 color;      // 12 bytes        | 16
-    float intensity; //  4 bytes        | 32
-                     // total: 32 bytes
-};
-
-struct DirectionalLight {
-                        // base alignment  | aligned offset
-    vec3 direction;  // 12 bytes        | 0
-    vec3 color;      // 12 bytes        | 16
-    float intensity; //  4 bytes        | 32
-                        // total: 32 bytes
-};
-
-layout(std140, binding = 0) uniform Lights {
-                               // base alignment  | aligned offset
-    Light lights[10];          // 320 bytes       | 0
-    DirectionalLight dirLight; // 32 bytes        | 320
-    int numLights;             //   4 bytes       | 352
-                               // total: 356 bytes
-};
+#include "lights.glsl"
 
 layout(location = 1) uniform mat4 model;
 layout(location = 2) uniform mat4 view;
@@ -51,13 +30,14 @@ void main() {
     vec3 ambient = 0.2 * baseColor;
     vec3 color = vec3(0.0);
     float specular = 0.0;
-    for(int i = 0; i < numLights; i++) {
-        Light light = lights[i];
+    uint cluster = getLightCluster();
+    for(uint i = 0; i < getClusterLightCount(cluster); i++) {
+        Light light = getClusterLight(cluster, i);
         // compute diffuse
         vec3 norm = normalize(normalDir);
         vec3 lightDir = normalize(light.position - fragPos);
         float diff = max(dot(lightDir, norm), 0.0);
-        vec3 diffuse = vec3(diff * light.intensity);
+        vec3 diffuse = vec3(diff * light.intensity * lightAttenuation(light, fragPos));
 
         // compute specular
         vec3 reflectDir = reflect(-lightDir, norm);
@@ -70,7 +50,7 @@ void main() {
     // compute directional light
     float diff = max(dot(normalDir, -dirLight.direction), 0.0);
     vec3 diffuse = vec3(diff * dirLight.intensity) * dirLight.color;
-    color += diffuse;
+    color += diffuse * getShadow(fragPos, normalize(normalDir));
 
     // directional light specular
     vec3 reflectDir = reflect(dirLight.direction, normalize(normalDir));
@@ -94,4 +74,6 @@ void main() {
 
     // FragColor = vec4(normalDir, 1.0);
     // FragColor = vec4(specular, 1.0);
+
+    writeVelocity();
 }
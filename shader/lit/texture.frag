@@ -5,23 +5,37 @@
 in vec2 uv;
 in vec3 normalDir;
 in vec3 fragPos;
-in vec4 prevFragPos;
-in vec4 glFragPos;
+flat in vec4 objectTint;
 
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor;
+#include "velocity.glsl"
 
+#ifdef TEXTURE_ARRAYS
+// same sized textures share an array, the material points at its layer
+layout(location = 500) uniform sampler2DArray Texture;
+layout(location = 600) uniform float TextureLayer;
+#define sampleTexture(uv) texture(Texture, vec3(uv, TextureLayer))
+#else
 layout(location = 500) uniform sampler2D Texture;
+#define sampleTexture(uv) texture(Texture, uv)
+#endif
+
+// see the <material> params in scene.xml, same members in the same order
+layout(std140, binding = 1) uniform MaterialParams {
+    vec4 tint;
+};
 
 void main() {
-    vec3 texColor = texture(Texture, uv).rgb;
+    vec3 texColor = sampleTexture(uv).rgb * tint.rgb * objectTint.rgb;
     vec3 ambient = 0.2 * texColor;
     vec3 color = vec3(0.0);
-    for(int i = 0; i < numLights; i++) {
-        Light light = lights[i];
+    uint cluster = getLightCluster();
+    for(uint i = 0; i < getClusterLightCount(cluster); i++) {
+        Light light = getClusterLight(cluster, i);
         vec3 norm = normalize(normalDir);
         vec3 lightDir = normalize(light.position - fragPos);
         float diff = max(dot(lightDir, norm), 0.0);
-        vec3 diffuse = vec3(diff * light.intensity);
+        vec3 diffuse = vec3(diff * light.intensity * lightAttenuation(light, fragPos));
 
         color += diffuse * light.color;
     }
@@ -29,19 +43,11 @@ void main() {
     // compute directional light
     float diff = max(dot(normalDir, -dirLight.direction), 0.0);
     vec3 diffuse = vec3(diff * dirLight.intensity) * dirLight.color;
-    color += diffuse;
+    color += diffuse * getShadow(fragPos, normalize(normalDir));
 
     vec3 result = clamp(color * texColor + ambient, 0.0, 1.0);
 
     FragColor = vec4(result, 1.0);
 
-    vec2 fragCoord = gl_FragCoord.xy;
-    int fragPosition = int(fragCoord.x) + int(fragCoord.y) * int(resolution.x);
-
-    vec2 a = (glFragPos.xy / glFragPos.w) * 0.5 + 0.5;
-    vec2 b = (prevFragPos.xy / prevFragPos.w) * 0.5 + 0.5;
-
-    vec2 velocity = a - b;
-
-    velocities[fragPosition] = velocity;
+    writeVelocity();
 }
\ No newline at end of file
@@ -6,6 +6,7 @@ out vec4 FragColor;
 
 in vec2 uv;
 
+layout(location = 751) uniform sampler2D fbo1; // velocity
 layout(location = 752) uniform sampler2D fbo2;
 
 void main() {
@@ -14,15 +15,12 @@ void main() {
     vec3 color = texture(fbo2, screenPos).rgb;
     // color = vec3(1.0) - color;
 
-    vec2 fragCoord = gl_FragCoord.xy;
-    int fragPosition = int(fragCoord.x) + int(fragCoord.y) * int(resolution.x);
-
     // FragColor = vec4(color, 1.0);
     // FragColor = vec4(1.0);
 
-    // FragColor = vec4(clamp(color + vec3(velocities[fragPosition] * 100.0, 0.0), 0.0, 1.0), 1.0);
+    // FragColor = vec4(clamp(color + vec3(texture(fbo1, screenPos).rg * 100.0, 0.0), 0.0, 1.0), 1.0);
 
-    vec2 vel = velocities[fragPosition];
+    vec2 vel = texture(fbo1, screenPos).rg;
 
     // move the pixel by the velocity
     vec2 offset = vel * 10.0;
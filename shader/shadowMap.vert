@@ -2,8 +2,13 @@
 
 layout(location = 0) in vec3 position;
 
+#include "drawData.glsl"
+
 layout(location = 5) uniform mat4 lightSpaceMatrix;
 
 void main() {
-    gl_Position = lightSpaceMatrix * vec4(position, 1.0);
+    uint drawID = uint(gl_BaseInstance + gl_DrawID);
+    // identity unless the mesh positions are quantized
+    vec3 objectPosition = position * draws[drawID].positionScale.xyz + draws[drawID].positionOffset.xyz;
+    gl_Position = lightSpaceMatrix * draws[drawID].model * vec4(objectPosition, 1.0);
 }
@@ -0,0 +1,43 @@
+#pragma once
+
+// Cascaded shadow map of the directional light, rendered by CascadedShadowMap every frame before
+// anything lit. Cascades are picked by view depth, see lights.glsl for getFragViewDepth.
+
+layout(std140, binding = 9) uniform Shadows {
+                                // base alignment  | aligned offset
+    mat4 cascadeViewProj[4];    // 256 bytes       | 0
+    vec4 cascadeSplits;         // 16 bytes        | 256  (view depth where each cascade ends)
+    vec4 cascadeTexelSizes;     // 16 bytes        | 272  (world size of a texel)
+    int cascadeCount;           //  4 bytes        | 288  (0: shadows off)
+    float shadowNormalOffset;   //  4 bytes        | 292  (in texels)
+                                // total: 304 bytes
+};
+
+layout(binding = 15) uniform sampler2DArrayShadow shadowMap;
+
+// 1 lit by the directional light, 0 in its shadow
+float getShadow(vec3 fragPos, vec3 normal) {
+    float viewDepth = getFragViewDepth();
+    int cascade = 0;
+    while (cascade < cascadeCount && viewDepth > cascadeSplits[cascade])
+        cascade++;
+    if (cascade >= cascadeCount)
+        return 1.0;
+
+    // pushed off the surface by about a texel of this cascade so it doesn't shadow itself
+    vec3 offsetPos = fragPos + normal * cascadeTexelSizes[cascade] * shadowNormalOffset;
+    vec4 lightPos = cascadeViewProj[cascade] * vec4(offsetPos, 1.0);
+    vec3 coords = lightPos.xyz / lightPos.w * 0.5 + 0.5;
+    if (coords.z > 1.0)
+        return 1.0;
+
+    // 3x3 taps on top of the hardware 2x2 compare
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+        }
+    }
+    return lit / 9.0;
+}
@@ -4,10 +4,10 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
 
-layout(location = 1) uniform mat4 model;
+#include "drawData.glsl"
+
 layout(location = 2) uniform mat4 view;
 layout(location = 3) uniform mat4 projection;
-layout(location = 8) uniform mat4 prevMVP;
 
 out vec3 fragPos;
 out vec4 glFragPos;
@@ -18,6 +18,6 @@ void main() {
     fragPos = position;
 
     gl_Position = pos.xyww;
-    prevFragPos = prevMVP * vec4(position, 1.0);
+    prevFragPos = draws[gl_BaseInstance + gl_DrawID].prevMVP * vec4(position, 1.0);
     glFragPos = gl_Position;
 }
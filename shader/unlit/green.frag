@@ -1,7 +1,10 @@
 #version 460 core
 
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor;
+#include "velocity.glsl"
 
 void main() {
     FragColor = vec4(0.0, 1.0, 0.0, 1.0);
+
+    writeVelocity();
 }
@@ -2,14 +2,18 @@
 
 in vec2 uv;
 in vec3 fragPos;
+flat in vec4 objectTint;
 
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor;
+#include "velocity.glsl"
 
 layout(location = 500) uniform sampler2D Texture;
 
 void main() {
     vec4 texColor = texture(Texture, uv);
-    FragColor = texColor;
+    FragColor = texColor * objectTint;
 
     // FragColor = vec4(uv, 1.0, 1.0);
+
+    writeVelocity();
 }
\ No newline at end of file
@@ -0,0 +1,15 @@
+#pragma once
+
+// Screen motion since the last frame, in uv units, out of the prevMVP of the draw (see 3D.vert).
+// Goes to the second color attachment of passes with a velocity target, every shader drawn in
+// such a pass has to call writeVelocity()
+in vec4 prevFragPos;
+in vec4 glFragPos;
+
+layout(location = 1) out vec2 Velocity;
+
+void writeVelocity() {
+    vec2 a = (glFragPos.xy / glFragPos.w) * 0.5 + 0.5;
+    vec2 b = (prevFragPos.xy / prevFragPos.w) * 0.5 + 0.5;
+    Velocity = a - b;
+}
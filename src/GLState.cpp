@@ -0,0 +1,302 @@
+#include "GLState.hpp"
+
+#include <iostream>
+
+GLState &getGLState()
+{
+    static GLState state;
+    return state;
+}
+
+GLState::GLState()
+{
+    invalidate();
+    issued.fill(0);
+    skipped.fill(0);
+    lastIssued.fill(0);
+    lastSkipped.fill(0);
+}
+
+void GLState::invalidate()
+{
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    activeTextureUnit = UNKNOWN;
+    for (auto &unit : textures)
+    {
+        unit.fill(UNKNOWN);
+    }
+    drawFramebuffer = UNKNOWN;
+    readFramebuffer = UNKNOWN;
+    capabilities.fill(-1);
+    depthMask = -1;
+    depthFunc = UNKNOWN;
+    blendSrc = UNKNOWN;
+    blendDst = UNKNOWN;
+    polygonMode = UNKNOWN;
+    viewport = ivec4(-1);
+}
+
+void GLState::endFrame()
+{
+    lastIssued = issued;
+    lastSkipped = skipped;
+    issued.fill(0);
+    skipped.fill(0);
+}
+
+u32 GLState::toTargetIndex(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_2D:
+        return TARGET_2D;
+    case GL_TEXTURE_CUBE_MAP:
+        return TARGET_CUBE_MAP;
+    case GL_TEXTURE_2D_ARRAY:
+        return TARGET_2D_ARRAY;
+    case GL_TEXTURE_3D:
+        return TARGET_3D;
+    default:
+        return TEXTURE_TARGET_N;
+    }
+}
+
+u32 GLState::toCapabilityIndex(GLenum cap)
+{
+    switch (cap)
+    {
+    case GL_DEPTH_TEST:
+        return CAP_DEPTH_TEST;
+    case GL_BLEND:
+        return CAP_BLEND;
+    case GL_CULL_FACE:
+        return CAP_CULL_FACE;
+    case GL_SCISSOR_TEST:
+        return CAP_SCISSOR_TEST;
+    case GL_STENCIL_TEST:
+        return CAP_STENCIL_TEST;
+    default:
+        return CAPABILITY_N;
+    }
+}
+
+void GLState::useProgram(u32 id)
+{
+    if (check(program == id, PROGRAM))
+    {
+        glUseProgram(id);
+        program = id;
+    }
+}
+
+void GLState::bindVertexArray(u32 id)
+{
+    if (check(vertexArray == id, VERTEX_ARRAY))
+    {
+        glBindVertexArray(id);
+        vertexArray = id;
+    }
+}
+
+void GLState::activeTexture(u32 unit)
+{
+    if (check(activeTextureUnit == unit, ACTIVE_TEXTURE))
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeTextureUnit = unit;
+    }
+}
+
+void GLState::bindTexture(GLenum target, u32 id)
+{
+    u32 t = toTargetIndex(target);
+    if (activeTextureUnit >= MAX_TEXTURE_UNITS || t == TEXTURE_TARGET_N)
+    {
+        issued[TEXTURE]++;
+        glBindTexture(target, id);
+        if (activeTextureUnit < MAX_TEXTURE_UNITS)
+        {
+            textures[activeTextureUnit].fill(UNKNOWN);
+        }
+        return;
+    }
+
+    if (check(textures[activeTextureUnit][t] == id, TEXTURE))
+    {
+        glBindTexture(target, id);
+        textures[activeTextureUnit][t] = id;
+    }
+}
+
+void GLState::bindTexture(u32 unit, GLenum target, u32 id)
+{
+    u32 t = toTargetIndex(target);
+    if (unit < MAX_TEXTURE_UNITS && t != TEXTURE_TARGET_N && textures[unit][t] == id)
+    {
+        skipped[TEXTURE]++;
+        return;
+    }
+
+    activeTexture(unit);
+    bindTexture(target, id);
+}
+
+void GLState::bindFramebuffer(GLenum target, u32 id)
+{
+    switch (target)
+    {
+    case GL_FRAMEBUFFER:
+        if (check(drawFramebuffer == id && readFramebuffer == id, FRAMEBUFFER))
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, id);
+            drawFramebuffer = id;
+            readFramebuffer = id;
+        }
+        break;
+    case GL_DRAW_FRAMEBUFFER:
+        if (check(drawFramebuffer == id, FRAMEBUFFER))
+        {
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, id);
+            drawFramebuffer = id;
+        }
+        break;
+    case GL_READ_FRAMEBUFFER:
+        if (check(readFramebuffer == id, FRAMEBUFFER))
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, id);
+            readFramebuffer = id;
+        }
+        break;
+    default:
+        std::cerr << "GLState: invalid framebuffer target " << target << std::endl;
+        break;
+    }
+}
+
+void GLState::setCapability(GLenum cap, bool enabled)
+{
+    u32 c = toCapabilityIndex(cap);
+    if (c == CAPABILITY_N)
+    {
+        issued[CAPABILITY]++;
+        enabled ? glEnable(cap) : glDisable(cap);
+        return;
+    }
+
+    if (check(capabilities[c] == (i8)enabled, CAPABILITY))
+    {
+        enabled ? glEnable(cap) : glDisable(cap);
+        capabilities[c] = enabled;
+    }
+}
+
+void GLState::setDepthMask(bool enabled)
+{
+    if (check(depthMask == (i8)enabled, DEPTH_MASK))
+    {
+        glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+        depthMask = enabled;
+    }
+}
+
+void GLState::setDepthFunc(GLenum func)
+{
+    if (check(depthFunc == func, DEPTH_FUNC))
+    {
+        glDepthFunc(func);
+        depthFunc = func;
+    }
+}
+
+void GLState::setBlendFunc(GLenum src, GLenum dst)
+{
+    if (check(blendSrc == src && blendDst == dst, BLEND_FUNC))
+    {
+        glBlendFunc(src, dst);
+        blendSrc = src;
+        blendDst = dst;
+    }
+}
+
+void GLState::setPolygonMode(GLenum mode)
+{
+    if (check(polygonMode == mode, POLYGON_MODE))
+    {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+        polygonMode = mode;
+    }
+}
+
+void GLState::setViewport(i32 x, i32 y, i32 width, i32 height)
+{
+    ivec4 v(x, y, width, height);
+    if (check(viewport == v, VIEWPORT))
+    {
+        glViewport(x, y, width, height);
+        viewport = v;
+    }
+}
+
+void GLState::programDeleted(u32 id)
+{
+    if (program == id)
+        program = 0;
+}
+
+void GLState::vertexArrayDeleted(u32 id)
+{
+    if (vertexArray == id)
+        vertexArray = 0;
+}
+
+void GLState::textureDeleted(u32 id)
+{
+    for (auto &unit : textures)
+    {
+        for (auto &binding : unit)
+        {
+            if (binding == id)
+                binding = 0;
+        }
+    }
+}
+
+void GLState::framebufferDeleted(u32 id)
+{
+    if (drawFramebuffer == id)
+        drawFramebuffer = 0;
+    if (readFramebuffer == id)
+        readFramebuffer = 0;
+}
+
+const char *GLState::getCounterName(Counter counter)
+{
+    switch (counter)
+    {
+    case PROGRAM:
+        return "program";
+    case VERTEX_ARRAY:
+        return "vertex array";
+    case ACTIVE_TEXTURE:
+        return "active texture";
+    case TEXTURE:
+        return "texture";
+    case FRAMEBUFFER:
+        return "framebuffer";
+    case CAPABILITY:
+        return "enable/disable";
+    case DEPTH_MASK:
+        return "depth mask";
+    case DEPTH_FUNC:
+        return "depth func";
+    case BLEND_FUNC:
+        return "blend func";
+    case POLYGON_MODE:
+        return "polygon mode";
+    case VIEWPORT:
+        return "viewport";
+    default:
+        return "unknown";
+    }
+}
@@ -1,5 +1,6 @@
 #include "GLutils.hpp"
 #include "cstdlib"
+#include "shader.hpp"
 
 #define GLFW_DLL
 #include <GLFW/glfw3.h>
@@ -210,18 +211,25 @@ void OpenGLInit()
         exit(EXIT_FAILURE);
     }
 
+    ShaderProgram::enableParallelCompile();
+
     glfwSetErrorCallback(glfw_error_callback);
     glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 
     // Enable V-Sync
     glfwSwapInterval(1);
 
+    GLState &gl = getGLState();
+
     // Enable depth test
-    glEnable(GL_DEPTH_TEST);
+    gl.setCapability(GL_DEPTH_TEST, true);
     // Accept fragment if it closer to the camera than the former one
-    glDepthFunc(GL_LESS);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl.setDepthFunc(GL_LESS);
+    gl.setCapability(GL_BLEND, true);
+    gl.setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // the skybox mips would show the face edges otherwise
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
     glEnable(GL_DEBUG_OUTPUT);
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
@@ -244,29 +252,9 @@ void OpenGLInit()
     windowSize = ivec2(width, height);
 
     // update window size
-    glViewport(0, 0, width, height);
+    gl.setViewport(0, 0, width, height);
 
     glClearColor(0.1f, 0.2f, 0.3f, 0.0f);
 
-    // initialize VelocityBuffer SSBO
-    GLuint clearVelocitySSBOID;
-    glGenBuffers(1, &clearVelocitySSBOID);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, clearVelocitySSBOID);
-    EngineGlobals::clearVelocitySSBO = std::vector<float>(windowSize.x * windowSize.y * 2, 0.0f);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(vec2) * windowSize.x * windowSize.y,
-                 EngineGlobals::clearVelocitySSBO.data(), GL_DYNAMIC_COPY);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_OBJECT_BINDINGS::VELOCITY_BUFFER, clearVelocitySSBOID);
-
-    EngineGlobals::clearVelocitySSBOID = clearVelocitySSBOID;
-
-    auto SSBOResizeCallback = [](GLFWwindow *window, i32 width, i32 height) {
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, EngineGlobals::clearVelocitySSBOID);
-        EngineGlobals::clearVelocitySSBO = std::vector<float>(width * height * 2, 0.0f);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(vec2) * width * height, EngineGlobals::clearVelocitySSBO.data(),
-                     GL_DYNAMIC_COPY);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_OBJECT_BINDINGS::VELOCITY_BUFFER,
-                         EngineGlobals::clearVelocitySSBOID);
-    };
-
-    InputManager::addWindowSizeCallback(SSBOResizeCallback);
+    renderSize = windowSize;
 }
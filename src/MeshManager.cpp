@@ -1,5 +1,6 @@
 #include "MeshManager.hpp"
 #include "mesh.hpp"
+#include "occlusionCulling.hpp"
 
 MeshManagerPtr getMeshManager()
 {
@@ -7,16 +8,72 @@ MeshManagerPtr getMeshManager()
     return meshManager;
 }
 
+void MeshManager::buildStaticGeometry()
+{
+    if (staticGeometry.isDirty())
+    {
+        staticGeometry.build(meshes);
+        getOcclusionCuller().setOccluders(meshes);
+    }
+}
+
 void MeshManager::Update(RenderLayerPtr renderLayer)
 {
     // not a huge fan of this past "me"...
     // wtf is this comment
     // also yeah this is bad
+    OcclusionCuller &occlusion = getOcclusionCuller();
+    buildStaticGeometry();
+
+    mat4 view = EngineGlobals::getViewMatrix();
+    occlusion.beginLayer(renderLayer, EngineGlobals::projectionMatrix * view);
+
+    staticGeometry.draw(renderLayer);
+
+    queue.clear();
+    queued.clear();
+    for (auto &mesh : meshes)
+    {
+        if (mesh->isStatic() || !mesh->getGameObject()->getEnabled() ||
+            mesh->getRenderLayer()->getID() != renderLayer->getID())
+            continue;
+
+        mat4 model = mesh->getGameObject()->getObjectMatrix();
+        vec3 boxMin, boxMax;
+        mesh->getBoundingBox(boxMin, boxMax);
+        if (!occlusion.isVisible(model, boxMin, boxMax))
+            continue;
+
+        mesh->requestTextureMips(view, model);
+        queued.push_back(mesh.get());
+        queue.push(mesh->getViewDepth(view, model), mesh->getMaterial()->getStateKey());
+    }
+
+    for (u32 i : queue.sort(renderLayer->getSortMode()))
+    {
+        queued[i]->ManualUpdate();
+    }
+}
+void MeshManager::drawShadowCasters(bool staticCasters, const std::array<vec4, 6> &planes)
+{
+    if (staticCasters)
+    {
+        staticGeometry.drawShadowCasters(planes);
+        return;
+    }
+
     for (auto &mesh : meshes)
     {
-        if (mesh->getGameObject()->getEnabled() && mesh->getRenderLayer()->getID() == renderLayer->getID())
-        {
-            mesh->ManualUpdate();
-        }
+        if (mesh->isStatic() || !mesh->getCastShadows() || !mesh->getRenderLayer()->getDepthTest() ||
+            !mesh->getGameObject()->getEnabled())
+            continue;
+
+        // meshes without CPU side vertices have no sphere, they always get drawn
+        mat4 model = mesh->getGameObject()->getObjectMatrix();
+        vec4 sphere = mesh->getBoundingSphere();
+        if (sphere.w > 0.0f && !DrawCuller::isVisible(planes, model, sphere))
+            continue;
+
+        mesh->drawDepth(model);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,246 @@
+#include "cascadedShadowMap.hpp"
+#include "GLState.hpp"
+#include "MeshManager.hpp"
+#include "drawCulling.hpp"
+#include "globals.hpp"
+#include "utils.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// std140 Shadows block of shader/shadows.glsl
+struct ShadowBlock
+{
+    mat4 viewProj[CascadedShadowMap::MAX_CASCADES];
+    vec4 splitDepths;
+    vec4 texelSizes;
+    i32 cascadeCount;
+    f32 normalOffset;
+    f32 padding[2];
+};
+static_assert(sizeof(ShadowBlock) == 304, "ShadowBlock must match the std140 layout of shader/shadows.glsl");
+} // namespace
+
+CascadedShadowMap &getCascadedShadowMap()
+{
+    static CascadedShadowMap cascadedShadowMap;
+    return cascadedShadowMap;
+}
+
+CascadedShadowMap::CascadedShadowMap(u32 _resolution) : resolution(_resolution)
+{
+    for (Cascade &cascade : cascades)
+    {
+        cascade.viewProj = mat4(1.0f);
+        cascade.splitDepth = 0.0f;
+        cascade.texelSize = 0.0f;
+    }
+
+    depthShader = std::make_shared<ShaderProgram>("shader/shadowMap.vert", "shader/shadowMap.frag");
+
+    // one layer per cascade, the cache is only ever copied from
+    for (GLuint *textureID : {&shadowTextureID, &staticTextureID})
+    {
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, textureID);
+        glTextureStorage3D(*textureID, 1, GL_DEPTH_COMPONENT32F, resolution, resolution, MAX_CASCADES);
+    }
+
+    // compared by the sampler, linear filtering gives a 2x2 PCF for free
+    glTextureParameteri(shadowTextureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(shadowTextureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(shadowTextureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(shadowTextureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(shadowTextureID, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTextureParameteri(shadowTextureID, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    glCreateFramebuffers(1, &fboID);
+    glNamedFramebufferDrawBuffer(fboID, GL_NONE);
+    glNamedFramebufferReadBuffer(fboID, GL_NONE);
+
+    glCreateBuffers(1, &uboID);
+    glNamedBufferStorage(uboID, sizeof(ShadowBlock), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glBindBufferBase(GL_UNIFORM_BUFFER, BUFFER_OBJECT_BINDINGS::SHADOWS, uboID);
+    uploadBlock();
+}
+
+CascadedShadowMap::~CascadedShadowMap()
+{
+    GLState &gl = getGLState();
+    glDeleteFramebuffers(1, &fboID);
+    gl.framebufferDeleted(fboID);
+    for (GLuint textureID : {shadowTextureID, staticTextureID})
+    {
+        glDeleteTextures(1, &textureID);
+        gl.textureDeleted(textureID);
+    }
+    glDeleteBuffers(1, &uboID);
+}
+
+void CascadedShadowMap::fitCascades(const mat4 &view, const mat4 &projection, vec3 lightDirection)
+{
+    // near and far back out of the perspective matrix
+    f32 near = projection[3][2] / (projection[2][2] - 1.0f);
+    f32 far = projection[3][2] / (projection[2][2] + 1.0f);
+    f32 distance = std::min(shadowDistance, far);
+    u32 count = clamp(cascadeCount, 1, (i32)MAX_CASCADES);
+
+    // only the light direction turns the cascades, never the camera
+    vec3 up = std::abs(lightDirection.y) > 0.99f ? vec3(0.0f, 0.0f, 1.0f) : vec3(0.0f, 1.0f, 0.0f);
+    mat4 lightView = lookAt(vec3(0.0f), lightDirection, up);
+    mat4 viewToLight = lightView * inverse(view);
+
+    // view space rays through the screen corners, at a distance of 1 along -z
+    mat4 inverseProjection = inverse(projection);
+    vec3 rays[4];
+    for (u32 c = 0; c < 4; c++)
+    {
+        vec4 p = inverseProjection * vec4(c & 1 ? 1.0f : -1.0f, c & 2 ? 1.0f : -1.0f, -1.0f, 1.0f);
+        rays[c] = vec3(p) / p.w;
+        rays[c] /= -rays[c].z;
+    }
+
+    f32 sliceNear = near;
+    for (u32 i = 0; i < count; i++)
+    {
+        f32 t = (i + 1) / (f32)count;
+        f32 sliceFar = mix(near + (distance - near) * t, near * std::pow(distance / near, t), splitLambda);
+
+        // sphere around the slice, taken in view space its radius can't change when the camera turns
+        vec3 corners[8];
+        vec3 center(0.0f);
+        for (u32 c = 0; c < 4; c++)
+        {
+            corners[c] = rays[c] * sliceNear;
+            corners[c + 4] = rays[c] * sliceFar;
+            center += corners[c] + corners[c + 4];
+        }
+        center /= 8.0f;
+        f32 radius = 0.0f;
+        for (const vec3 &corner : corners)
+        {
+            radius = std::max(radius, glm::distance(center, corner));
+        }
+        // rounded so float noise can't change the texel size from a frame to the next
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        // whole texel steps in light space, the depth range too so the matrix only changes when a
+        // texel boundary is crossed
+        f32 texelSize = 2.0f * radius / resolution;
+        vec3 lightCenter = floor(vec3(viewToLight * vec4(center, 1.0f)) / texelSize) * texelSize;
+
+        // the light looks down -z, casters up to casterDistance in front of the sphere still count
+        f32 depth = -lightCenter.z;
+        mat4 lightProjection = ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius,
+                                     lightCenter.y + radius, depth - radius - casterDistance, depth + radius);
+
+        cascades[i].viewProj = lightProjection * lightView;
+        cascades[i].splitDepth = sliceFar;
+        cascades[i].texelSize = texelSize;
+        sliceNear = sliceFar;
+    }
+}
+
+void CascadedShadowMap::renderCasters(GLuint textureID, u32 layer, const mat4 &viewProj, bool staticCasters,
+                                      bool clear)
+{
+    glNamedFramebufferTextureLayer(fboID, GL_DEPTH_ATTACHMENT, textureID, 0, layer);
+    if (clear)
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+    depthShader->setUniform(UNIFORM_LOCATIONS::LIGHT_SPACE_MATRIX, viewProj);
+    getMeshManager()->drawShadowCasters(staticCasters, DrawCuller::getFrustumPlanes(viewProj));
+}
+
+void CascadedShadowMap::uploadBlock()
+{
+    ShadowBlock block = {};
+    for (u32 i = 0; i < MAX_CASCADES; i++)
+    {
+        block.viewProj[i] = cascades[i].viewProj;
+        block.splitDepths[i] = cascades[i].splitDepth;
+        block.texelSizes[i] = cascades[i].texelSize;
+    }
+    block.cascadeCount = enabled ? clamp(cascadeCount, 1, (i32)MAX_CASCADES) : 0;
+    block.normalOffset = normalOffset;
+    glNamedBufferSubData(uboID, 0, sizeof(ShadowBlock), &block);
+}
+
+void CascadedShadowMap::update(const mat4 &view, const mat4 &projection, vec3 lightDirection)
+{
+    staticRenders = 0;
+    directRenders = 0;
+    if (!enabled)
+    {
+        uploadBlock();
+        return;
+    }
+
+    GLState &gl = getGLState();
+    MeshManagerPtr meshManager = getMeshManager();
+    meshManager->buildStaticGeometry();
+
+    lightDirection = normalize(lightDirection);
+    fitCascades(view, projection, lightDirection);
+
+    // static meshes are assumed to stay put, only a rebuild of the batches or the light turning
+    // throws every cached cascade away
+    u32 staticVersion = meshManager->getStaticGeometry().getVersion();
+    bool cacheUsable = cacheStatic && staticVersion == cachedStaticVersion && lightDirection == cachedLightDirection;
+    cachedStaticVersion = staticVersion;
+    cachedLightDirection = lightDirection;
+
+    depthShader->use();
+    gl.bindFramebuffer(GL_FRAMEBUFFER, fboID);
+    gl.setViewport(0, 0, resolution, resolution);
+    gl.setDepthMask(true);
+    gl.setCapability(GL_DEPTH_TEST, true);
+    // thin and open meshes cast from both sides
+    gl.setCapability(GL_CULL_FACE, false);
+    gl.setPolygonMode(GL_FILL);
+    gl.setCapability(GL_POLYGON_OFFSET_FILL, true);
+    glPolygonOffset(2.0f, 4.0f);
+
+    u32 count = clamp(cascadeCount, 1, (i32)MAX_CASCADES);
+    for (u32 i = 0; i < count; i++)
+    {
+        Cascade &cascade = cascades[i];
+        bool moved = !cacheUsable || cascade.viewProj != cascade.previousViewProj;
+        cascade.previousViewProj = cascade.viewProj;
+        cascade.missStreak = moved ? cascade.missStreak + 1 : 0;
+
+        // the near cascade moves with nearly every step of the camera, and one that keeps moving would pay for
+        // the cache render and the copy on top of what a direct render costs
+        if (!cacheStatic || i == 0 || cascade.missStreak >= MISS_LIMIT)
+        {
+            renderCasters(shadowTextureID, i, cascade.viewProj, true, true);
+            renderCasters(shadowTextureID, i, cascade.viewProj, false, false);
+            cascade.cacheValid = false;
+            directRenders++;
+            continue;
+        }
+
+        if (!cascade.cacheValid || cascade.cachedViewProj != cascade.viewProj)
+        {
+            renderCasters(staticTextureID, i, cascade.viewProj, true, true);
+            cascade.cachedViewProj = cascade.viewProj;
+            cascade.cacheValid = true;
+            staticRenders++;
+        }
+
+        glCopyImageSubData(staticTextureID, GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, shadowTextureID, GL_TEXTURE_2D_ARRAY, 0,
+                           0, 0, i, resolution, resolution, 1);
+        renderCasters(shadowTextureID, i, cascade.viewProj, false, false);
+    }
+
+    gl.setCapability(GL_POLYGON_OFFSET_FILL, false);
+    gl.bindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl.setViewport(0, 0, EngineGlobals::renderSize.x, EngineGlobals::renderSize.y);
+    depthShader->stop();
+
+    uploadBlock();
+    gl.bindTexture(TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, shadowTextureID);
+}
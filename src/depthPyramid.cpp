@@ -0,0 +1,65 @@
+#include "depthPyramid.hpp"
+#include "GLState.hpp"
+
+DepthPyramid::DepthPyramid()
+{
+    reduceShader = std::make_shared<ShaderProgram>("shader/depthReduce.comp");
+}
+
+DepthPyramid::~DepthPyramid()
+{
+    destroy();
+}
+
+void DepthPyramid::create(ivec2 _sourceSize)
+{
+    sourceSize = _sourceSize;
+    size = max(sourceSize / 2, ivec2(1));
+    levels = (u32)floor(log2((f32)max(size.x, size.y))) + 1;
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &pyramidTextureID);
+    glTextureStorage2D(pyramidTextureID, levels, GL_R32F, size.x, size.y);
+    glTextureParameteri(pyramidTextureID, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTextureParameteri(pyramidTextureID, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTextureParameteri(pyramidTextureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(pyramidTextureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void DepthPyramid::destroy()
+{
+    if (!pyramidTextureID)
+        return;
+
+    glDeleteTextures(1, &pyramidTextureID);
+    getGLState().textureDeleted(pyramidTextureID);
+    pyramidTextureID = 0;
+}
+
+void DepthPyramid::update(GLuint depthTextureID, ivec2 _sourceSize)
+{
+    if (_sourceSize != sourceSize)
+    {
+        destroy();
+        create(_sourceSize);
+    }
+
+    GLState &gl = getGLState();
+    reduceShader->use();
+
+    ivec2 inputSize = sourceSize;
+    ivec2 outputSize = size;
+    for (u32 level = 0; level < levels; level++)
+    {
+        // level 0 reads the scene depth itself, the others the previous level
+        gl.bindTexture(0, GL_TEXTURE_2D, level == 0 ? depthTextureID : pyramidTextureID);
+        reduceShader->setUniform(0, (i32)(level == 0 ? 0 : level - 1));
+        reduceShader->setUniform(1, inputSize);
+        glBindImageTexture(0, pyramidTextureID, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        glDispatchCompute((outputSize.x + 7) / 8, (outputSize.y + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        inputSize = outputSize;
+        outputSize = max(outputSize / 2, ivec2(1));
+    }
+}
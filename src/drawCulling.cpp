@@ -0,0 +1,236 @@
+#include "drawCulling.hpp"
+#include "GLState.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+DrawCuller &getDrawCuller()
+{
+    static DrawCuller drawCuller;
+    return drawCuller;
+}
+
+DrawCuller::DrawCuller()
+    : candidateRing(GL_SHADER_STORAGE_BUFFER, BUFFER_OBJECT_BINDINGS::CULL_CANDIDATES,
+                    MAX_CANDIDATES * sizeof(CullCandidate))
+{
+    cullShader = std::make_shared<ShaderProgram>("shader/cull.comp");
+
+    glCreateBuffers(1, &commandBufferID);
+    glNamedBufferStorage(commandBufferID, MAX_CANDIDATES * sizeof(DrawElementsIndirectCommand), nullptr, 0);
+    glCreateBuffers(1, &counterBufferID);
+    glNamedBufferStorage(counterBufferID, MAX_BUCKETS * sizeof(u32), nullptr, 0);
+}
+
+DrawCuller::~DrawCuller()
+{
+    glDeleteBuffers(1, &commandBufferID);
+    glDeleteBuffers(1, &counterBufferID);
+}
+
+void DrawCuller::beginFrame()
+{
+    candidateRing.beginFrame();
+    commandHead = 0;
+    counterHead = 0;
+    candidateCount = 0;
+    visibleCount = 0;
+}
+
+void DrawCuller::endFrame(GLuint depthTextureID, ivec2 depthSize)
+{
+    lastCandidateCount = candidateCount;
+    lastVisibleCount = visibleCount;
+    candidateRing.endFrame();
+
+    if (mode == GPU && useHiZ && depthTextureID)
+    {
+        depthPyramid.update(depthTextureID, depthSize);
+        pyramidViewProj = frameViewProj;
+    }
+}
+
+std::array<vec4, 6> DrawCuller::getFrustumPlanes(const mat4 &viewProj)
+{
+    // Gribb/Hartmann, rows of the view projection matrix
+    vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+    vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+    vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+    vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+
+    std::array<vec4, 6> planes = {row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2};
+    for (vec4 &plane : planes)
+    {
+        plane /= length(vec3(plane));
+    }
+    return planes;
+}
+
+bool DrawCuller::isVisible(const std::array<vec4, 6> &planes, const mat4 &model, vec4 sphere)
+{
+    // same math as shader/cull.comp
+    vec3 center = vec3(model * vec4(vec3(sphere), 1.0f));
+    f32 scale = max(max(length(vec3(model[0])), length(vec3(model[1]))), length(vec3(model[2])));
+    f32 radius = sphere.w * scale;
+
+    for (const vec4 &plane : planes)
+    {
+        if (dot(vec3(plane), center) + plane.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+void DrawCuller::cull(const std::vector<CullCandidate> &candidates, u32 bucketCount, const mat4 &viewProj,
+                      const std::vector<mat4> &models, bool keepOrder)
+{
+    u32 n = candidates.size();
+    frameViewProj = viewProj;
+    frustumPlanes = getFrustumPlanes(viewProj);
+    candidateCount += n;
+
+    if (mode == CPU || verifyGPU)
+    {
+        cpuCommands.assign(n, {});
+        cpuCounts.assign(bucketCount, 0);
+        for (u32 i = 0; i < n; i++)
+        {
+            const CullCandidate &c = candidates[i];
+            if (!isVisible(frustumPlanes, models[i], c.sphere))
+                continue;
+
+            u32 slot = cpuCounts[c.bucket]++;
+            cpuCommands[c.firstCommand + slot] = {c.count, 1, c.firstIndex, c.baseVertex, c.drawID - slot};
+        }
+    }
+
+    if (mode == CPU)
+    {
+        for (u32 count : cpuCounts)
+            visibleCount += count;
+        return;
+    }
+
+    if (commandHead + n > MAX_CANDIDATES || counterHead + bucketCount > MAX_BUCKETS)
+    {
+        std::cerr << "Too many culled draws in a frame (max " << MAX_CANDIDATES << " draws, " << MAX_BUCKETS
+                  << " buckets).\n";
+        exit(EXIT_FAILURE);
+    }
+
+    firstCommand = commandHead;
+    firstCounter = counterHead;
+    commandHead += n;
+    counterHead += bucketCount;
+
+    i64 offset = candidateRing.allocate(n * sizeof(CullCandidate), sizeof(CullCandidate));
+    memcpy(candidateRing.getPointer(offset), candidates.data(), n * sizeof(CullCandidate));
+
+    // without ARB_indirect_parameters every slot is kept and culled draws just get no instance
+    compact = !keepOrder && (GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters);
+    if (compact)
+    {
+        glClearNamedBufferSubData(counterBufferID, GL_R32UI, firstCounter * sizeof(u32), bucketCount * sizeof(u32),
+                                  GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_OBJECT_BINDINGS::CULL_COMMANDS, commandBufferID);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_OBJECT_BINDINGS::CULL_COUNTERS, counterBufferID);
+
+    bool hiZ = useHiZ && depthPyramid.isValid();
+    cullShader->setUniform(0, (u32)(offset / sizeof(CullCandidate)));
+    cullShader->setUniform(1, n);
+    cullShader->setUniform(2, firstCounter);
+    cullShader->setUniform(3, (u32)compact);
+    cullShader->setUniform(4, (u32)hiZ);
+    cullShader->setUniform(7, firstCommand);
+    if (hiZ)
+    {
+        cullShader->setUniform(5, pyramidViewProj);
+        cullShader->setUniform(6, vec2(depthPyramid.getSize()));
+        getGLState().bindTexture(0, GL_TEXTURE_2D, depthPyramid.getTextureID());
+    }
+    for (u32 i = 0; i < frustumPlanes.size(); i++)
+    {
+        cullShader->setUniform(10 + i, frustumPlanes[i]);
+    }
+
+    glDispatchCompute((n + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    if (verifyGPU)
+        verify(candidates, bucketCount);
+}
+
+void DrawCuller::verify(const std::vector<CullCandidate> &candidates, u32 bucketCount)
+{
+    u32 n = candidates.size();
+    std::vector<DrawElementsIndirectCommand> gpuCommands(n);
+    std::vector<u32> gpuCounts(bucketCount, 0);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glGetNamedBufferSubData(commandBufferID, firstCommand * sizeof(DrawElementsIndirectCommand),
+                            n * sizeof(DrawElementsIndirectCommand), gpuCommands.data());
+    if (compact)
+    {
+        glGetNamedBufferSubData(counterBufferID, firstCounter * sizeof(u32), bucketCount * sizeof(u32),
+                                gpuCounts.data());
+    }
+
+    // compare the sets of visible draw IDs, the GPU order depends on the atomics
+    std::vector<u32> gpuVisible;
+    std::vector<u32> cpuVisible;
+    for (u32 i = 0; i < n; i++)
+    {
+        const CullCandidate &c = candidates[i];
+        if (c.slot < (compact ? gpuCounts[c.bucket] : n) && gpuCommands[i].instanceCount)
+            gpuVisible.push_back(gpuCommands[i].baseInstance + c.slot);
+        if (c.slot < cpuCounts[c.bucket])
+            cpuVisible.push_back(cpuCommands[i].baseInstance + c.slot);
+    }
+    std::sort(gpuVisible.begin(), gpuVisible.end());
+    std::sort(cpuVisible.begin(), cpuVisible.end());
+    visibleCount += gpuVisible.size();
+
+    // the depth pyramid can only hide more, never show something outside the frustum
+    std::vector<u32> difference;
+    std::set_difference(gpuVisible.begin(), gpuVisible.end(), cpuVisible.begin(), cpuVisible.end(),
+                        std::back_inserter(difference));
+    if (!useHiZ)
+    {
+        std::set_difference(cpuVisible.begin(), cpuVisible.end(), gpuVisible.begin(), gpuVisible.end(),
+                            std::back_inserter(difference));
+    }
+
+    mismatches = difference.size();
+    if (mismatches)
+        std::cerr << "GPU culling differs from the CPU reference on " << mismatches << " draws.\n";
+}
+
+void DrawCuller::drawBucket(u32 bucket, u32 bucketFirstCommand, u32 bucketCandidates, GLenum indexType)
+{
+    if (mode == CPU)
+    {
+        u32 count = cpuCounts[bucket];
+        if (!count)
+            return;
+
+        u64 offset = getDrawDataBuffer().pushCommands(&cpuCommands[bucketFirstCommand], count);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (void *)offset, count, 0);
+        return;
+    }
+
+    u64 offset = (firstCommand + bucketFirstCommand) * sizeof(DrawElementsIndirectCommand);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBufferID);
+    if (compact)
+    {
+        glBindBuffer(GL_PARAMETER_BUFFER, counterBufferID);
+        glMultiDrawElementsIndirectCount(GL_TRIANGLES, indexType, (void *)offset,
+                                         (firstCounter + bucket) * sizeof(u32), bucketCandidates, 0);
+    }
+    else
+    {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (void *)offset, bucketCandidates, 0);
+    }
+}
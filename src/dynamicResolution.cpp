@@ -0,0 +1,209 @@
+#include "dynamicResolution.hpp"
+#include "GLState.hpp"
+#include "globals.hpp"
+#include "renderTargetPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+f32 halton(u32 index, u32 base)
+{
+    f32 result = 0.0f;
+    f32 f = 1.0f;
+    for (; index > 0; index /= base)
+    {
+        f /= base;
+        result += f * (index % base);
+    }
+    return result;
+}
+
+// frames between two scale changes, the timings of the old scale have to flush out first
+constexpr u32 SCALE_COOLDOWN = 15;
+// under that fraction of the budget the scale goes back up
+constexpr f32 HEADROOM = 0.8f;
+constexpr u32 JITTER_PHASES = 8;
+} // namespace
+
+DynamicResolution &getDynamicResolution()
+{
+    static DynamicResolution dynamicResolution;
+    return dynamicResolution;
+}
+
+DynamicResolution::DynamicResolution()
+{
+    glCreateQueries(GL_TIME_ELAPSED, QUERY_N, queryIDs.data());
+    upsampleShader = std::make_shared<ShaderProgram>("shader/temporalUpsample.comp");
+}
+
+DynamicResolution::~DynamicResolution()
+{
+    glDeleteQueries(QUERY_N, queryIDs.data());
+    releaseHistory();
+}
+
+void DynamicResolution::readQueries()
+{
+    for (u32 i = 0; i < QUERY_N; i++)
+    {
+        if (!queryPending[i])
+            continue;
+
+        GLuint available = 0;
+        glGetQueryObjectuiv(queryIDs[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queryIDs[i], GL_QUERY_RESULT, &elapsed);
+        f32 ms = elapsed / 1e6f;
+        gpuTime = gpuTime == 0.0f ? ms : mix(gpuTime, ms, 0.1f);
+        queryPending[i] = false;
+    }
+}
+
+void DynamicResolution::beginFrame()
+{
+    readQueries();
+
+    if (enabled && framesSinceChange >= SCALE_COOLDOWN && gpuTime > 0.0f)
+    {
+        // fragment cost goes with the pixel count, the square of the scale
+        f32 fitting = scale * std::sqrt(budgetMs / gpuTime);
+        f32 next = scale;
+        if (gpuTime > budgetMs)
+            next = std::floor(fitting / SCALE_STEP) * SCALE_STEP;
+        else if (gpuTime < budgetMs * HEADROOM)
+            next = std::max(scale, std::min(scale + SCALE_STEP, std::floor(fitting / SCALE_STEP) * SCALE_STEP));
+
+        next = clamp(next, minScale, 1.0f);
+        if (next != scale)
+        {
+            scale = next;
+            framesSinceChange = 0;
+        }
+    }
+    framesSinceChange++;
+
+    // all queries still in flight, this frame goes untimed
+    if (!queryPending[queryIndex])
+    {
+        glBeginQuery(GL_TIME_ELAPSED, queryIDs[queryIndex]);
+        queryActive = true;
+    }
+}
+
+void DynamicResolution::endFrame()
+{
+    if (!queryActive)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    queryPending[queryIndex] = true;
+    queryIndex = (queryIndex + 1) % QUERY_N;
+    queryActive = false;
+}
+
+void DynamicResolution::prepareFrame(ivec2 renderSize, ivec2 outputSize)
+{
+    using namespace EngineGlobals;
+    refreshProjectionMatrix();
+    unjitteredProjection = projectionMatrix;
+
+    prevJitter = jitter;
+    jittered = temporalUpsample && renderSize != outputSize;
+    if (!jittered)
+    {
+        jitter = vec2(0.0f);
+        prevJitter = vec2(0.0f);
+        historyValid = false;
+        return;
+    }
+
+    // Halton(2, 3) covers the pixel evenly within a few frames
+    u32 phase = frame++ % JITTER_PHASES + 1;
+    vec2 offset = vec2(halton(phase, 2), halton(phase, 3)) - 0.5f;
+    jitter = offset / vec2(renderSize);
+    // ndc is twice the uv range, the w of a perspective projection is -z
+    projectionMatrix[2][0] -= 2.0f * jitter.x;
+    projectionMatrix[2][1] -= 2.0f * jitter.y;
+}
+
+void DynamicResolution::allocateHistory(ivec2 size)
+{
+    releaseHistory();
+    historySize = size;
+
+    RenderTargetPool &pool = getRenderTargetPool();
+    for (u32 i = 0; i < 2; i++)
+    {
+        historyTextureIDs[i] = pool.acquire(GL_RGBA16F, size);
+        glCreateFramebuffers(1, &historyFBOIDs[i]);
+        glNamedFramebufferTexture(historyFBOIDs[i], GL_COLOR_ATTACHMENT0, historyTextureIDs[i], 0);
+        if (glCheckNamedFramebufferStatus(historyFBOIDs[i], GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Dynamic resolution: history framebuffer is not complete!" << std::endl;
+    }
+    historyValid = false;
+}
+
+void DynamicResolution::releaseHistory()
+{
+    GLState &gl = getGLState();
+    for (u32 i = 0; i < 2; i++)
+    {
+        if (!historyTextureIDs[i])
+            continue;
+        glDeleteFramebuffers(1, &historyFBOIDs[i]);
+        gl.framebufferDeleted(historyFBOIDs[i]);
+        getRenderTargetPool().release(historyTextureIDs[i]);
+        historyTextureIDs[i] = 0;
+        historyFBOIDs[i] = 0;
+    }
+    historySize = ivec2(0);
+}
+
+GLuint DynamicResolution::resolve(GLuint colorTextureID, GLuint depthTextureID, GLuint velocityTextureID,
+                                  ivec2 renderSize, ivec2 outputSize)
+{
+    prevViewProj = viewProj;
+    viewProj = unjitteredProjection * EngineGlobals::getViewMatrix();
+
+    if (!jittered)
+    {
+        // nothing to accumulate at full resolution, the history goes back to the pool
+        if (historySize != ivec2(0))
+            releaseHistory();
+        return 0;
+    }
+    if (historySize != outputSize)
+        allocateHistory(outputSize);
+
+    GLState &gl = getGLState();
+    u32 read = historyIndex;
+    u32 write = 1 - historyIndex;
+
+    upsampleShader->use();
+    gl.bindTexture(0, GL_TEXTURE_2D, colorTextureID);
+    gl.bindTexture(1, GL_TEXTURE_2D, depthTextureID);
+    gl.bindTexture(2, GL_TEXTURE_2D, historyTextureIDs[read]);
+    gl.bindTexture(3, GL_TEXTURE_2D, velocityTextureID);
+    // without a depth target static surfaces are taken as not moving
+    upsampleShader->setUniform(0, depthTextureID ? prevViewProj * inverse(viewProj) : mat4(1.0f));
+    upsampleShader->setUniform(1, jitter);
+    upsampleShader->setUniform(2, jitter - prevJitter);
+    upsampleShader->setUniform(3, renderSize);
+    upsampleShader->setUniform(4, historyValid ? 1.0f : 0.0f);
+    upsampleShader->setUniform(5, velocityTextureID ? 1.0f : 0.0f);
+    glBindImageTexture(0, historyTextureIDs[write], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+    glDispatchCompute((outputSize.x + 7) / 8, (outputSize.y + 7) / 8, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+    historyIndex = write;
+    historyValid = true;
+    return historyFBOIDs[write];
+}
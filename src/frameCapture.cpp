@@ -0,0 +1,252 @@
+#include "frameCapture.hpp"
+#include "GLState.hpp"
+#include "globals.hpp"
+
+#include <stb/stb_image_write.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+FrameCapture &getFrameCapture()
+{
+    // png encoding is the slow part, a few writers keep up with a sequence at full frame rate
+    static FrameCapture frameCapture(std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u));
+    return frameCapture;
+}
+
+FrameCapture::FrameCapture(u32 writerCount)
+{
+    for (u32 i = 0; i < writerCount; i++)
+    {
+        writers.emplace_back([this] { writerLoop(); });
+    }
+}
+
+FrameCapture::~FrameCapture()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &writer : writers)
+    {
+        writer.join();
+    }
+
+    for (Readback &slot : ring)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (slot.bufferID)
+            glDeleteBuffers(1, &slot.bufferID);
+    }
+}
+
+void FrameCapture::capture(GLuint fboID, ivec2 size, const std::string &path)
+{
+    if (size.x <= 0 || size.y <= 0)
+        return;
+
+    // the ring is full of readbacks the GPU isn't done with yet
+    Readback &slot = ring[next];
+    if (slot.fence)
+    {
+        stalls++;
+        collect(true);
+    }
+
+    u64 bytes = (u64)size.x * size.y * 4;
+    if (slot.bufferSize < bytes)
+    {
+        if (slot.bufferID)
+            glDeleteBuffers(1, &slot.bufferID);
+        glCreateBuffers(1, &slot.bufferID);
+        glNamedBufferStorage(slot.bufferID, bytes, nullptr, GL_MAP_READ_BIT | GL_CLIENT_STORAGE_BIT);
+        slot.bufferSize = bytes;
+    }
+
+    // rgba keeps every row 4 byte aligned whatever the width, the writers drop the alpha
+    getGLState().bindFramebuffer(GL_READ_FRAMEBUFFER, fboID);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.bufferID);
+    glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.size = size;
+    slot.path = path;
+    next = (next + 1) % RING_N;
+}
+
+void FrameCapture::startSequence(const std::string &pattern)
+{
+    std::filesystem::path directory = std::filesystem::path(pattern).parent_path();
+    std::error_code error;
+    if (!directory.empty())
+        std::filesystem::create_directories(directory, error);
+    if (error)
+        std::cerr << "Frame capture: can't create " << directory << ": " << error.message() << std::endl;
+
+    sequencePattern = pattern;
+    sequenceFrame = 0;
+    recording = true;
+}
+
+void FrameCapture::stopSequence()
+{
+    recording = false;
+}
+
+void FrameCapture::endFrame()
+{
+    if (recording)
+    {
+        char path[512];
+        snprintf(path, sizeof(path), sequencePattern.c_str(), sequenceFrame++);
+        capture(0, EngineGlobals::windowSize, path);
+    }
+    collect(false);
+
+    std::lock_guard lock(mutex);
+    writtenShown = written;
+}
+
+void FrameCapture::collect(bool waitForNext)
+{
+    // oldest first, so the files of a sequence reach the writers in order
+    for (u32 i = 0; i < RING_N; i++)
+    {
+        u32 index = (next + i) % RING_N;
+        Readback &slot = ring[index];
+        if (!slot.fence)
+            continue;
+
+        GLenum result = glClientWaitSync(slot.fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            if (!(waitForNext && index == next))
+                continue;
+            do
+            {
+                result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            } while (result == GL_TIMEOUT_EXPIRED);
+        }
+        if (result == GL_WAIT_FAILED)
+            std::cerr << "Frame capture fence wait failed.\n";
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+
+        Image image;
+        image.size = slot.size;
+        image.path = slot.path;
+        u64 bytes = (u64)slot.size.x * slot.size.y * 4;
+        image.pixels.resize(bytes);
+        const void *mapped = glMapNamedBufferRange(slot.bufferID, 0, bytes, GL_MAP_READ_BIT);
+        memcpy(image.pixels.data(), mapped, bytes);
+        glUnmapNamedBuffer(slot.bufferID);
+
+        std::unique_lock lock(mutex);
+        if (queue.size() >= MAX_QUEUED)
+        {
+            stalls++;
+            drained.wait(lock, [&] { return queue.size() < MAX_QUEUED; });
+        }
+        queue.push_back(std::move(image));
+        wake.notify_one();
+    }
+}
+
+void FrameCapture::flush()
+{
+    for (u32 i = 0; i < RING_N; i++)
+    {
+        collect(true);
+        next = (next + 1) % RING_N;
+    }
+
+    std::unique_lock lock(mutex);
+    drained.wait(lock, [&] { return queue.empty() && writing == 0; });
+}
+
+void FrameCapture::writerLoop()
+{
+    std::unique_lock lock(mutex);
+    while (true)
+    {
+        // what's queued still gets written when stopping
+        wake.wait(lock, [&] { return stopping || !queue.empty(); });
+        if (queue.empty())
+            return;
+
+        Image image = std::move(queue.front());
+        queue.pop_front();
+        writing++;
+        drained.notify_all();
+
+        lock.unlock();
+        write(image);
+        lock.lock();
+
+        writing--;
+        written++;
+        drained.notify_all();
+    }
+}
+
+void FrameCapture::write(Image &image)
+{
+    std::string extension = image.path.substr(std::min(image.path.rfind('.'), image.path.size()));
+    ivec2 size = image.size;
+
+    if (extension == ".raw")
+    {
+        FILE *f = fopen(image.path.c_str(), "wb");
+        if (!f)
+        {
+            std::cerr << "Frame capture: can't open " << image.path << std::endl;
+            return;
+        }
+        fwrite(image.pixels.data(), 1, image.pixels.size(), f);
+        fclose(f);
+        return;
+    }
+
+    // top row first and no alpha, the backbuffer's is meaningless
+    std::vector<u8> rgb(size.x * size.y * 3);
+    for (i32 y = 0; y < size.y; y++)
+    {
+        const u8 *src = image.pixels.data() + (u64)(size.y - 1 - y) * size.x * 4;
+        u8 *dst = rgb.data() + (u64)y * size.x * 3;
+        for (i32 x = 0; x < size.x; x++)
+        {
+            dst[x * 3 + 0] = src[x * 4 + 0];
+            dst[x * 3 + 1] = src[x * 4 + 1];
+            dst[x * 3 + 2] = src[x * 4 + 2];
+        }
+    }
+
+    if (extension == ".png")
+    {
+        if (!stbi_write_png(image.path.c_str(), size.x, size.y, 3, rgb.data(), size.x * 3))
+            std::cerr << "Frame capture: can't write " << image.path << std::endl;
+    }
+    else if (extension == ".ppm")
+    {
+        FILE *f = fopen(image.path.c_str(), "wb");
+        if (!f)
+        {
+            std::cerr << "Frame capture: can't open " << image.path << std::endl;
+            return;
+        }
+        fprintf(f, "P6\n%d %d\n255\n", size.x, size.y);
+        fwrite(rgb.data(), 1, rgb.size(), f);
+        fclose(f);
+    }
+    else
+    {
+        std::cerr << "Frame capture: unknown format for " << image.path << ", use .png, .ppm or .raw" << std::endl;
+    }
+}
@@ -2,6 +2,8 @@
 #include "glm/gtc/matrix_transform.hpp"
 
 ivec2 EngineGlobals::windowSize = ivec2(800, 600);
+// set by OpenGLInit
+ivec2 EngineGlobals::renderSize = ivec2(0);
 f32 EngineGlobals::fov = 45.0f;
 
 mat4 EngineGlobals::projectionMatrix = mat4(1.0f);
@@ -24,6 +26,3 @@ GLFWwindow *EngineGlobals::window = nullptr;
 CameraPtr EngineGlobals::camera = createCamera();
 
 ScenePtr EngineGlobals::scene = nullptr;
-
-std::vector<float> EngineGlobals::clearVelocitySSBO = std::vector<float>(windowSize.x * windowSize.y * 2, 0.0f);
-u32 EngineGlobals::clearVelocitySSBOID = 0;
\ No newline at end of file
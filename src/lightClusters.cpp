@@ -0,0 +1,92 @@
+#include "lightClusters.hpp"
+#include "globals.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// std140 Lights block of shader/lights.glsl
+struct LightBlock
+{
+    vec3 direction;
+    f32 padding0;
+    vec3 color;
+    f32 intensity;
+    uvec4 clusterGrid;
+    vec4 clusterDepth;
+    vec2 screenSize;
+    i32 lightCount;
+    i32 padding1;
+};
+static_assert(sizeof(LightBlock) == 80, "LightBlock must match the std140 layout of shader/lights.glsl");
+static_assert(sizeof(Light) == 32, "Light must match the std430 layout of shader/lights.glsl");
+} // namespace
+
+LightClusters::LightClusters()
+{
+    buildShader = std::make_shared<ShaderProgram>("shader/lightCluster.comp",
+                                                 std::vector<std::string>{"LIGHT_CLUSTER_BUILD"});
+
+    glCreateBuffers(1, &uboID);
+    glNamedBufferStorage(uboID, sizeof(LightBlock), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glBindBufferBase(GL_UNIFORM_BUFFER, BUFFER_OBJECT_BINDINGS::LIGHTS, uboID);
+
+    // only ever written by the build pass
+    glCreateBuffers(1, &countBufferID);
+    glNamedBufferStorage(countBufferID, CLUSTER_COUNT * sizeof(u32), nullptr, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_OBJECT_BINDINGS::LIGHT_CLUSTER_COUNTS, countBufferID);
+    glCreateBuffers(1, &indexBufferID);
+    glNamedBufferStorage(indexBufferID, CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER * sizeof(u32), nullptr, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_OBJECT_BINDINGS::LIGHT_CLUSTER_INDICES, indexBufferID);
+
+    setLights({}, directionalLight);
+}
+
+LightClusters::~LightClusters()
+{
+    glDeleteBuffers(1, &uboID);
+    glDeleteBuffers(1, &lightBufferID);
+    glDeleteBuffers(1, &countBufferID);
+    glDeleteBuffers(1, &indexBufferID);
+}
+
+void LightClusters::setLights(const std::vector<Light> &lights, const DirectionalLight &_directionalLight)
+{
+    lightCount = lights.size();
+    directionalLight = _directionalLight;
+
+    // an empty buffer can't be bound, keep at least one light worth of storage
+    if (lightBufferID)
+        glDeleteBuffers(1, &lightBufferID);
+    glCreateBuffers(1, &lightBufferID);
+    glNamedBufferStorage(lightBufferID, std::max(lights.size(), (size_t)1) * sizeof(Light),
+                         lights.empty() ? nullptr : lights.data(), 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_OBJECT_BINDINGS::POINT_LIGHTS, lightBufferID);
+}
+
+void LightClusters::update(const mat4 &view, const mat4 &projection)
+{
+    // near and far back out of the perspective matrix, slices are spaced evenly in log depth
+    f32 near = projection[3][2] / (projection[2][2] - 1.0f);
+    f32 far = projection[3][2] / (projection[2][2] + 1.0f);
+    f32 sliceScale = GRID_Z / std::log(far / near);
+    f32 sliceBias = -std::log(near) * sliceScale;
+
+    LightBlock block;
+    block.direction = directionalLight.direction;
+    block.color = directionalLight.color;
+    block.intensity = directionalLight.intensity;
+    block.clusterGrid = uvec4(GRID_X, GRID_Y, GRID_Z, MAX_LIGHTS_PER_CLUSTER);
+    block.clusterDepth = vec4(near, far, sliceScale, sliceBias);
+    block.screenSize = vec2(EngineGlobals::renderSize);
+    block.lightCount = lightCount;
+    glNamedBufferSubData(uboID, 0, sizeof(LightBlock), &block);
+
+    buildShader->use();
+    buildShader->setUniform(0, view);
+    buildShader->setUniform(1, inverse(projection));
+    glDispatchCompute((CLUSTER_COUNT + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
@@ -0,0 +1,11 @@
+#include "lod.hpp"
+#include "globals.hpp"
+
+f32 LODSettings::maxPixelError = 1.0f;
+f32 LODSettings::hysteresis = 0.25f;
+
+f32 LODSettings::pixelsPerUnit()
+{
+    using namespace EngineGlobals;
+    return (f32)renderSize.y / (2.0f * tan(radians(fov) * 0.5f));
+}
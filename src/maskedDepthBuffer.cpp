@@ -0,0 +1,300 @@
+#include "maskedDepthBuffer.hpp"
+
+#include <algorithm>
+
+#include <emmintrin.h>
+
+void MaskedDepthBuffer::resize(u32 _width, u32 _height)
+{
+    tilesX = (_width + TILE_WIDTH - 1) / TILE_WIDTH;
+    tilesY = (_height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    width = tilesX * TILE_WIDTH;
+    height = tilesY * TILE_HEIGHT;
+    tiles.resize(tilesX * tilesY);
+    clear();
+}
+
+void MaskedDepthBuffer::clear()
+{
+    std::fill(tiles.begin(), tiles.end(), Tile{0, 1.0f, 0.0f});
+}
+
+void MaskedDepthBuffer::updateTile(Tile &tile, u32 coverage, f32 z)
+{
+    // behind everything already there
+    if (z >= tile.zMax0)
+        return;
+
+    // the triangle is further in front of the working layer than the working layer is in front of
+    // the tile, restart the layer from the triangle instead of letting it drag its depth along
+    if (tile.mask && tile.zMax1 - z > tile.zMax0 - tile.zMax1)
+    {
+        tile.zMax1 = 0.0f;
+        tile.mask = 0;
+    }
+
+    tile.zMax1 = std::max(tile.zMax1, z);
+    tile.mask |= coverage;
+
+    // full coverage, the working layer becomes the whole tile
+    if (tile.mask == FULL_MASK)
+    {
+        tile.zMax0 = tile.zMax1;
+        tile.zMax1 = 0.0f;
+        tile.mask = 0;
+    }
+}
+
+void MaskedDepthBuffer::rasterizeTriangle(vec3 v0, vec3 v1, vec3 v2, u32 firstTileRow, u32 endTileRow)
+{
+    f32 area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (!(area > 0.0f))
+        return;
+
+    vec2 boxMin = min(min(vec2(v0), vec2(v1)), vec2(v2));
+    vec2 boxMax = max(max(vec2(v0), vec2(v1)), vec2(v2));
+    if (boxMax.x < 0.0f || boxMax.y < 0.0f || boxMin.x >= width || boxMin.y >= height)
+        return;
+
+    // clamped before the casts, vertices close to the camera plane land very far away
+    vec2 screenMax = vec2(width - 1, height - 1);
+    boxMin = clamp(boxMin, vec2(0.0f), screenMax);
+    boxMax = clamp(boxMax, vec2(0.0f), screenMax);
+    i32 tx0 = (i32)boxMin.x / (i32)TILE_WIDTH;
+    i32 tx1 = (i32)boxMax.x / (i32)TILE_WIDTH;
+    i32 ty0 = (i32)boxMin.y / (i32)TILE_HEIGHT;
+    i32 ty1 = (i32)boxMax.y / (i32)TILE_HEIGHT;
+    ty0 = std::max(ty0, (i32)firstTileRow);
+    ty1 = std::min(ty1, (i32)std::min(endTileRow, tilesY) - 1);
+    if (ty0 > ty1)
+        return;
+
+    // depth plane, evaluated at the tile corners for a conservative tile depth
+    f32 triZMax = std::max(std::max(v0.z, v1.z), v2.z);
+    f32 dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    f32 dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+
+    // edge functions, positive inside. Pixel centers exactly on an edge belong to its triangle only
+    // for top and left edges, the two triangles of a quad have to cover the whole of it
+    vec3 verts[3] = {v0, v1, v2};
+    f32 edgeA[3];
+    f32 edgeB[3];
+    f32 edgeC[3];
+    __m128 rampLo[3];
+    __m128 rampHi[3];
+    __m128 topLeft[3];
+    for (u32 e = 0; e < 3; e++)
+    {
+        vec3 a = verts[e];
+        vec3 b = verts[(e + 1) % 3];
+        edgeA[e] = a.y - b.y;
+        edgeB[e] = b.x - a.x;
+        edgeC[e] = a.x * b.y - a.y * b.x;
+        rampLo[e] = _mm_mul_ps(_mm_set1_ps(edgeA[e]), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+        rampHi[e] = _mm_mul_ps(_mm_set1_ps(edgeA[e]), _mm_setr_ps(4.0f, 5.0f, 6.0f, 7.0f));
+        bool isTopLeft = a.y > b.y || (a.y == b.y && b.x < a.x);
+        topLeft[e] = _mm_castsi128_ps(_mm_set1_epi32(isTopLeft ? -1 : 0));
+    }
+    __m128 zero = _mm_setzero_ps();
+    auto inside = [&](__m128 value, u32 e) {
+        return _mm_or_ps(_mm_cmpgt_ps(value, zero), _mm_and_ps(_mm_cmpeq_ps(value, zero), topLeft[e]));
+    };
+
+    for (i32 ty = ty0; ty <= ty1; ty++)
+    {
+        f32 y = ty * TILE_HEIGHT + 0.5f;
+        for (i32 tx = tx0; tx <= tx1; tx++)
+        {
+            f32 x = tx * TILE_WIDTH + 0.5f;
+
+            // 8 pixels of a row at once, in two halves
+            __m128 lo[3];
+            __m128 hi[3];
+            __m128 stepY[3];
+            for (u32 e = 0; e < 3; e++)
+            {
+                __m128 base = _mm_set1_ps(edgeA[e] * x + edgeB[e] * y + edgeC[e]);
+                lo[e] = _mm_add_ps(base, rampLo[e]);
+                hi[e] = _mm_add_ps(base, rampHi[e]);
+                stepY[e] = _mm_set1_ps(edgeB[e]);
+            }
+
+            u32 coverage = 0;
+            for (u32 row = 0; row < TILE_HEIGHT; row++)
+            {
+                __m128 insideLo = _mm_and_ps(_mm_and_ps(inside(lo[0], 0), inside(lo[1], 1)), inside(lo[2], 2));
+                __m128 insideHi = _mm_and_ps(_mm_and_ps(inside(hi[0], 0), inside(hi[1], 1)), inside(hi[2], 2));
+                u32 rowMask = _mm_movemask_ps(insideLo) | (_mm_movemask_ps(insideHi) << 4);
+                coverage |= rowMask << (row * TILE_WIDTH);
+
+                for (u32 e = 0; e < 3; e++)
+                {
+                    lo[e] = _mm_add_ps(lo[e], stepY[e]);
+                    hi[e] = _mm_add_ps(hi[e], stepY[e]);
+                }
+            }
+
+            if (!coverage)
+                continue;
+
+            f32 zx = dzdx * (dzdx > 0.0f ? x + TILE_WIDTH - 1 - v0.x : x - v0.x);
+            f32 zy = dzdy * (dzdy > 0.0f ? y + TILE_HEIGHT - 1 - v0.y : y - v0.y);
+            f32 z = std::min(v0.z + zx + zy, triZMax);
+            updateTile(tiles[tx + ty * tilesX], coverage, z);
+        }
+    }
+}
+
+bool MaskedDepthBuffer::testRect(vec2 rectMin, vec2 rectMax, f32 zMin) const
+{
+    // off screen is for frustum culling to decide
+    if (rectMax.x < 0.0f || rectMax.y < 0.0f || rectMin.x >= width || rectMin.y >= height)
+        return true;
+
+    vec2 screenMax = vec2(width - 1, height - 1);
+    i32 px0 = (i32)clamp(rectMin.x, 0.0f, screenMax.x);
+    i32 px1 = (i32)clamp(rectMax.x, 0.0f, screenMax.x);
+    i32 py0 = (i32)clamp(rectMin.y, 0.0f, screenMax.y);
+    i32 py1 = (i32)clamp(rectMax.y, 0.0f, screenMax.y);
+
+    for (i32 ty = py0 / (i32)TILE_HEIGHT; ty <= py1 / (i32)TILE_HEIGHT; ty++)
+    {
+        for (i32 tx = px0 / (i32)TILE_WIDTH; tx <= px1 / (i32)TILE_WIDTH; tx++)
+        {
+            const Tile &tile = tiles[tx + ty * tilesX];
+
+            // pixels of the rectangle inside this tile, if the working layer has them all its
+            // depth is the tighter bound
+            i32 cx0 = std::max(px0 - tx * (i32)TILE_WIDTH, 0);
+            i32 cx1 = std::min(px1 - tx * (i32)TILE_WIDTH, (i32)TILE_WIDTH - 1);
+            i32 cy0 = std::max(py0 - ty * (i32)TILE_HEIGHT, 0);
+            i32 cy1 = std::min(py1 - ty * (i32)TILE_HEIGHT, (i32)TILE_HEIGHT - 1);
+            u32 rowBits = ((1u << (cx1 - cx0 + 1)) - 1) << cx0;
+            u32 rectMask = 0;
+            for (i32 cy = cy0; cy <= cy1; cy++)
+            {
+                rectMask |= rowBits << (cy * TILE_WIDTH);
+            }
+
+            f32 zMax = (rectMask & ~tile.mask) ? tile.zMax0 : tile.zMax1;
+            if (zMin <= zMax)
+                return true;
+        }
+    }
+    return false;
+}
+
+f32 MaskedDepthBuffer::getPixelDepth(u32 x, u32 y) const
+{
+    const Tile &tile = tiles[x / TILE_WIDTH + (y / TILE_HEIGHT) * tilesX];
+    u32 bit = 1u << (x % TILE_WIDTH + (y % TILE_HEIGHT) * TILE_WIDTH);
+    return (tile.mask & bit) ? tile.zMax1 : tile.zMax0;
+}
+
+void ReferenceDepthBuffer::resize(u32 _width, u32 _height)
+{
+    width = _width;
+    height = _height;
+    depths.resize(width * height);
+    clear();
+}
+
+void ReferenceDepthBuffer::clear()
+{
+    std::fill(depths.begin(), depths.end(), 1.0f);
+}
+
+void ReferenceDepthBuffer::rasterizeTriangle(vec3 v0, vec3 v1, vec3 v2)
+{
+    f32 area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (!(area > 0.0f))
+        return;
+
+    vec2 boxMin = min(min(vec2(v0), vec2(v1)), vec2(v2));
+    vec2 boxMax = max(max(vec2(v0), vec2(v1)), vec2(v2));
+    if (boxMax.x < 0.0f || boxMax.y < 0.0f || boxMin.x >= width || boxMin.y >= height)
+        return;
+
+    vec2 screenMax = vec2(width - 1, height - 1);
+    boxMin = clamp(boxMin, vec2(0.0f), screenMax);
+    boxMax = clamp(boxMax, vec2(0.0f), screenMax);
+
+    f32 triZMax = std::max(std::max(v0.z, v1.z), v2.z);
+    f32 dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    f32 dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+
+    vec3 verts[3] = {v0, v1, v2};
+    for (i32 py = (i32)boxMin.y; py <= (i32)boxMax.y; py++)
+    {
+        for (i32 px = (i32)boxMin.x; px <= (i32)boxMax.x; px++)
+        {
+            // from the first pixel center of the tile, one column step then one row step at a time
+            i32 tx = px / (i32)MaskedDepthBuffer::TILE_WIDTH;
+            i32 ty = py / (i32)MaskedDepthBuffer::TILE_HEIGHT;
+            f32 x = tx * MaskedDepthBuffer::TILE_WIDTH + 0.5f;
+            f32 y = ty * MaskedDepthBuffer::TILE_HEIGHT + 0.5f;
+            i32 column = px - tx * (i32)MaskedDepthBuffer::TILE_WIDTH;
+            i32 row = py - ty * (i32)MaskedDepthBuffer::TILE_HEIGHT;
+
+            bool inside = true;
+            for (u32 e = 0; e < 3 && inside; e++)
+            {
+                vec3 a = verts[e];
+                vec3 b = verts[(e + 1) % 3];
+                f32 edgeA = a.y - b.y;
+                f32 edgeB = b.x - a.x;
+                f32 edgeC = a.x * b.y - a.y * b.x;
+                f32 value = edgeA * x + edgeB * y + edgeC;
+                value = value + edgeA * (f32)column;
+                for (i32 r = 0; r < row; r++)
+                {
+                    value = value + edgeB;
+                }
+                bool isTopLeft = a.y > b.y || (a.y == b.y && b.x < a.x);
+                inside = value > 0.0f || (value == 0.0f && isTopLeft);
+            }
+            if (!inside)
+                continue;
+
+            f32 z = std::min(v0.z + dzdx * (px + 0.5f - v0.x) + dzdy * (py + 0.5f - v0.y), triZMax);
+            f32 &depth = depths[px + py * width];
+            depth = std::min(depth, z);
+        }
+    }
+}
+
+bool ReferenceDepthBuffer::testRect(vec2 rectMin, vec2 rectMax, f32 zMin) const
+{
+    if (rectMax.x < 0.0f || rectMax.y < 0.0f || rectMin.x >= width || rectMin.y >= height)
+        return true;
+
+    vec2 screenMax = vec2(width - 1, height - 1);
+    i32 px0 = (i32)clamp(rectMin.x, 0.0f, screenMax.x);
+    i32 px1 = (i32)clamp(rectMax.x, 0.0f, screenMax.x);
+    i32 py0 = (i32)clamp(rectMin.y, 0.0f, screenMax.y);
+    i32 py1 = (i32)clamp(rectMax.y, 0.0f, screenMax.y);
+
+    for (i32 py = py0; py <= py1; py++)
+    {
+        for (i32 px = px0; px <= px1; px++)
+        {
+            if (zMin <= depths[px + py * width] - DEPTH_EPSILON)
+                return true;
+        }
+    }
+    return false;
+}
+
+u32 ReferenceDepthBuffer::countMismatches(const MaskedDepthBuffer &masked) const
+{
+    u32 count = 0;
+    for (u32 y = 0; y < height; y++)
+    {
+        for (u32 x = 0; x < width; x++)
+        {
+            if (masked.getPixelDepth(x, y) < depths[x + y * width] - DEPTH_EPSILON)
+                count++;
+        }
+    }
+    return count;
+}
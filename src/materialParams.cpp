@@ -0,0 +1,319 @@
+#include "materialParams.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+u32 alignUp(u32 value, u32 alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// std140 base alignment and size
+u32 paramAlignment(MaterialParamType type)
+{
+    switch (type)
+    {
+    case MaterialParamType::FLOAT:
+        return 4;
+    case MaterialParamType::VEC2:
+        return 8;
+    default:
+        return 16;
+    }
+}
+
+u32 paramSize(MaterialParamType type)
+{
+    switch (type)
+    {
+    case MaterialParamType::FLOAT:
+        return 4;
+    case MaterialParamType::VEC2:
+        return 8;
+    case MaterialParamType::VEC3:
+        return 12;
+    default:
+        return 16;
+    }
+}
+
+bool isVec4(MaterialParamType type)
+{
+    return type == MaterialParamType::VEC4 || type == MaterialParamType::COLOR;
+}
+} // namespace
+
+MaterialParamBuffer &getMaterialParamBuffer()
+{
+    static MaterialParamBuffer buffer;
+    return buffer;
+}
+
+MaterialParamBuffer::MaterialParamBuffer()
+{
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    grow(INITIAL_CAPACITY);
+}
+
+MaterialParamBuffer::~MaterialParamBuffer()
+{
+    glDeleteBuffers(1, &bufferID);
+}
+
+void MaterialParamBuffer::grow(u32 minCapacity)
+{
+    u32 newCapacity = std::max(capacity * 2, minCapacity);
+    GLuint newBufferID;
+    glCreateBuffers(1, &newBufferID);
+    glNamedBufferStorage(newBufferID, newCapacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+    // the slices keep their offsets, their values come along
+    if (bufferID)
+    {
+        glCopyNamedBufferSubData(bufferID, newBufferID, 0, 0, top);
+        glDeleteBuffers(1, &bufferID);
+    }
+    bufferID = newBufferID;
+    capacity = newCapacity;
+    boundBufferID = 0;
+}
+
+u32 MaterialParamBuffer::allocate(u32 size)
+{
+    size = alignUp(size, alignment);
+
+    // first fit, the rest of the slice stays where it was so the list keeps its order
+    auto fits = [&](const Slice &slice) { return slice.size >= size; };
+    auto it = std::find_if(freeSlices.begin(), freeSlices.end(), fits);
+    if (it != freeSlices.end())
+    {
+        u32 offset = it->offset;
+        if (it->size > size)
+            *it = {it->offset + size, it->size - size};
+        else
+            freeSlices.erase(it);
+        return offset;
+    }
+
+    if (top + size > capacity)
+        grow(top + size);
+    u32 offset = top;
+    top += size;
+    return offset;
+}
+
+void MaterialParamBuffer::free(u32 offset, u32 size)
+{
+    if (boundBufferID == bufferID && boundOffset == offset)
+        boundBufferID = 0;
+
+    // sorted by offset, a freed slice merges with the free neighbours it touches
+    Slice slice = {offset, alignUp(size, alignment)};
+    auto next = std::lower_bound(freeSlices.begin(), freeSlices.end(), slice,
+                                 [](const Slice &a, const Slice &b) { return a.offset < b.offset; });
+    if (next != freeSlices.end() && slice.offset + slice.size == next->offset)
+    {
+        slice.size += next->size;
+        next = freeSlices.erase(next);
+    }
+    if (next != freeSlices.begin())
+    {
+        auto previous = next - 1;
+        if (previous->offset + previous->size == slice.offset)
+        {
+            slice.offset = previous->offset;
+            slice.size += previous->size;
+            next = freeSlices.erase(previous);
+        }
+    }
+
+    // at the end of the used part, given back to the top
+    if (slice.offset + slice.size == top)
+    {
+        top = slice.offset;
+        return;
+    }
+    freeSlices.insert(next, slice);
+}
+
+void MaterialParamBuffer::upload(u32 offset, const void *data, u32 size)
+{
+    glNamedBufferSubData(bufferID, offset, size, data);
+    uploads++;
+}
+
+void MaterialParamBuffer::bind(u32 offset, u32 size)
+{
+    if (boundBufferID == bufferID && boundOffset == offset)
+        return;
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, BUFFER_OBJECT_BINDINGS::MATERIAL, bufferID, offset, size);
+    boundBufferID = bufferID;
+    boundOffset = offset;
+}
+
+MaterialParams::~MaterialParams()
+{
+    if (sliceSize)
+        getMaterialParamBuffer().free(sliceOffset, sliceSize);
+}
+
+std::unique_ptr<MaterialParams> MaterialParams::makeInstance() const
+{
+    std::unique_ptr<MaterialParams> instance = std::make_unique<MaterialParams>();
+    instance->params = params;
+    instance->data = data;
+    instance->parent = this;
+    instance->parentVersion = version;
+    instance->resize();
+    return instance;
+}
+
+void MaterialParams::resize()
+{
+    const Param *last = params->empty() ? nullptr : &params->back();
+    u32 size = last ? alignUp(last->offset + last->size, 16) : 0;
+
+    data.resize(size, 0);
+    overridden.resize(params->size(), false);
+    if (size > sliceSize)
+    {
+        MaterialParamBuffer &buffer = getMaterialParamBuffer();
+        if (sliceSize)
+            buffer.free(sliceOffset, sliceSize);
+        sliceOffset = buffer.allocate(size);
+        sliceSize = size;
+    }
+    dirty = true;
+}
+
+const MaterialParams::Param *MaterialParams::find(const std::string &name, MaterialParamType type) const
+{
+    for (const Param &param : *params)
+    {
+        if (param.name != name)
+            continue;
+        if (param.type == type || (isVec4(param.type) && isVec4(type)))
+            return &param;
+
+        std::cerr << "Material param " << name << " is declared with another type" << std::endl;
+        return nullptr;
+    }
+
+    std::cerr << "Material param " << name << " isn't declared" << std::endl;
+    return nullptr;
+}
+
+void MaterialParams::write(const std::string &name, MaterialParamType type, const void *value, u32 size)
+{
+    const Param *param = find(name, type);
+    if (!param)
+        return;
+
+    if (data.size() < param->offset + size)
+        resize();
+
+    // once set, the instance's value stops following the material's
+    if (parent)
+        overridden[param - params->data()] = true;
+
+    if (memcmp(data.data() + param->offset, value, size) == 0)
+        return;
+    memcpy(data.data() + param->offset, value, size);
+    dirty = true;
+    version++;
+}
+
+void MaterialParams::declare(const std::string &name, f32 value)
+{
+    declare(name, vec4(value), MaterialParamType::FLOAT);
+}
+
+void MaterialParams::declare(const std::string &name, vec2 value)
+{
+    declare(name, vec4(value, 0.0f, 0.0f), MaterialParamType::VEC2);
+}
+
+void MaterialParams::declare(const std::string &name, vec3 value)
+{
+    declare(name, vec4(value, 0.0f), MaterialParamType::VEC3);
+}
+
+void MaterialParams::declare(const std::string &name, vec4 value, MaterialParamType type)
+{
+    if (parent)
+    {
+        std::cerr << "Material param " << name << " has to be declared by the material, not an instance" << std::endl;
+        return;
+    }
+
+    auto it = std::find_if(params->begin(), params->end(), [&](const Param &param) { return param.name == name; });
+    if (it == params->end())
+    {
+        u32 end = params->empty() ? 0 : params->back().offset + params->back().size;
+        params->push_back({name, type, alignUp(end, paramAlignment(type)), paramSize(type)});
+        resize();
+    }
+    else
+    {
+        std::cerr << "Material param " << name << " declared twice, keeping the first declaration" << std::endl;
+    }
+
+    // the first components of the vec4 are the value whatever the type
+    write(name, type, &value, paramSize(type));
+}
+
+void MaterialParams::set(const std::string &name, f32 value)
+{
+    write(name, MaterialParamType::FLOAT, &value, sizeof(value));
+}
+
+void MaterialParams::set(const std::string &name, vec2 value)
+{
+    write(name, MaterialParamType::VEC2, &value, sizeof(value));
+}
+
+void MaterialParams::set(const std::string &name, vec3 value)
+{
+    write(name, MaterialParamType::VEC3, &value, sizeof(value));
+}
+
+void MaterialParams::set(const std::string &name, vec4 value)
+{
+    write(name, MaterialParamType::VEC4, &value, sizeof(value));
+}
+
+void MaterialParams::bind()
+{
+    if (params->empty())
+        return;
+
+    // declared by the material after this instance was made
+    if (data.size() < params->back().offset + params->back().size)
+        resize();
+
+    // the material changed, the values this instance didn't set follow it
+    if (parent && parentVersion != parent->version)
+    {
+        for (u32 i = 0; i < params->size(); i++)
+        {
+            const Param &param = (*params)[i];
+            if (!overridden[i])
+                memcpy(data.data() + param.offset, parent->data.data() + param.offset, param.size);
+        }
+        parentVersion = parent->version;
+        dirty = true;
+    }
+
+    MaterialParamBuffer &buffer = getMaterialParamBuffer();
+    if (dirty)
+    {
+        buffer.upload(sliceOffset, data.data(), data.size());
+        dirty = false;
+    }
+    buffer.bind(sliceOffset, sliceSize);
+}
@@ -1,6 +1,9 @@
 #include "mesh.hpp"
 #include "AssetManager.hpp"
+#include "MeshManager.hpp"
 #include "assetLoader.hpp"
+#include "meshOptimizer.hpp"
+#include "meshSimplifier.hpp"
 
 #include <algorithm>
 #include <fstream>
@@ -30,46 +33,241 @@ Mesh::~Mesh()
     }
     ebo->deleteBuffer();
     glDeleteVertexArrays(1, &vaoID);
+    getGLState().vertexArrayDeleted(vaoID);
 }
 
 void Mesh::addVBO(VertexBufferObject &vbo)
 {
     vbo.genBuffer();
+    vbo.attach(vaoID);
     vbos.push_back(vbo);
 }
 
 void Mesh::setEBO(EBOptr &_ebo)
 {
     ebo = std::move(_ebo);
+    glVertexArrayElementBuffer(vaoID, ebo->getBufferID());
 }
 
-void Mesh::bind()
+void Mesh::uploadVertices(bool quantizePositions)
 {
-    material->use();
-    glBindVertexArray(vaoID);
-    for (auto &vbo : vbos)
+    packed = PackedVertices(VertexFormat::choose(vertices.size(), quantizePositions), indices, vertices, normals, uvs);
+    uploadIndices();
+
+    std::array<VertexAttribute, 3> attributes = packed.format.getAttributes();
+    std::vector<u8> *streams[] = {&packed.positions, &packed.normals, &packed.uvs};
+    for (GLuint location = 0; location < 3; location++)
     {
-        vbo.bind();
+        if (streams[location]->empty())
+            continue;
+
+        VertexBufferObject vbo(attributes[location], location, (void *)streams[location]->data(), packed.vertexCount);
+        addVBO(vbo);
     }
-    ebo->bind();
+}
+
+void Mesh::uploadIndices()
+{
+    if (ebo)
+        ebo->deleteBuffer();
+
+    EBOptr packedEBO = std::make_unique<ElementBufferObject>((void *)packed.indices.data(), packed.indexCount,
+                                                             packed.format.indexType, packed.format.getIndexSize(),
+                                                             GL_STATIC_DRAW, 0);
+    setEBO(packedEBO);
+}
+
+void Mesh::bind()
+{
+    material->use();
+    if (params)
+        params->bind();
+    getGLState().bindVertexArray(vaoID);
 }
 
 void Mesh::draw()
 {
     bind();
-    ebo->draw();
+    if (clusters.empty())
+        ebo->draw(drawID);
+    else
+        ebo->draw(drawID, 0, getFullIndexCount());
     unbind();
 }
 
 void Mesh::unbind()
 {
+    // the VAO stays bound, GLState skips the rebind if the same mesh is drawn next
     material->stop();
-    ebo->unbind();
-    for (auto &vbo : vbos)
+}
+
+void Mesh::setStatic(bool value)
+{
+    if (value == staticGeometry)
+        return;
+
+    if (value && !StaticGeometry::isCompatible(*this))
+    {
+        std::cerr << "Mesh " << name << " can't be merged with the static geometry, drawing it on its own.\n";
+        return;
+    }
+
+    staticGeometry = value;
+    getMeshManager()->getStaticGeometry().setDirty();
+}
+
+vec4 Mesh::getBoundingSphere()
+{
+    if (boundingSphereValid || vertices.empty())
+        return boundingSphere;
+
+    // not the tightest sphere but cheap: centered on the bounding box
+    vec3 boxMin = vertices[0];
+    vec3 boxMax = vertices[0];
+    for (const vec3 &v : vertices)
+    {
+        boxMin = min(boxMin, v);
+        boxMax = max(boxMax, v);
+    }
+    vec3 center = (boxMin + boxMax) * 0.5f;
+    f32 radius = 0.0f;
+    for (const vec3 &v : vertices)
     {
-        vbo.unbind();
+        radius = max(radius, distance(center, v));
     }
-    glBindVertexArray(0);
+
+    boundingSphere = vec4(center, radius);
+    boundingBoxMin = boxMin;
+    boundingBoxMax = boxMax;
+    boundingSphereValid = true;
+    return boundingSphere;
+}
+
+f32 Mesh::getUVDensity()
+{
+    if (uvDensity >= 0.0f)
+        return uvDensity;
+
+    // sqrt of the uv area over the surface area, both summed over the triangles
+    f32 uvArea = 0.0f, area = 0.0f;
+    if (uvs.size() == vertices.size())
+    {
+        for (const uivec3 &triangle : indices)
+        {
+            vec3 a = vertices[triangle.x], b = vertices[triangle.y], c = vertices[triangle.z];
+            vec2 ua = uvs[triangle.x], ub = uvs[triangle.y], uc = uvs[triangle.z];
+            area += length(cross(b - a, c - a)) * 0.5f;
+            vec2 e1 = ub - ua, e2 = uc - ua;
+            uvArea += std::abs(e1.x * e2.y - e1.y * e2.x) * 0.5f;
+        }
+    }
+    uvDensity = area > 0.0f ? std::sqrt(uvArea / area) : 0.0f;
+    return uvDensity;
+}
+
+void Mesh::requestTextureMips(const mat4 &view, const mat4 &objMat)
+{
+    f32 density = getUVDensity();
+    if (density <= 0.0f || material->getTextureCount() == 0)
+        return;
+
+    f32 scale = max(length(vec3(objMat[0])), max(length(vec3(objMat[1])), length(vec3(objMat[2]))));
+    if (scale <= 0.0f)
+        return;
+
+    // the nearest point of the bounding sphere is the one needing the finest level
+    f32 distance = max(getViewDepth(view, objMat) - getBoundingSphere().w * scale, 0.1f);
+    f32 uvPerPixel = density / scale * distance / LODSettings::pixelsPerUnit();
+    material->requestTextureMips(uvPerPixel);
+}
+
+void Mesh::generateLODs(u32 count, f32 ratio, bool clustered)
+{
+    if (indices.empty() || packed.indexCount == 0)
+        return;
+
+    std::vector<bool> locked;
+    std::vector<std::vector<uivec3>> pieces;
+    if (clustered)
+        pieces = splitIntoClusters(indices, vertices, locked);
+    else
+        pieces = {indices};
+
+    clusters.clear();
+    lodIndices.clear();
+    for (const std::vector<uivec3> &piece : pieces)
+    {
+        // same kind of sphere as getBoundingSphere, around the box of the cluster
+        vec3 boxMin = vertices[piece[0].x];
+        vec3 boxMax = boxMin;
+        for (const uivec3 &tri : piece)
+        {
+            for (u32 i = 0; i < 3; i++)
+            {
+                boxMin = min(boxMin, vertices[tri[i]]);
+                boxMax = max(boxMax, vertices[tri[i]]);
+            }
+        }
+        vec3 center = (boxMin + boxMax) * 0.5f;
+        f32 radius = 0.0f;
+        for (const uivec3 &tri : piece)
+        {
+            for (u32 i = 0; i < 3; i++)
+            {
+                radius = max(radius, distance(center, vertices[tri[i]]));
+            }
+        }
+
+        MeshCluster cluster;
+        cluster.sphere = vec4(center, radius);
+        cluster.lods = {{(u32)lodIndices.size() * 3, (u32)piece.size() * 3, 0.0f}};
+        clusters.push_back(cluster);
+        lodIndices.insert(lodIndices.end(), piece.begin(), piece.end());
+    }
+
+    // every level starts over from the full cluster so the errors are measured against it
+    for (u32 c = 0; c < clusters.size(); c++)
+    {
+        MeshCluster &cluster = clusters[c];
+        f32 error = 0.0f;
+        u32 target = pieces[c].size();
+        for (u32 i = 0; i < count; i++)
+        {
+            target = (u32)(target * ratio);
+            f32 levelError = 0.0f;
+            std::vector<uivec3> simplified =
+                simplifyMesh(pieces[c], vertices, normals, uvs, target, levelError, locked);
+            if (simplified.empty() || simplified.size() * 3 >= cluster.lods.back().indexCount)
+                break;
+
+            error = max(error, levelError);
+            optimizeVertexCache(simplified, vertices.size());
+            cluster.lods.push_back({(u32)lodIndices.size() * 3, (u32)simplified.size() * 3, error});
+            lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+        }
+    }
+
+    packed.setIndices(lodIndices);
+    uploadIndices();
+
+    if (staticGeometry)
+        getMeshManager()->getStaticGeometry().setDirty();
+}
+
+u32 Mesh::selectLOD(const mat4 &objMat, u32 c)
+{
+    MeshCluster &cluster = clusters[c];
+
+    // distance to the cluster sphere surface, the error scales with the object
+    vec3 center = vec3(objMat * vec4(vec3(cluster.sphere), 1.0f));
+    f32 scale = max(max(length(vec3(objMat[0])), length(vec3(objMat[1]))), length(vec3(objMat[2])));
+    vec3 cameraPosition = EngineGlobals::camera->getTransform().getPosition();
+    scale = max(scale, 1e-6f);
+    f32 d = (distance(center, cameraPosition) - cluster.sphere.w * scale) / scale;
+
+    cluster.currentLOD = LODSettings::select(cluster.lods.size(), cluster.currentLOD, d,
+                                             [&cluster](u32 i) { return cluster.lods[i].error; });
+    return cluster.currentLOD;
 }
 
 MeshPtr Mesh::addTexture(TexturePtr &texture)
@@ -84,38 +282,39 @@ MeshPtr Mesh::addTexture(std::string filename)
     return shared_from_this();
 }
 
-template <typename T, std::enable_if_t<std::is_same<T, mat4>::value || std::is_same<T, vec3>::value ||
-                                           std::is_same<T, vec4>::value || std::is_same<T, f32>::value ||
-                                           std::is_same<T, i32>::value || std::is_same<T, u32>::value,
-                                       bool>>
-MeshPtr Mesh::setUniform(u32 location, const T &value)
+MaterialParams &Mesh::getInstanceParams()
+{
+    if (!params)
+    {
+        params = material->getParams().makeInstance();
+        // the static batches are split by parameter block, this mesh gets a bucket of its own
+        if (staticGeometry)
+            getMeshManager()->getStaticGeometry().setDirty();
+    }
+    return *params;
+}
+
+MeshPtr Mesh::setParam(const std::string &name, f32 value)
 {
-    material->getShader()->setUniform(location, value);
+    getInstanceParams().set(name, value);
     return shared_from_this();
 }
 
-template <typename T, std::enable_if_t<std::is_same<T, f64>::value, bool>>
-MeshPtr Mesh::setUniform(u32 location, const T &value)
+MeshPtr Mesh::setParam(const std::string &name, vec2 value)
 {
-    material->getShader()->setUniform(location, (f32)value);
+    getInstanceParams().set(name, value);
     return shared_from_this();
 }
 
-template <
-    typename T,
-    std::enable_if_t<std::is_same<T, i64>::value || std::is_same<T, i16>::value || std::is_same<T, i8>::value, bool>>
-MeshPtr Mesh::setUniform(u32 location, const T &value)
+MeshPtr Mesh::setParam(const std::string &name, vec3 value)
 {
-    material->getShader()->setUniform(location, (i32)value);
+    getInstanceParams().set(name, value);
     return shared_from_this();
 }
 
-template <
-    typename T,
-    std::enable_if_t<std::is_same<T, u64>::value || std::is_same<T, u16>::value || std::is_same<T, u8>::value, bool>>
-MeshPtr Mesh::setUniform(u32 location, const T &value)
+MeshPtr Mesh::setParam(const std::string &name, vec4 value)
 {
-    material->getShader()->setUniform(location, (u32)value);
+    getInstanceParams().set(name, value);
     return shared_from_this();
 }
 
@@ -178,16 +377,3 @@ bool Mesh::meshIntersect(Ray r, vec3 &intersectionPoint, vec3 &normal) const
     return false;
 }
 
-template MeshPtr Mesh::setUniform(u32 location, const mat4 &value);
-template MeshPtr Mesh::setUniform(u32 location, const vec3 &value);
-template MeshPtr Mesh::setUniform(u32 location, const vec4 &value);
-template MeshPtr Mesh::setUniform(u32 location, const f32 &value);
-template MeshPtr Mesh::setUniform(u32 location, const f64 &value);
-template MeshPtr Mesh::setUniform(u32 location, const i64 &value);
-template MeshPtr Mesh::setUniform(u32 location, const i32 &value);
-template MeshPtr Mesh::setUniform(u32 location, const i16 &value);
-template MeshPtr Mesh::setUniform(u32 location, const i8 &value);
-template MeshPtr Mesh::setUniform(u32 location, const u64 &value);
-template MeshPtr Mesh::setUniform(u32 location, const u32 &value);
-template MeshPtr Mesh::setUniform(u32 location, const u16 &value);
-template MeshPtr Mesh::setUniform(u32 location, const u8 &value);
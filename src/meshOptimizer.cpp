@@ -0,0 +1,325 @@
+#include "meshOptimizer.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+// FIFO cache simulation. A vertex is cached while fewer than cacheSize misses happened since
+// its own miss, starting a new run just skips the clock ahead
+class FIFOCache
+{
+  private:
+    std::vector<i64> missTime;
+    i64 misses = 0;
+    u32 size;
+
+  public:
+    FIFOCache(u32 vertexCount, u32 cacheSize) : missTime(vertexCount, -(i64)cacheSize - 1), size(cacheSize)
+    {
+    }
+
+    // misses of the triangle
+    u32 access(const uivec3 &tri)
+    {
+        u32 triangleMisses = 0;
+        for (u32 i = 0; i < 3; i++)
+        {
+            if (misses - missTime[tri[i]] > size)
+            {
+                missTime[tri[i]] = misses++;
+                triangleMisses++;
+            }
+        }
+        return triangleMisses;
+    }
+
+    void flush()
+    {
+        misses += size + 1;
+    }
+};
+} // namespace
+
+VertexCacheStats analyzeVertexCache(const std::vector<uivec3> &indices, u32 vertexCount, u32 cacheSize)
+{
+    if (indices.empty())
+        return {0.0f, 0.0f};
+
+    FIFOCache cache(vertexCount, cacheSize);
+    std::vector<bool> used(vertexCount, false);
+    u32 misses = 0;
+    u32 usedCount = 0;
+    for (const uivec3 &tri : indices)
+    {
+        misses += cache.access(tri);
+        for (u32 i = 0; i < 3; i++)
+        {
+            if (!used[tri[i]])
+            {
+                used[tri[i]] = true;
+                usedCount++;
+            }
+        }
+    }
+
+    return {(f32)misses / indices.size(), (f32)misses / usedCount};
+}
+
+void optimizeVertexCache(std::vector<uivec3> &indices, u32 vertexCount, std::vector<u32> *clusters, u32 cacheSize)
+{
+    u32 triangleCount = indices.size();
+    if (clusters)
+        clusters->clear();
+    if (!triangleCount)
+        return;
+
+    // triangles around each vertex, packed
+    std::vector<u32> live(vertexCount, 0);
+    for (const uivec3 &tri : indices)
+    {
+        live[tri.x]++;
+        live[tri.y]++;
+        live[tri.z]++;
+    }
+    std::vector<u32> offsets(vertexCount + 1, 0);
+    for (u32 v = 0; v < vertexCount; v++)
+    {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<u32> adjacency(offsets[vertexCount]);
+    std::vector<u32> fill(offsets.begin(), offsets.end() - 1);
+    for (u32 t = 0; t < triangleCount; t++)
+    {
+        for (u32 i = 0; i < 3; i++)
+        {
+            adjacency[fill[indices[t][i]]++] = t;
+        }
+    }
+
+    std::vector<u32> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<u32> deadEnds;
+    std::vector<u32> candidates;
+    std::vector<uivec3> result;
+    result.reserve(triangleCount);
+
+    u32 timestamp = cacheSize + 1;
+    u32 cursor = 0;
+    i64 fan = 0;
+    while (live[fan] == 0 && fan + 1 < vertexCount)
+        fan++;
+
+    if (clusters)
+        clusters->push_back(0);
+
+    while (fan >= 0)
+    {
+        // emit every triangle left around the fanning vertex
+        candidates.clear();
+        for (u32 a = offsets[fan]; a < offsets[fan + 1]; a++)
+        {
+            u32 t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            emitted[t] = true;
+            result.push_back(indices[t]);
+            for (u32 i = 0; i < 3; i++)
+            {
+                u32 v = indices[t][i];
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (timestamp - cacheTime[v] > cacheSize)
+                    cacheTime[v] = timestamp++;
+            }
+        }
+
+        // next fan: the candidate that stays in the cache the longest once its triangles are out
+        fan = -1;
+        i32 bestPriority = -1;
+        for (u32 v : candidates)
+        {
+            if (!live[v])
+                continue;
+
+            i32 priority = 0;
+            if (timestamp - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = timestamp - cacheTime[v];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fan = v;
+            }
+        }
+
+        if (fan >= 0)
+            continue;
+
+        // dead end, go back to a recent vertex or else the next one with triangles left
+        while (!deadEnds.empty() && fan < 0)
+        {
+            u32 v = deadEnds.back();
+            deadEnds.pop_back();
+            if (live[v])
+                fan = v;
+        }
+        while (fan < 0 && cursor < vertexCount)
+        {
+            if (live[cursor])
+                fan = cursor;
+            cursor++;
+        }
+
+        if (fan >= 0 && clusters)
+            clusters->push_back(result.size());
+    }
+
+    indices = std::move(result);
+}
+
+void optimizeOverdraw(std::vector<uivec3> &indices, const std::vector<vec3> &positions,
+                      const std::vector<u32> &clusters, f32 threshold, u32 cacheSize)
+{
+    u32 triangleCount = indices.size();
+    if (!triangleCount)
+        return;
+
+    // split the hard clusters where their running ACMR gets close enough to the cluster one
+    FIFOCache cache(positions.size(), cacheSize);
+    std::vector<u32> splits;
+    for (u32 c = 0; c < clusters.size(); c++)
+    {
+        u32 start = clusters[c];
+        u32 end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        if (start >= end)
+            continue;
+
+        cache.flush();
+        u32 clusterMisses = 0;
+        for (u32 t = start; t < end; t++)
+        {
+            clusterMisses += cache.access(indices[t]);
+        }
+        f32 clusterACMR = (f32)clusterMisses / (end - start);
+
+        cache.flush();
+        splits.push_back(start);
+        u32 runStart = start;
+        u32 runMisses = 0;
+        for (u32 t = start; t < end; t++)
+        {
+            runMisses += cache.access(indices[t]);
+            if (t + 1 < end && (f32)runMisses / (t + 1 - runStart) <= clusterACMR * threshold)
+            {
+                splits.push_back(t + 1);
+                runStart = t + 1;
+                runMisses = 0;
+                cache.flush();
+            }
+        }
+    }
+    splits.push_back(triangleCount);
+
+    // area weighted centroid and normal of every cluster
+    vec3 meshCentroid(0.0f);
+    f32 meshArea = 0.0f;
+    std::vector<vec3> centroids(splits.size() - 1, vec3(0.0f));
+    std::vector<vec3> normals(splits.size() - 1, vec3(0.0f));
+    for (u32 c = 0; c + 1 < splits.size(); c++)
+    {
+        f32 clusterArea = 0.0f;
+        for (u32 t = splits[c]; t < splits[c + 1]; t++)
+        {
+            vec3 p0 = positions[indices[t].x];
+            vec3 p1 = positions[indices[t].y];
+            vec3 p2 = positions[indices[t].z];
+            vec3 n = cross(p1 - p0, p2 - p0);
+            f32 area = length(n);
+            centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            normals[c] += n;
+            clusterArea += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += clusterArea;
+        if (clusterArea > 0.0f)
+            centroids[c] /= clusterArea;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    std::vector<f32> sortKeys(splits.size() - 1);
+    std::vector<u32> order(splits.size() - 1);
+    for (u32 c = 0; c < order.size(); c++)
+    {
+        f32 normalLength = length(normals[c]);
+        sortKeys[c] = normalLength > 0.0f ? dot(centroids[c] - meshCentroid, normals[c] / normalLength) : 0.0f;
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uivec3> result;
+    result.reserve(triangleCount);
+    for (u32 c : order)
+    {
+        result.insert(result.end(), indices.begin() + splits[c], indices.begin() + splits[c + 1]);
+    }
+    indices = std::move(result);
+}
+
+void optimizeVertexFetch(std::vector<uivec3> &indices, std::vector<vec3> &vertices, std::vector<vec3> &normals,
+                         std::vector<vec2> &uvs)
+{
+    u32 vertexCount = vertices.size();
+    std::vector<u32> remap(vertexCount, ~0u);
+    u32 next = 0;
+    for (uivec3 &tri : indices)
+    {
+        for (u32 i = 0; i < 3; i++)
+        {
+            if (remap[tri[i]] == ~0u)
+                remap[tri[i]] = next++;
+            tri[i] = remap[tri[i]];
+        }
+    }
+
+    auto reorder = [&](auto &attribute) {
+        if (attribute.size() != vertexCount)
+            return;
+
+        std::remove_reference_t<decltype(attribute)> result(next);
+        for (u32 v = 0; v < vertexCount; v++)
+        {
+            if (remap[v] != ~0u)
+                result[remap[v]] = attribute[v];
+        }
+        attribute = std::move(result);
+    };
+    reorder(normals);
+    reorder(uvs);
+    reorder(vertices);
+}
+
+void optimizeMesh(const std::string &name, std::vector<uivec3> &indices, std::vector<vec3> &vertices,
+                  std::vector<vec3> &normals, std::vector<vec2> &uvs)
+{
+    if (indices.empty())
+        return;
+
+    VertexCacheStats before = analyzeVertexCache(indices, vertices.size());
+
+    std::vector<u32> clusters;
+    optimizeVertexCache(indices, vertices.size(), &clusters);
+    optimizeOverdraw(indices, vertices, clusters);
+    optimizeVertexFetch(indices, vertices, normals, uvs);
+
+    VertexCacheStats after = analyzeVertexCache(indices, vertices.size());
+
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(3) << name << ": ACMR " << before.acmr << " -> " << after.acmr
+           << ", ATVR " << before.atvr << " -> " << after.atvr << "\n";
+    std::cout << report.str();
+}
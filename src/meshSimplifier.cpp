@@ -0,0 +1,489 @@
+#include "meshSimplifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+namespace
+{
+// normals are unit vectors and uvs mostly in [0, 1], their squared differences get weighted by the
+// area around the vertex like the geometric error
+constexpr f64 NORMAL_WEIGHT = 0.5;
+constexpr f64 UV_WEIGHT = 1.0;
+// open borders are held in place by planes perpendicular to their faces
+constexpr f64 BORDER_WEIGHT = 10.0;
+// collapses turning a face by more than ~80 degrees fold the surface over itself
+constexpr f64 MIN_NORMAL_DOT = 0.2;
+
+// symmetric 4x4 matrix, only the upper triangle is stored
+struct Quadric
+{
+    f64 a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    f64 a11 = 0, a12 = 0, a13 = 0;
+    f64 a22 = 0, a23 = 0;
+    f64 a33 = 0;
+    f64 weight = 0;
+
+    void addPlane(dvec3 n, f64 d, f64 w)
+    {
+        a00 += w * n.x * n.x;
+        a01 += w * n.x * n.y;
+        a02 += w * n.x * n.z;
+        a03 += w * n.x * d;
+        a11 += w * n.y * n.y;
+        a12 += w * n.y * n.z;
+        a13 += w * n.y * d;
+        a22 += w * n.z * n.z;
+        a23 += w * n.z * d;
+        a33 += w * d * d;
+        weight += w;
+    }
+
+    Quadric operator+(const Quadric &o) const
+    {
+        return {a00 + o.a00, a01 + o.a01, a02 + o.a02, a03 + o.a03, a11 + o.a11, a12 + o.a12,
+                a13 + o.a13, a22 + o.a22, a23 + o.a23, a33 + o.a33, weight + o.weight};
+    }
+
+    // weighted sum of the squared distances of p to the planes
+    f64 evaluate(dvec3 p) const
+    {
+        f64 e = a00 * p.x * p.x + 2 * a01 * p.x * p.y + 2 * a02 * p.x * p.z + 2 * a03 * p.x + a11 * p.y * p.y +
+                2 * a12 * p.y * p.z + 2 * a13 * p.y + a22 * p.z * p.z + 2 * a23 * p.z + a33;
+        return max(e, 0.0);
+    }
+};
+
+template <size_t N> struct KeyHash
+{
+    size_t operator()(const std::array<u32, N> &key) const
+    {
+        // FNV-1a over the float bit patterns
+        size_t h = 14695981039346656037ull;
+        for (u32 v : key)
+        {
+            h = (h ^ v) * 1099511628211ull;
+        }
+        return h;
+    }
+};
+
+template <size_t N> std::array<u32, N> makeKey(const f32 *values)
+{
+    std::array<u32, N> key;
+    memcpy(key.data(), values, N * sizeof(f32));
+    return key;
+}
+
+struct Collapse
+{
+    f64 cost;
+    f64 error;
+    u32 from;
+    u32 to;
+    u32 fromVersion;
+    u32 toVersion;
+
+    bool operator>(const Collapse &o) const
+    {
+        return cost > o.cost;
+    }
+};
+
+class Simplifier
+{
+  private:
+    const std::vector<vec3> &vertices;
+    const std::vector<vec3> &normals;
+    const std::vector<vec2> &uvs;
+
+    // wedges are the distinct vertices, points the distinct positions
+    std::vector<u32> pointOf;
+    std::vector<dvec3> points;
+    std::vector<std::vector<u32>> pointWedges;
+    std::vector<std::vector<u32>> pointTriangles;
+    std::vector<Quadric> quadrics;
+    std::vector<u32> versions;
+    std::vector<bool> removed;
+    std::vector<bool> locked;
+
+    std::vector<uvec3> triangles;
+    std::vector<bool> dead;
+    u32 liveTriangles = 0;
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+    f64 attributeDistance(u32 a, u32 b) const
+    {
+        f64 d = 0.0;
+        if (!normals.empty())
+        {
+            vec3 n = normals[a] - normals[b];
+            d += NORMAL_WEIGHT * dot(n, n);
+        }
+        if (!uvs.empty())
+        {
+            vec2 uv = uvs[a] - uvs[b];
+            d += UV_WEIGHT * dot(uv, uv);
+        }
+        return d;
+    }
+
+    // wedge of the target point the wedge w is merged into
+    u32 closestWedge(u32 w, u32 target) const
+    {
+        u32 best = pointWedges[target][0];
+        f64 bestDistance = attributeDistance(w, best);
+        for (u32 candidate : pointWedges[target])
+        {
+            f64 d = attributeDistance(w, candidate);
+            if (d < bestDistance)
+            {
+                best = candidate;
+                bestDistance = d;
+            }
+        }
+        return best;
+    }
+
+    Collapse evaluate(u32 from, u32 to) const
+    {
+        Quadric q = quadrics[from] + quadrics[to];
+        f64 geometric = q.evaluate(points[to]);
+
+        f64 attributes = 0.0;
+        for (u32 w : pointWedges[from])
+        {
+            attributes += attributeDistance(w, closestWedge(w, to));
+        }
+        attributes *= quadrics[from].weight;
+
+        f64 error = q.weight > 0.0 ? sqrt(geometric / q.weight) : 0.0;
+        return {geometric + attributes, error, from, to, versions[from], versions[to]};
+    }
+
+    // a locked point can take a neighbour in but never goes anywhere itself
+    void pushEdge(u32 a, u32 b)
+    {
+        if (locked[a] && locked[b])
+            return;
+        if (locked[a] || locked[b])
+        {
+            queue.push(locked[a] ? evaluate(b, a) : evaluate(a, b));
+            return;
+        }
+
+        Collapse ab = evaluate(a, b);
+        Collapse ba = evaluate(b, a);
+        queue.push(ab.cost <= ba.cost ? ab : ba);
+    }
+
+    dvec3 faceNormal(const uvec3 &t, u32 from, u32 to) const
+    {
+        dvec3 p[3];
+        for (u32 i = 0; i < 3; i++)
+        {
+            u32 point = pointOf[t[i]];
+            p[i] = points[point == from ? to : point];
+        }
+        return cross(p[1] - p[0], p[2] - p[0]);
+    }
+
+    bool flips(u32 from, u32 to) const
+    {
+        for (u32 t : pointTriangles[from])
+        {
+            const uvec3 &tri = triangles[t];
+            if (dead[t] || pointOf[tri.x] == to || pointOf[tri.y] == to || pointOf[tri.z] == to)
+                continue;
+
+            dvec3 before = faceNormal(tri, from, from);
+            dvec3 after = faceNormal(tri, from, to);
+            f64 lengths = length(before) * length(after);
+            if (lengths <= 0.0 || dot(before, after) < MIN_NORMAL_DOT * lengths)
+                return true;
+        }
+        return false;
+    }
+
+    void collapse(u32 from, u32 to)
+    {
+        std::vector<std::pair<u32, u32>> wedgeMap;
+        for (u32 w : pointWedges[from])
+        {
+            wedgeMap.push_back({w, closestWedge(w, to)});
+        }
+
+        for (u32 t : pointTriangles[from])
+        {
+            if (dead[t])
+                continue;
+
+            uvec3 &tri = triangles[t];
+            if (pointOf[tri.x] == to || pointOf[tri.y] == to || pointOf[tri.z] == to)
+            {
+                // the collapsed edge was one of its sides
+                dead[t] = true;
+                liveTriangles--;
+                continue;
+            }
+
+            for (u32 i = 0; i < 3; i++)
+            {
+                for (auto &[w, target] : wedgeMap)
+                {
+                    if (tri[i] == w)
+                        tri[i] = target;
+                }
+            }
+            pointTriangles[to].push_back(t);
+        }
+
+        quadrics[to] = quadrics[from] + quadrics[to];
+        removed[from] = true;
+        pointTriangles[from].clear();
+        versions[to]++;
+
+        // drop the dead triangles and requeue the edges around the merged point
+        std::vector<u32> &around = pointTriangles[to];
+        std::erase_if(around, [&](u32 t) { return dead[t]; });
+        std::vector<u32> neighbours;
+        for (u32 t : around)
+        {
+            for (u32 i = 0; i < 3; i++)
+            {
+                u32 point = pointOf[triangles[t][i]];
+                if (point != to && std::find(neighbours.begin(), neighbours.end(), point) == neighbours.end())
+                    neighbours.push_back(point);
+            }
+        }
+        for (u32 n : neighbours)
+        {
+            pushEdge(to, n);
+        }
+    }
+
+  public:
+    Simplifier(const std::vector<uivec3> &indices, const std::vector<vec3> &_vertices,
+               const std::vector<vec3> &_normals, const std::vector<vec2> &_uvs,
+               const std::vector<bool> &lockedVertices)
+        : vertices(_vertices), normals(_normals.size() == _vertices.size() ? _normals : empty3),
+          uvs(_uvs.size() == _vertices.size() ? _uvs : empty2)
+    {
+        // identical vertices become a single wedge, identical positions a single point. Meshes
+        // are often loaded as triangle soup, without this there would be no edge to collapse
+        std::unordered_map<std::array<u32, 8>, u32, KeyHash<8>> wedgeIDs;
+        std::unordered_map<std::array<u32, 3>, u32, KeyHash<3>> pointIDs;
+        std::vector<u32> wedgeOf(vertices.size());
+        pointOf.assign(vertices.size(), 0);
+        for (u32 v = 0; v < vertices.size(); v++)
+        {
+            f32 attributes[8] = {vertices[v].x, vertices[v].y, vertices[v].z};
+            if (!normals.empty())
+                memcpy(attributes + 3, &normals[v], sizeof(vec3));
+            if (!uvs.empty())
+                memcpy(attributes + 6, &uvs[v], sizeof(vec2));
+
+            auto [wedge, newWedge] = wedgeIDs.try_emplace(makeKey<8>(attributes), v);
+            wedgeOf[v] = wedge->second;
+
+            auto [point, newPoint] = pointIDs.try_emplace(makeKey<3>(attributes), (u32)points.size());
+            if (newPoint)
+            {
+                points.push_back(dvec3(vertices[v]));
+                pointWedges.emplace_back();
+            }
+            pointOf[v] = point->second;
+            if (newWedge)
+                pointWedges[point->second].push_back(v);
+        }
+
+        pointTriangles.resize(points.size());
+        quadrics.resize(points.size());
+        versions.assign(points.size(), 0);
+        removed.assign(points.size(), false);
+        locked.assign(points.size(), false);
+        if (lockedVertices.size() == vertices.size())
+        {
+            for (u32 v = 0; v < vertices.size(); v++)
+            {
+                if (lockedVertices[v])
+                    locked[pointOf[v]] = true;
+            }
+        }
+
+        std::unordered_map<u64, std::pair<u32, u32>> edges; // point pair -> uses, last triangle
+        for (const uivec3 &index : indices)
+        {
+            uvec3 tri(wedgeOf[index.x], wedgeOf[index.y], wedgeOf[index.z]);
+            uvec3 p(pointOf[tri.x], pointOf[tri.y], pointOf[tri.z]);
+            if (p.x == p.y || p.y == p.z || p.z == p.x)
+                continue;
+
+            u32 t = triangles.size();
+            triangles.push_back(tri);
+
+            dvec3 n = cross(points[p.y] - points[p.x], points[p.z] - points[p.x]);
+            f64 area = length(n) * 0.5;
+            if (area > 0.0)
+            {
+                n = normalize(n);
+                for (u32 i = 0; i < 3; i++)
+                {
+                    quadrics[p[i]].addPlane(n, -dot(n, points[p.x]), area);
+                }
+            }
+
+            for (u32 i = 0; i < 3; i++)
+            {
+                pointTriangles[p[i]].push_back(t);
+                u32 a = min(p[i], p[(i + 1) % 3]);
+                u32 b = max(p[i], p[(i + 1) % 3]);
+                auto &edge = edges[(u64)a << 32 | b];
+                edge.first++;
+                edge.second = t;
+            }
+        }
+        dead.assign(triangles.size(), false);
+        liveTriangles = triangles.size();
+
+        for (auto &[key, edge] : edges)
+        {
+            u32 a = key >> 32;
+            u32 b = key & 0xFFFFFFFF;
+            if (edge.first == 1)
+            {
+                const uvec3 &tri = triangles[edge.second];
+                dvec3 faceN = cross(points[pointOf[tri.y]] - points[pointOf[tri.x]],
+                                    points[pointOf[tri.z]] - points[pointOf[tri.x]]);
+                dvec3 side = points[b] - points[a];
+                dvec3 n = cross(side, faceN);
+                if (length(n) > 0.0)
+                {
+                    n = normalize(n);
+                    f64 w = BORDER_WEIGHT * dot(side, side);
+                    quadrics[a].addPlane(n, -dot(n, points[a]), w);
+                    quadrics[b].addPlane(n, -dot(n, points[a]), w);
+                }
+            }
+        }
+
+        for (auto &[key, edge] : edges)
+        {
+            pushEdge(key >> 32, key & 0xFFFFFFFF);
+        }
+    }
+
+    std::vector<uivec3> run(u32 targetTriangles, f32 &error)
+    {
+        f64 maxError = 0.0;
+        while (liveTriangles > targetTriangles && !queue.empty())
+        {
+            Collapse c = queue.top();
+            queue.pop();
+
+            if (removed[c.from] || removed[c.to] || versions[c.from] != c.fromVersion ||
+                versions[c.to] != c.toVersion)
+                continue;
+
+            if (flips(c.from, c.to))
+                continue;
+
+            collapse(c.from, c.to);
+            maxError = max(maxError, c.error);
+        }
+        error = maxError;
+
+        std::vector<uivec3> result;
+        result.reserve(liveTriangles);
+        for (u32 t = 0; t < triangles.size(); t++)
+        {
+            if (!dead[t])
+                result.push_back(triangles[t]);
+        }
+        return result;
+    }
+
+    static inline const std::vector<vec3> empty3;
+    static inline const std::vector<vec2> empty2;
+};
+} // namespace
+
+std::vector<uivec3> simplifyMesh(const std::vector<uivec3> &indices, const std::vector<vec3> &vertices,
+                                 const std::vector<vec3> &normals, const std::vector<vec2> &uvs, u32 targetTriangles,
+                                 f32 &error, const std::vector<bool> &lockedVertices)
+{
+    Simplifier simplifier(indices, vertices, normals, uvs, lockedVertices);
+    return simplifier.run(targetTriangles, error);
+}
+
+std::vector<std::vector<uivec3>> splitIntoClusters(const std::vector<uivec3> &indices,
+                                                   const std::vector<vec3> &vertices,
+                                                   std::vector<bool> &lockedVertices)
+{
+    lockedVertices.assign(vertices.size(), false);
+    if (indices.empty())
+        return {};
+
+    vec3 boxMin(std::numeric_limits<f32>::max());
+    vec3 boxMax(-std::numeric_limits<f32>::max());
+    for (const uivec3 &tri : indices)
+    {
+        for (u32 i = 0; i < 3; i++)
+        {
+            boxMin = min(boxMin, vertices[tri[i]]);
+            boxMax = max(boxMax, vertices[tri[i]]);
+        }
+    }
+
+    // cubic-ish cells, the grid shrinks along its longest axis until the cells get enough triangles
+    vec3 extent = boxMax - boxMin;
+    f32 longest = max(max(extent.x, extent.y), extent.z);
+    if (longest <= 0.0f)
+        return {indices};
+
+    uvec3 grid;
+    for (u32 a = 0; a < 3; a++)
+    {
+        grid[a] = clamp((u32)std::round(extent[a] / longest * CLUSTER_GRID), 1u, CLUSTER_GRID);
+    }
+    while (grid.x * grid.y * grid.z * MIN_CLUSTER_TRIANGLES > indices.size() && grid.x * grid.y * grid.z > 1)
+    {
+        u32 a = grid.x >= grid.y && grid.x >= grid.z ? 0 : (grid.y >= grid.z ? 1 : 2);
+        grid[a]--;
+    }
+
+    std::vector<std::vector<uivec3>> cells(grid.x * grid.y * grid.z);
+    vec3 cellSize = max(extent / vec3(grid), vec3(1e-6f));
+    for (const uivec3 &tri : indices)
+    {
+        vec3 center = (vertices[tri.x] + vertices[tri.y] + vertices[tri.z]) / 3.0f;
+        uvec3 cell = min(uvec3(max((center - boxMin) / cellSize, vec3(0.0f))), grid - 1u);
+        cells[cell.x + (cell.y + cell.z * grid.y) * grid.x].push_back(tri);
+    }
+    std::erase_if(cells, [](const std::vector<uivec3> &cell) { return cell.empty(); });
+
+    // the first cluster using a position, or ~0u once a second one does too
+    std::unordered_map<std::array<u32, 3>, u32, KeyHash<3>> owners;
+    for (u32 c = 0; c < cells.size(); c++)
+    {
+        for (const uivec3 &tri : cells[c])
+        {
+            for (u32 i = 0; i < 3; i++)
+            {
+                auto [owner, inserted] = owners.try_emplace(makeKey<3>(&vertices[tri[i]].x), c);
+                if (!inserted && owner->second != c)
+                    owner->second = ~0u;
+            }
+        }
+    }
+    for (u32 v = 0; v < vertices.size(); v++)
+    {
+        auto owner = owners.find(makeKey<3>(&vertices[v].x));
+        lockedVertices[v] = owner != owners.end() && owner->second == ~0u;
+    }
+    return cells;
+}
@@ -0,0 +1,100 @@
+#include "mipStreamer.hpp"
+
+#include <algorithm>
+
+MipStreamer &getMipStreamer()
+{
+    static MipStreamer mipStreamer;
+    return mipStreamer;
+}
+
+void MipStreamer::add(const TexturePtr &texture)
+{
+    if (texture->isStreamed())
+        textures.push_back(texture);
+}
+
+i32 MipStreamer::initialLevel(Texture &texture)
+{
+    i32 level = 0;
+    while (level + 1 < texture.levels && std::max(texture.width, texture.height) >> level > INITIAL_SIZE)
+        level++;
+    return level;
+}
+
+void MipStreamer::endFrame()
+{
+    std::erase_if(textures, [](const std::weak_ptr<Texture> &texture) {
+        TexturePtr locked = texture.lock();
+        return !locked || !locked->isStreamed();
+    });
+
+    struct Change
+    {
+        TexturePtr texture;
+        i32 target;
+    };
+    std::vector<Change> changes;
+    changes.reserve(textures.size());
+
+    // what every texture asked for, the ones not seen this frame keep what they have
+    u64 total = 0;
+    for (const std::weak_ptr<Texture> &weak : textures)
+    {
+        TexturePtr texture = weak.lock();
+        i32 target = texture->baseLevel;
+        if (texture->lastUsedFrame == frame)
+            target = std::clamp(texture->wantedLevel, 0, texture->levels - 1);
+        texture->wantedLevel = INT32_MAX;
+
+        changes.push_back({texture, target});
+        total += texture->residentBytes(target);
+    }
+
+    // over budget, the least recently seen give up their finest levels first, one level at a time
+    u64 budget = (u64)budgetMB * 1024 * 1024;
+    if (total > budget)
+    {
+        auto leastRecent = [](const Change &a, const Change &b) {
+            return a.texture->lastUsedFrame < b.texture->lastUsedFrame;
+        };
+        std::sort(changes.begin(), changes.end(), leastRecent);
+        for (Change &change : changes)
+        {
+            Texture *texture = change.texture.get();
+            while (total > budget && change.target + 1 < texture->levels)
+            {
+                total -= texture->residentBytes(change.target) - texture->residentBytes(change.target + 1);
+                change.target++;
+            }
+            if (total <= budget)
+                break;
+        }
+    }
+
+    // dropping levels first frees the memory the loads take
+    i32 loadsLeft = maxLoadsPerFrame;
+    residentKB = 0;
+    for (const Change &change : changes)
+    {
+        Texture *texture = change.texture.get();
+        if (change.target > texture->baseLevel)
+        {
+            texture->setBaseLevel(change.target);
+            evictions++;
+        }
+    }
+    for (const Change &change : changes)
+    {
+        Texture *texture = change.texture.get();
+        if (change.target < texture->baseLevel && loadsLeft > 0)
+        {
+            texture->setBaseLevel(change.target);
+            loads++;
+            loadsLeft--;
+        }
+        residentKB += texture->residentBytes(texture->baseLevel) / 1024;
+    }
+
+    frame++;
+}
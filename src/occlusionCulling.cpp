@@ -0,0 +1,300 @@
+#include "occlusionCulling.hpp"
+#include "GLState.hpp"
+#include "mesh.hpp"
+#include "threadPool.hpp"
+
+#include "imgui/imgui.h"
+
+#include <algorithm>
+#include <iostream>
+
+OcclusionCuller &getOcclusionCuller()
+{
+    static OcclusionCuller occlusionCuller;
+    return occlusionCuller;
+}
+
+OcclusionCuller::OcclusionCuller(u32 width, u32 height) : depthBuffer(width, height)
+{
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+    if (debugTextureID)
+    {
+        glDeleteTextures(1, &debugTextureID);
+        getGLState().textureDeleted(debugTextureID);
+    }
+}
+
+void OcclusionCuller::setOccluders(const std::vector<MeshPtr> &meshes)
+{
+    // biggest static meshes first, in world space
+    std::vector<std::pair<f32, MeshPtr>> candidates;
+    for (const MeshPtr &mesh : meshes)
+    {
+        if (!mesh->isStatic() || !mesh->getRenderLayer()->getDepthWrite() || mesh->indices.empty())
+            continue;
+
+        mat4 model = mesh->getGameObject()->getObjectMatrix();
+        f32 scale = max(max(length(vec3(model[0])), length(vec3(model[1]))), length(vec3(model[2])));
+        f32 radius = mesh->getBoundingSphere().w * scale;
+        if (radius >= minOccluderRadius)
+            candidates.push_back({radius, mesh});
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const auto &a, const auto &b) { return a.first > b.first; });
+    candidates.resize(std::min(candidates.size(), (size_t)std::max(maxOccluders, 0)));
+
+    occluders.clear();
+    std::vector<std::pair<f32, u32>> areas;
+    for (auto &[radius, mesh] : candidates)
+    {
+        Occluder occluder = {mesh, mesh->getRenderLayer()->getID(), mesh->indices};
+
+        // over budget, the largest triangles in world space cover the most
+        u32 budget = std::max(maxOccluderTriangles, 0);
+        if (occluder.triangles.size() > budget)
+        {
+            mat3 model = mat3(mesh->getGameObject()->getObjectMatrix());
+            areas.clear();
+            for (u32 t = 0; t < occluder.triangles.size(); t++)
+            {
+                const uivec3 &tri = occluder.triangles[t];
+                vec3 v0 = model * mesh->vertices[tri.x];
+                vec3 v1 = model * mesh->vertices[tri.y];
+                vec3 v2 = model * mesh->vertices[tri.z];
+                areas.push_back({length(cross(v1 - v0, v2 - v0)), t});
+            }
+            std::nth_element(areas.begin(), areas.begin() + budget, areas.end(),
+                             [](const auto &a, const auto &b) { return a.first > b.first; });
+
+            // back in mesh order, neighbours stay close in memory
+            areas.resize(budget);
+            std::sort(areas.begin(), areas.end(), [](const auto &a, const auto &b) { return a.second < b.second; });
+            std::vector<uivec3> kept;
+            for (auto &[area, t] : areas)
+            {
+                kept.push_back(occluder.triangles[t]);
+            }
+            occluder.triangles = std::move(kept);
+        }
+        occluders.push_back(std::move(occluder));
+    }
+}
+
+void OcclusionCuller::beginLayer(const RenderLayerPtr &renderLayer, const mat4 &_viewProj)
+{
+    viewProj = _viewProj;
+    active = false;
+    if (!enabled || !renderLayer->getDepthTest())
+        return;
+
+    // matrices on this thread, the game objects compute them lazily
+    layerOccluders.clear();
+    layerMVPs.clear();
+    for (const Occluder &occluder : occluders)
+    {
+        GameObjectPtr object = occluder.mesh->getGameObject();
+        if (occluder.layerID != renderLayer->getID() || !object->getEnabled())
+            continue;
+
+        layerOccluders.push_back(&occluder);
+        layerMVPs.push_back(viewProj * object->getObjectMatrix());
+    }
+    if (layerOccluders.empty())
+        return;
+
+    ThreadPool &pool = getThreadPool();
+    depthBuffer.clear();
+    screenVertices.resize(std::max(screenVertices.size(), layerOccluders.size()));
+
+    vec2 size(depthBuffer.getWidth(), depthBuffer.getHeight());
+    pool.parallelFor(layerOccluders.size(), [&](u32 i) {
+        const std::vector<vec3> &vertices = layerOccluders[i]->mesh->vertices;
+        std::vector<vec3> &screen = screenVertices[i];
+        screen.resize(vertices.size());
+        for (u32 v = 0; v < vertices.size(); v++)
+        {
+            vec4 clip = layerMVPs[i] * vec4(vertices[v], 1.0f);
+            if (clip.w <= 1e-5f || clip.z < -clip.w)
+            {
+                screen[v] = vec3(0.0f, 0.0f, -1.0f);
+                continue;
+            }
+            vec3 ndc = vec3(clip) / clip.w;
+            screen[v] = vec3((vec2(ndc) * 0.5f + 0.5f) * size, ndc.z * 0.5f + 0.5f);
+        }
+    });
+
+    // one band of tile rows per job, bands never share a tile. Triangles crossing the near plane
+    // are dropped rather than clipped, an occluder can only lose coverage that way
+    u32 tileRows = depthBuffer.getTilesY();
+    u32 bandCount = std::min(pool.getThreadCount() * 2, tileRows);
+    u32 bandRows = (tileRows + bandCount - 1) / bandCount;
+    pool.parallelFor(bandCount, [&](u32 band) {
+        u32 firstRow = band * bandRows;
+        u32 endRow = std::min(firstRow + bandRows, tileRows);
+        for (u32 i = 0; i < layerOccluders.size(); i++)
+        {
+            const Occluder &occluder = *layerOccluders[i];
+            const std::vector<vec3> &screen = screenVertices[i];
+            for (const uivec3 &tri : occluder.triangles)
+            {
+                const vec3 &v0 = screen[tri.x];
+                const vec3 &v1 = screen[tri.y];
+                const vec3 &v2 = screen[tri.z];
+                if (v0.z < 0.0f || v1.z < 0.0f || v2.z < 0.0f)
+                    continue;
+
+                depthBuffer.rasterizeTriangle(v0, v1, v2, firstRow, endRow);
+            }
+        }
+    });
+
+    for (const Occluder *occluder : layerOccluders)
+    {
+        occluderTriangles += occluder->triangles.size();
+    }
+    active = true;
+
+    if (verifyReference)
+        rasterizeReference();
+
+    if (showDepth)
+        updateDebugTexture();
+}
+
+void OcclusionCuller::rasterizeReference()
+{
+    if (referenceBuffer.getPixelCount() != depthBuffer.getWidth() * depthBuffer.getHeight())
+        referenceBuffer.resize(depthBuffer.getWidth(), depthBuffer.getHeight());
+    referenceBuffer.clear();
+
+    for (u32 i = 0; i < layerOccluders.size(); i++)
+    {
+        const std::vector<vec3> &screen = screenVertices[i];
+        for (const uivec3 &tri : layerOccluders[i]->triangles)
+        {
+            const vec3 &v0 = screen[tri.x];
+            const vec3 &v1 = screen[tri.y];
+            const vec3 &v2 = screen[tri.z];
+            if (v0.z < 0.0f || v1.z < 0.0f || v2.z < 0.0f)
+                continue;
+
+            referenceBuffer.rasterizeTriangle(v0, v1, v2);
+        }
+    }
+
+    mismatches += referenceBuffer.countMismatches(depthBuffer);
+}
+
+void OcclusionCuller::endFrame()
+{
+    if (mismatches)
+        std::cerr << "Masked depth buffer differs from the scalar reference " << mismatches << " times.\n";
+    lastMismatches = mismatches;
+    mismatches = 0;
+    lastOccluderTriangles = occluderTriangles;
+    lastTestedCount = testedCount;
+    lastCulledCount = culledCount;
+    occluderTriangles = 0;
+    testedCount = 0;
+    culledCount = 0;
+}
+
+bool OcclusionCuller::isVisible(const mat4 &model, vec3 boxMin, vec3 boxMax)
+{
+    // meshes without CPU side vertices have an empty box
+    if (!active || boxMin == boxMax)
+        return true;
+
+    testedCount++;
+
+    // screen rectangle and nearest depth of the box corners, anything reaching behind the camera
+    // can't be decided
+    mat4 mvp = viewProj * model;
+    vec2 size(depthBuffer.getWidth(), depthBuffer.getHeight());
+    vec2 rectMin(1e30f);
+    vec2 rectMax(-1e30f);
+    f32 zMin = 1.0f;
+    for (u32 corner = 0; corner < 8; corner++)
+    {
+        vec3 p = vec3(corner & 1 ? boxMax.x : boxMin.x, corner & 2 ? boxMax.y : boxMin.y,
+                      corner & 4 ? boxMax.z : boxMin.z);
+        vec4 clip = mvp * vec4(p, 1.0f);
+        if (clip.w <= 1e-5f || clip.z < -clip.w)
+            return true;
+
+        vec3 ndc = vec3(clip) / clip.w;
+        vec2 screen = (vec2(ndc) * 0.5f + 0.5f) * size;
+        rectMin = min(rectMin, screen);
+        rectMax = max(rectMax, screen);
+        zMin = std::min(zMin, ndc.z * 0.5f + 0.5f);
+    }
+
+    if (depthBuffer.testRect(rectMin, rectMax, zMin))
+        return true;
+
+    // the reference drew the same triangles, it can only see more
+    if (verifyReference && referenceBuffer.testRect(rectMin, rectMax, zMin))
+        mismatches++;
+
+    culledCount++;
+    return false;
+}
+
+void OcclusionCuller::updateDebugTexture()
+{
+    u32 width = depthBuffer.getWidth();
+    u32 height = depthBuffer.getHeight();
+    if (!debugTextureID)
+    {
+        glCreateTextures(GL_TEXTURE_2D, 1, &debugTextureID);
+        glTextureStorage2D(debugTextureID, 1, GL_R8, width, height);
+        glTextureParameteri(debugTextureID, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(debugTextureID, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTextureParameteriv(debugTextureID, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    // stretched between the nearest and furthest depth written, empty pixels stay black
+    f32 zMin = 1.0f;
+    f32 zMax = 0.0f;
+    for (u32 y = 0; y < height; y++)
+    {
+        for (u32 x = 0; x < width; x++)
+        {
+            f32 z = depthBuffer.getPixelDepth(x, y);
+            if (z < 1.0f)
+            {
+                zMin = std::min(zMin, z);
+                zMax = std::max(zMax, z);
+            }
+        }
+    }
+
+    debugPixels.resize(width * height);
+    for (u32 y = 0; y < height; y++)
+    {
+        for (u32 x = 0; x < width; x++)
+        {
+            f32 z = depthBuffer.getPixelDepth(x, y);
+            f32 value = z < 1.0f ? 1.0f - 0.8f * (z - zMin) / std::max(zMax - zMin, 1e-6f) : 0.0f;
+            debugPixels[x + y * width] = (u8)(255.0f * value);
+        }
+    }
+
+    // rows are whole tiles wide, always 4 byte aligned
+    glTextureSubImage2D(debugTextureID, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, debugPixels.data());
+}
+
+void OcclusionCuller::drawDebugImage()
+{
+    if (!showDepth || !debugTextureID)
+        return;
+
+    // rows go up, ImGui's go down
+    ImVec2 size(depthBuffer.getWidth() * 2.0f, depthBuffer.getHeight() * 2.0f);
+    ImGui::Image((ImTextureID)(intptr_t)debugTextureID, size, ImVec2(0.0f, 1.0f), ImVec2(1.0f, 0.0f));
+}
@@ -0,0 +1,198 @@
+#include "programCache.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+constexpr u32 MAGIC = 0x43425053; // "SPBC"
+constexpr u32 VERSION = 1;
+
+struct Header
+{
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 format;
+    u32 length;
+};
+
+// fnv-1a, only has to tell two versions of the same program apart
+u64 hash(u64 h, const std::string &str)
+{
+    for (char c : str)
+    {
+        h ^= (u8)c;
+        h *= 0x100000001b3ull;
+    }
+    // separator, "ab" + "c" and "a" + "bc" don't collide
+    h ^= 0xff;
+    h *= 0x100000001b3ull;
+    return h;
+}
+
+constexpr u64 FNV_OFFSET = 0xcbf29ce484222325ull;
+} // namespace
+
+ProgramCache &getProgramCache()
+{
+    static ProgramCache programCache;
+    return programCache;
+}
+
+void ProgramCache::init()
+{
+    initialized = true;
+
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    supported = formatCount > 0;
+    if (!supported)
+    {
+        std::cerr << "Program cache: the driver has no program binary format, shaders will be built from source"
+                  << std::endl;
+        return;
+    }
+
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+    {
+        const char *str = (const char *)glGetString(name);
+        driver += str ? str : "";
+        driver += '\n';
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        std::cerr << "Program cache: can't create " << directory << ": " << error.message() << std::endl;
+        supported = false;
+    }
+}
+
+std::string ProgramCache::filePath(const std::vector<std::string> &paths) const
+{
+    u64 h = FNV_OFFSET;
+    for (const std::string &path : paths)
+    {
+        h = hash(h, path);
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)h);
+    return directory + "/" + name;
+}
+
+u64 ProgramCache::key(const std::vector<std::string> &sources)
+{
+    if (!initialized)
+        init();
+
+    u64 h = hash(FNV_OFFSET, driver);
+    for (const std::string &source : sources)
+    {
+        h = hash(h, source);
+    }
+    return h;
+}
+
+bool ProgramCache::load(GLuint programID, const std::vector<std::string> &paths, u64 key)
+{
+    if (!initialized)
+        init();
+    if (!enabled || !supported)
+        return false;
+
+    std::string path = filePath(paths);
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        misses++;
+        return false;
+    }
+
+    // stale entries are left in place, the rebuilt program overwrites them
+    Header header;
+    if (!file.read((char *)&header, sizeof(header)) || header.magic != MAGIC || header.version != VERSION ||
+        header.key != key)
+    {
+        misses++;
+        return false;
+    }
+
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), header.length))
+    {
+        misses++;
+        return false;
+    }
+
+    glProgramBinary(programID, header.format, binary.data(), header.length);
+
+    // the driver may still refuse a binary it produced, after an update keeping the same version string
+    GLint linked = GL_FALSE;
+    glGetProgramiv(programID, GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE)
+    {
+        std::cerr << "Program cache: driver rejected " << path << ", rebuilding from source" << std::endl;
+        file.close();
+        std::error_code error;
+        std::filesystem::remove(path, error);
+        misses++;
+        return false;
+    }
+
+    hits++;
+    return true;
+}
+
+void ProgramCache::prepare(GLuint programID)
+{
+    if (!initialized)
+        init();
+    if (enabled && supported)
+        glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::store(GLuint programID, const std::vector<std::string> &paths, u64 key)
+{
+    if (!enabled || !supported)
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(programID, length, &length, &format, binary.data());
+
+    Header header = {MAGIC, VERSION, key, format, (u32)length};
+
+    // written aside and renamed, a run killed halfway never leaves a truncated binary behind
+    std::string path = filePath(paths);
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cerr << "Program cache: can't open " << tmpPath << std::endl;
+            return;
+        }
+        file.write((const char *)&header, sizeof(header));
+        file.write(binary.data(), length);
+        if (!file)
+        {
+            std::cerr << "Program cache: can't write " << tmpPath << std::endl;
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmpPath, path, error);
+    if (error)
+        std::cerr << "Program cache: can't write " << path << ": " << error.message() << std::endl;
+}
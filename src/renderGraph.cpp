@@ -0,0 +1,537 @@
+#include "renderGraph.hpp"
+#include "GLState.hpp"
+#include "dynamicResolution.hpp"
+#include "globals.hpp"
+#include "renderTargetPool.hpp"
+#include "texture.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+
+namespace
+{
+bool isDepthFormat(GLenum format)
+{
+    return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH_COMPONENT32F;
+}
+
+[[noreturn]] void fail(const std::string &message)
+{
+    std::cerr << "Render graph: " << message << std::endl;
+    exit(EXIT_FAILURE);
+}
+} // namespace
+
+RenderGraph::~RenderGraph()
+{
+    release();
+}
+
+GLenum RenderGraph::parseFormat(const std::string &name)
+{
+    if (name == "rgb8")
+        return GL_RGB8;
+    if (name == "rgba8")
+        return GL_RGBA8;
+    if (name == "rgba16f")
+        return GL_RGBA16F;
+    if (name == "rg16f")
+        return GL_RG16F;
+    if (name == "r32f")
+        return GL_R32F;
+    if (name == "depth24stencil8")
+        return GL_DEPTH24_STENCIL8;
+    if (name == "depth32f")
+        return GL_DEPTH_COMPONENT32F;
+    fail("unknown target format " + name);
+}
+
+void RenderGraph::addTarget(const Target &target)
+{
+    if (target.name == SCREEN || findTarget(target.name) >= 0)
+        fail("target " + target.name + " declared twice");
+    targets.push_back(target);
+}
+
+void RenderGraph::addPass(const Pass &pass)
+{
+    passes.push_back(pass);
+}
+
+i32 RenderGraph::findTarget(const std::string &name) const
+{
+    for (u32 i = 0; i < targets.size(); i++)
+    {
+        if (targets[i].name == name)
+            return i;
+    }
+    return -1;
+}
+
+void RenderGraph::compile(const std::vector<RenderLayerPtr> &layers)
+{
+    release();
+    order.clear();
+    targetTextures.assign(targets.size(), -1);
+    textures.clear();
+    if (passes.empty())
+        return;
+
+    // names to indices, everything a pass refers to has to exist
+    auto resolve = [&](const Pass &pass, const std::string &name, bool depth) {
+        if (name.empty())
+            return -1;
+        if (name == SCREEN && !depth)
+            return -2;
+
+        i32 t = findTarget(name);
+        if (t < 0)
+            fail("pass " + pass.name + " uses unknown target " + name);
+        if (isDepthFormat(targets[t].format) != depth)
+            fail("pass " + pass.name + (depth ? " needs a depth format for " : " can't draw color to ") + name);
+        return t;
+    };
+
+    u32 n = passes.size();
+    std::vector<CompiledPass> compiled(n);
+    for (u32 i = 0; i < n; i++)
+    {
+        const Pass &pass = passes[i];
+        CompiledPass &c = compiled[i];
+        c.pass = i;
+
+        auto layer = std::find_if(layers.begin(), layers.end(),
+                                  [&](const RenderLayerPtr &l) { return l->getID() == pass.layerID; });
+        if (layer == layers.end())
+            fail("pass " + pass.name + " draws unknown layer " + std::to_string(pass.layerID));
+        c.layer = *layer;
+
+        c.color = resolve(pass, pass.color, false);
+        c.depth = resolve(pass, pass.depth, true);
+        if (c.color == -2 && c.depth != -1)
+            fail("pass " + pass.name + " can't use a depth target while drawing to the screen");
+        c.velocity = resolve(pass, pass.velocity, false);
+        if (c.velocity != -1 && c.color < 0)
+            fail("pass " + pass.name + " needs a color target other than the screen to draw velocity");
+
+        if (!pass.colorSource.empty())
+        {
+            c.colorSource = resolve(pass, pass.colorSource, false);
+            if (c.color < 0 || c.colorSource < 0 || targets[c.colorSource].format != targets[c.color].format)
+                fail("pass " + pass.name + " copies " + pass.colorSource + " into a target of another format");
+        }
+
+        for (auto &[name, slot] : pass.inputs)
+        {
+            i32 t = findTarget(name);
+            if (t < 0)
+                fail("pass " + pass.name + " samples unknown target " + name);
+            if (slot >= FBO_N)
+                fail("pass " + pass.name + " samples " + name + " on slot " + std::to_string(slot) +
+                     ", past the last one");
+            if (t == c.color || t == c.depth || t == c.velocity)
+                fail("pass " + pass.name + " samples " + name + " while drawing to it");
+            c.inputs.push_back({t, slot});
+        }
+    }
+
+    i32 outputTarget = output == SCREEN ? -2 : findTarget(output);
+    if (outputTarget == -1 || (outputTarget >= 0 && isDepthFormat(targets[outputTarget].format)))
+        fail("output " + output + " isn't a color target");
+    i32 depthIndex = depthTarget.empty() ? -1 : findTarget(depthTarget);
+    if (!depthTarget.empty() && (depthIndex < 0 || !isDepthFormat(targets[depthIndex].format)))
+        fail("depth " + depthTarget + " isn't a depth target");
+    i32 velocityIndex = velocityTarget.empty() ? -1 : findTarget(velocityTarget);
+    if (!velocityTarget.empty() && (velocityIndex < 0 || isDepthFormat(targets[velocityIndex].format)))
+        fail("velocity " + velocityTarget + " isn't a color target");
+
+    // Writers of a target run in the order they are declared in, each one drawing over what the
+    // previous one left unless it clears. Samplers and copies see the target once every writer is
+    // done, wherever they are declared. Data edges are what the culling follows, order edges only
+    // constrain the sort
+    auto slotOf = [&](i32 t) { return t == -2 ? (i32)targets.size() : t; };
+    std::vector<std::vector<i32>> writers(targets.size() + 1);
+    for (u32 i = 0; i < n; i++)
+    {
+        for (i32 t : {compiled[i].color, compiled[i].velocity, compiled[i].depth})
+        {
+            if (t != -1)
+                writers[slotOf(t)].push_back(i);
+        }
+    }
+
+    std::vector<std::vector<u32>> dataEdges(n);
+    std::vector<std::vector<u32>> orderEdges(n);
+    for (u32 i = 0; i < n; i++)
+    {
+        const CompiledPass &c = compiled[i];
+        const Pass &pass = passes[i];
+
+        std::vector<i32> reads;
+        for (auto &[t, slot] : c.inputs)
+        {
+            reads.push_back(t);
+        }
+        if (c.colorSource >= 0)
+            reads.push_back(c.colorSource);
+        for (i32 t : reads)
+        {
+            for (i32 w : writers[t])
+            {
+                orderEdges[i].push_back(w);
+            }
+            if (!writers[t].empty())
+                dataEdges[i].push_back(writers[t].back());
+        }
+
+        auto addPreviousWriter = [&](i32 t, bool loads) {
+            if (t == -1)
+                return;
+            const std::vector<i32> &w = writers[slotOf(t)];
+            auto self = std::find(w.begin(), w.end(), (i32)i);
+            if (self == w.begin())
+                return;
+            orderEdges[i].push_back(*(self - 1));
+            if (loads)
+                dataEdges[i].push_back(*(self - 1));
+        };
+        addPreviousWriter(c.color, !pass.clearColor && c.colorSource < 0);
+        addPreviousWriter(c.velocity, !pass.clearVelocity);
+        addPreviousWriter(c.depth, !pass.clearDepth);
+    }
+
+    // only what ends up in the output or the exported depth and velocity is kept
+    std::vector<bool> needed(n, false);
+    std::vector<u32> stack;
+    if (writers[slotOf(outputTarget)].empty())
+        fail("nothing draws to the output " + output);
+    stack.push_back(writers[slotOf(outputTarget)].back());
+    for (i32 t : {depthIndex, velocityIndex})
+    {
+        if (t >= 0 && !writers[t].empty())
+            stack.push_back(writers[t].back());
+    }
+    while (!stack.empty())
+    {
+        u32 i = stack.back();
+        stack.pop_back();
+        if (needed[i])
+            continue;
+        needed[i] = true;
+        stack.insert(stack.end(), dataEdges[i].begin(), dataEdges[i].end());
+    }
+
+    // Kahn, declaration order between passes that don't depend on each other
+    std::vector<u32> pending(n, 0);
+    std::vector<std::vector<u32>> dependents(n);
+    for (u32 i = 0; i < n; i++)
+    {
+        if (!needed[i])
+            continue;
+        std::vector<u32> &edges = orderEdges[i];
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        for (u32 e : edges)
+        {
+            if (!needed[e])
+                continue;
+            pending[i]++;
+            dependents[e].push_back(i);
+        }
+    }
+    u32 neededCount = std::count(needed.begin(), needed.end(), true);
+    std::vector<bool> done(n, false);
+    while (order.size() < neededCount)
+    {
+        u32 next = n;
+        for (u32 i = 0; i < n && next == n; i++)
+        {
+            if (needed[i] && !done[i] && pending[i] == 0)
+                next = i;
+        }
+        if (next == n)
+            fail("passes read and write each other's targets in a cycle");
+
+        done[next] = true;
+        order.push_back(compiled[next]);
+        for (u32 d : dependents[next])
+        {
+            pending[d]--;
+        }
+    }
+
+    // lifetimes in execution order, the output and the exported depth and velocity live until the end of the frame
+    std::vector<i32> firstUse(targets.size(), -1);
+    std::vector<i32> lastUse(targets.size(), -1);
+    auto use = [&](i32 t, i32 step) {
+        if (t < 0)
+            return;
+        if (firstUse[t] < 0)
+            firstUse[t] = step;
+        lastUse[t] = step;
+    };
+    for (u32 step = 0; step < order.size(); step++)
+    {
+        const CompiledPass &c = order[step];
+        use(c.color, step);
+        use(c.velocity, step);
+        use(c.depth, step);
+        use(c.colorSource, step);
+        for (auto &[t, slot] : c.inputs)
+        {
+            use(t, step);
+        }
+    }
+    for (i32 t : {outputTarget, depthIndex, velocityIndex})
+    {
+        if (t >= 0 && firstUse[t] >= 0)
+            lastUse[t] = order.size();
+    }
+
+    // targets of the same format share a texture once the previous owner is done with it
+    std::vector<u32> byFirstUse;
+    for (u32 t = 0; t < targets.size(); t++)
+    {
+        if (firstUse[t] >= 0)
+            byFirstUse.push_back(t);
+    }
+    std::stable_sort(byFirstUse.begin(), byFirstUse.end(), [&](u32 a, u32 b) { return firstUse[a] < firstUse[b]; });
+    for (u32 t : byFirstUse)
+    {
+        auto texture = std::find_if(textures.begin(), textures.end(), [&](const Texture &texture) {
+            return texture.format == targets[t].format && (i32)texture.lastUse < firstUse[t];
+        });
+        if (texture == textures.end())
+        {
+            textures.push_back({targets[t].format, 0, 0});
+            texture = textures.end() - 1;
+        }
+        texture->lastUse = lastUse[t];
+        targetTextures[t] = texture - textures.begin();
+    }
+
+    std::cout << "Render graph:";
+    for (const CompiledPass &c : order)
+    {
+        std::cout << (&c == &order[0] ? " " : " > ") << passes[c.pass].name;
+    }
+    std::cout << " (" << n - order.size() << " of " << n << " passes culled), " << byFirstUse.size()
+              << " targets in " << textures.size() << " textures\n";
+}
+
+void RenderGraph::allocate(ivec2 size)
+{
+    release();
+    allocatedSize = size;
+
+    // the textures just released come straight back when only the framebuffers had to go
+    RenderTargetPool &pool = getRenderTargetPool();
+    for (Texture &texture : textures)
+    {
+        texture.textureID = pool.acquire(texture.format, size);
+    }
+
+    // one framebuffer per set of attachments, passes drawing to the same targets share it
+    std::vector<std::array<GLuint, 3>> attachments;
+    auto getFBO = [&](i32 color, i32 velocity, i32 depth) -> GLuint {
+        auto textureOf = [&](i32 t) { return t >= 0 ? textures[targetTextures[t]].textureID : 0; };
+        std::array<GLuint, 3> ids = {textureOf(color), textureOf(velocity), textureOf(depth)};
+        for (u32 i = 0; i < attachments.size(); i++)
+        {
+            if (attachments[i] == ids)
+                return fboIDs[i];
+        }
+
+        auto [colorID, velocityID, depthID] = ids;
+        GLuint fboID;
+        glCreateFramebuffers(1, &fboID);
+        if (colorID)
+            glNamedFramebufferTexture(fboID, GL_COLOR_ATTACHMENT0, colorID, 0);
+        else
+            glNamedFramebufferDrawBuffer(fboID, GL_NONE);
+        // velocity is the second output of the fragment shaders, see shader/velocity.glsl
+        if (velocityID)
+        {
+            glNamedFramebufferTexture(fboID, GL_COLOR_ATTACHMENT1, velocityID, 0);
+            GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+            glNamedFramebufferDrawBuffers(fboID, 2, drawBuffers);
+        }
+        if (depthID)
+        {
+            GLenum attachment = depth >= 0 && targets[depth].format == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT
+                                                                                            : GL_DEPTH_ATTACHMENT;
+            glNamedFramebufferTexture(fboID, attachment, depthID, 0);
+        }
+        if (glCheckNamedFramebufferStatus(fboID, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Render graph: framebuffer is not complete!" << std::endl;
+
+        attachments.push_back(ids);
+        fboIDs.push_back(fboID);
+        return fboID;
+    };
+
+    for (CompiledPass &c : order)
+    {
+        c.fboID = c.color == -2 ? 0 : getFBO(c.color, c.velocity, c.depth);
+    }
+
+    i32 outputTarget = findTarget(output);
+    if (outputTarget >= 0)
+        outputFBOID = getFBO(outputTarget, -1, depthTarget.empty() ? -1 : findTarget(depthTarget));
+}
+
+void RenderGraph::release()
+{
+    GLState &gl = getGLState();
+    for (GLuint fboID : fboIDs)
+    {
+        glDeleteFramebuffers(1, &fboID);
+        gl.framebufferDeleted(fboID);
+    }
+    fboIDs.clear();
+    outputFBOID = 0;
+
+    for (Texture &texture : textures)
+    {
+        if (!texture.textureID)
+            continue;
+        getRenderTargetPool().release(texture.textureID);
+        texture.textureID = 0;
+    }
+    allocatedSize = ivec2(0);
+}
+
+void RenderGraph::beginFrame()
+{
+    DynamicResolution &resolution = getDynamicResolution();
+    ivec2 size = EngineGlobals::windowSize;
+    if (passes.empty())
+    {
+        EngineGlobals::renderSize = size;
+        resolution.prepareFrame(size, size);
+        return;
+    }
+    // minimized, keep the targets for when it comes back
+    if (size.x <= 0 || size.y <= 0)
+        return;
+
+    // a window being dragged changes size every frame, only the size it ends up at is allocated
+    f64 now = glfwGetTime();
+    if (size != pendingSize)
+    {
+        pendingSize = size;
+        pendingTime = now;
+    }
+    if (outputSize == ivec2(0) || (size != outputSize && now - pendingTime >= resizeDelay))
+        outputSize = size;
+
+    // passes drawing to the screen can't be scaled
+    f32 scale = 1.0f;
+    if (output != SCREEN)
+    {
+        resolution.beginFrame();
+        scale = resolution.scale;
+    }
+    ivec2 scaledSize = max(ivec2(vec2(outputSize) * scale + 0.5f), ivec2(1));
+    if (scaledSize != allocatedSize)
+        allocate(scaledSize);
+
+    EngineGlobals::renderSize = allocatedSize;
+    resolution.prepareFrame(allocatedSize, outputSize);
+}
+
+void RenderGraph::execute(const std::vector<RenderLayerPtr> &layers)
+{
+    GLState &gl = getGLState();
+    ivec2 windowSize = EngineGlobals::windowSize;
+
+    if (passes.empty())
+    {
+        gl.bindFramebuffer(GL_FRAMEBUFFER, 0);
+        gl.setViewport(0, 0, windowSize.x, windowSize.y);
+        for (const RenderLayerPtr &layer : layers)
+        {
+            layer->render();
+        }
+        return;
+    }
+
+    if (allocatedSize == ivec2(0) || windowSize.x <= 0 || windowSize.y <= 0)
+        return;
+    ivec2 size = allocatedSize;
+
+    auto textureOf = [&](i32 t) { return textures[targetTextures[t]].textureID; };
+    for (const CompiledPass &c : order)
+    {
+        const Pass &pass = passes[c.pass];
+        if (c.colorSource >= 0)
+        {
+            glCopyImageSubData(textureOf(c.colorSource), GL_TEXTURE_2D, 0, 0, 0, 0, textureOf(c.color), GL_TEXTURE_2D,
+                               0, 0, 0, 0, size.x, size.y, 1);
+        }
+
+        gl.bindFramebuffer(GL_FRAMEBUFFER, c.fboID);
+        gl.setViewport(0, 0, size.x, size.y);
+
+        GLbitfield clearMask = (pass.clearColor && c.color != -1 ? GL_COLOR_BUFFER_BIT : 0) |
+                               (pass.clearDepth && c.depth != -1 ? GL_DEPTH_BUFFER_BIT : 0);
+        if (clearMask)
+        {
+            // glClear honors the depth mask
+            gl.setDepthMask(true);
+            glClear(clearMask);
+        }
+        // straight to zero, whatever the framebuffer and its draw buffers look like
+        if (pass.clearVelocity && c.velocity >= 0)
+            glClearTexImage(textureOf(c.velocity), 0, GL_RG, GL_FLOAT, nullptr);
+
+        // slots the pass doesn't sample are unbound, nothing can read a target being drawn to
+        GLuint inputs[FBO_N] = {};
+        for (auto &[t, slot] : c.inputs)
+        {
+            inputs[slot] = textureOf(t);
+        }
+        for (u32 slot = 0; slot < FBO_N; slot++)
+        {
+            gl.bindTexture(16 + slot, GL_TEXTURE_2D, inputs[slot]);
+        }
+
+        c.layer->render();
+    }
+
+    if (outputFBOID)
+    {
+        // below full resolution the upsampler brings the color up to outputSize
+        DynamicResolution &resolution = getDynamicResolution();
+        GLuint colorFBOID = outputFBOID;
+        ivec2 colorSize = size;
+        GLuint upsampledFBOID = resolution.resolve(textureOf(findTarget(output)), getDepthTexture(),
+                                                   getVelocityTexture(), size, outputSize);
+        if (upsampledFBOID)
+        {
+            colorFBOID = upsampledFBOID;
+            colorSize = outputSize;
+        }
+
+        // stretched to the window while it is being resized or when nothing upsampled a scaled frame
+        GLenum filter = colorSize == windowSize ? GL_NEAREST : GL_LINEAR;
+        glBlitNamedFramebuffer(colorFBOID, 0, 0, 0, colorSize.x, colorSize.y, 0, 0, windowSize.x, windowSize.y,
+                               GL_COLOR_BUFFER_BIT, filter);
+        // depth can only be blitted with nearest, it stays at the render size
+        if (!depthTarget.empty())
+        {
+            glBlitNamedFramebuffer(outputFBOID, 0, 0, 0, size.x, size.y, 0, 0, windowSize.x, windowSize.y,
+                                   GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        }
+        resolution.endFrame();
+    }
+}
+
+GLuint RenderGraph::getTargetTexture(const std::string &name) const
+{
+    i32 t = name.empty() ? -1 : findTarget(name);
+    if (t < 0 || targetTextures.empty() || targetTextures[t] < 0)
+        return 0;
+    return textures[targetTextures[t]].textureID;
+}
@@ -6,105 +6,27 @@
 
 RenderLayerPtr RenderLayer::DEFAULT = std::make_shared<DefaultRenderLayer>();
 
-void RenderLayer::render()
+void RenderLayer::applyState()
 {
-    auto meshManager = getMeshManager();
-    if (postProcessLayer == nullptr)
-    {
-        if (!depthWrite)
-            glDepthMask(GL_FALSE);
-
-        if (!depthTest)
-        {
-            glDisable(GL_DEPTH_TEST);
-            glDisable(GL_CULL_FACE);
-        }
-
-        meshManager->Update(shared_from_this());
-        if (!depthWrite)
-            glDepthMask(GL_TRUE);
-
-        if (!depthTest)
-        {
-            glEnable(GL_DEPTH_TEST);
-            glEnable(GL_CULL_FACE);
-        }
-    }
-    else
-    {
-        postProcessLayer->bind();
-        if (!depthWrite)
-            glDepthMask(GL_FALSE);
-
-        if (!depthTest)
-        {
-            glDisable(GL_DEPTH_TEST);
-            glDisable(GL_CULL_FACE);
-        }
-
-        meshManager->Update(shared_from_this());
-        if (!depthWrite)
-            glDepthMask(GL_TRUE);
-
-        if (!depthTest)
-        {
-            glEnable(GL_DEPTH_TEST);
-            glEnable(GL_CULL_FACE);
-        }
+    GLState &gl = getGLState();
+    gl.setDepthMask(depthWrite);
+    gl.setCapability(GL_DEPTH_TEST, depthTest);
+    gl.setCapability(GL_CULL_FACE, depthTest);
+}
 
-        postProcessLayer->blit();
-        postProcessLayer->unbind();
-    }
+void RenderLayer::render()
+{
+    applyState();
+    getMeshManager()->Update(shared_from_this());
 }
 
 void DefaultRenderLayer::render()
 {
-    auto meshManager = getMeshManager();
-    if (postProcessLayer == nullptr)
-    {
-        if (!depthWrite)
-            glDepthMask(GL_FALSE);
-        if (!depthTest)
-        {
-            glDisable(GL_DEPTH_TEST);
-            glDisable(GL_CULL_FACE);
-        }
-        if (EngineGlobals::scene->getSkybox())
-        {
-            EngineGlobals::scene->getSkybox()->draw();
-        }
-        meshManager->Update(shared_from_this());
-        if (!depthWrite)
-            glDepthMask(GL_TRUE);
-        if (!depthTest)
-        {
-            glEnable(GL_DEPTH_TEST);
-            glEnable(GL_CULL_FACE);
-        }
-    }
-    else
+    applyState();
+    if (EngineGlobals::scene->getSkybox())
     {
-        postProcessLayer->bind();
-        if (!depthWrite)
-            glDepthMask(GL_FALSE);
-        if (!depthTest)
-        {
-            glDisable(GL_DEPTH_TEST);
-            glDisable(GL_CULL_FACE);
-        }
-        if (EngineGlobals::scene->getSkybox())
-        {
-            EngineGlobals::scene->getSkybox()->draw();
-        }
-        meshManager->Update(shared_from_this());
-        if (!depthWrite)
-            glDepthMask(GL_TRUE);
-        if (!depthTest)
-        {
-            glEnable(GL_DEPTH_TEST);
-            glEnable(GL_CULL_FACE);
-        }
-        postProcessLayer->blit();
-        postProcessLayer->unbind();
+        EngineGlobals::scene->getSkybox()->draw();
+        applyState();
     }
-}
\ No newline at end of file
+    getMeshManager()->Update(shared_from_this());
+}
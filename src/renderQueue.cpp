@@ -0,0 +1,54 @@
+#include "renderQueue.hpp"
+
+#include <algorithm>
+
+const std::vector<u32> &RenderQueue::sort(SortMode mode)
+{
+    u32 n = depths.size();
+    order.resize(n);
+    for (u32 i = 0; i < n; i++)
+    {
+        order[i] = i;
+    }
+
+    if (mode == NONE || n < 2)
+        return order;
+
+    auto [minDepth, maxDepth] = std::minmax_element(depths.begin(), depths.end());
+    f32 range = *maxDepth - *minDepth;
+    f32 scale = range > 0.0f ? 65535.0f / range : 0.0f;
+    keys.resize(n);
+    for (u32 i = 0; i < n; i++)
+    {
+        u16 key = (u16)((depths[i] - *minDepth) * scale);
+        // blending order can't give way to state changes
+        keys[i] = mode == FRONT_TO_BACK ? (u32)stateKeys[i] << 16 | key : 0xFFFF - key;
+    }
+
+    // LSD radix sort from the low byte up, counting sort passes are stable. The state bytes only
+    // cost their two passes when something set them
+    u32 bits = mode == FRONT_TO_BACK && hasStateKeys ? 32 : 16;
+    scratch.resize(n);
+    for (u32 shift = 0; shift < bits; shift += 8)
+    {
+        u32 offsets[256] = {};
+        for (u32 i : order)
+        {
+            offsets[(keys[i] >> shift) & 0xFF]++;
+        }
+        u32 sum = 0;
+        for (u32 &offset : offsets)
+        {
+            u32 count = offset;
+            offset = sum;
+            sum += count;
+        }
+        for (u32 i : order)
+        {
+            scratch[offsets[(keys[i] >> shift) & 0xFF]++] = i;
+        }
+        order.swap(scratch);
+    }
+
+    return order;
+}
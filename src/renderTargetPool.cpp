@@ -0,0 +1,105 @@
+#include "renderTargetPool.hpp"
+#include "GLState.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+u32 bytesPerTexel(GLenum format)
+{
+    switch (format)
+    {
+    case GL_RGB8:
+        return 3;
+    case GL_RGBA16F:
+        return 8;
+    default:
+        // rgba8, rg16f, r32f and both depth formats
+        return 4;
+    }
+}
+} // namespace
+
+RenderTargetPool &getRenderTargetPool()
+{
+    static RenderTargetPool pool;
+    return pool;
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+    for (Entry &entry : entries)
+    {
+        glDeleteTextures(1, &entry.textureID);
+    }
+}
+
+GLuint RenderTargetPool::acquire(GLenum format, ivec2 size)
+{
+    for (Entry &entry : entries)
+    {
+        if (!entry.inUse && entry.format == format && entry.size == size)
+        {
+            entry.inUse = true;
+            return entry.textureID;
+        }
+    }
+
+    GLuint textureID;
+    glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+    glTextureStorage2D(textureID, 1, format, size.x, size.y);
+    bool depth = format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH_COMPONENT32F;
+    GLint filter = depth ? GL_NEAREST : GL_LINEAR;
+    glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, filter);
+    glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, filter);
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    entries.push_back({textureID, format, size, true, 0});
+    refreshCounters();
+    return textureID;
+}
+
+void RenderTargetPool::release(GLuint textureID)
+{
+    for (Entry &entry : entries)
+    {
+        if (entry.textureID == textureID)
+        {
+            entry.inUse = false;
+            entry.releaseFrame = frame;
+            return;
+        }
+    }
+    std::cerr << "Render target pool: texture " << textureID << " wasn't acquired from the pool" << std::endl;
+}
+
+void RenderTargetPool::endFrame()
+{
+    frame++;
+
+    GLState &gl = getGLState();
+    auto expired = [&](const Entry &entry) {
+        if (entry.inUse || frame - entry.releaseFrame <= (u64)maxIdleFrames)
+            return false;
+        glDeleteTextures(1, &entry.textureID);
+        gl.textureDeleted(entry.textureID);
+        return true;
+    };
+    size_t count = entries.size();
+    entries.erase(std::remove_if(entries.begin(), entries.end(), expired), entries.end());
+    if (entries.size() != count)
+        refreshCounters();
+}
+
+void RenderTargetPool::refreshCounters()
+{
+    u64 bytes = 0;
+    for (const Entry &entry : entries)
+    {
+        bytes += (u64)entry.size.x * entry.size.y * bytesPerTexel(entry.format);
+    }
+    textureCount = entries.size();
+    allocatedMB = bytes / (1024.0f * 1024.0f);
+}
@@ -0,0 +1,137 @@
+#include "ringBuffer.hpp"
+#include "utils.hpp"
+
+#include <cstring>
+#include <iostream>
+
+RingBuffer::RingBuffer(GLenum _target, GLuint _binding, u64 _regionSize) : target(_target), binding(_binding)
+{
+    // indexed targets bind every region with glBindBufferRange, its offset has to respect the target alignment
+    GLint alignment = 16;
+    if (target == GL_UNIFORM_BUFFER)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    else if (target == GL_SHADER_STORAGE_BUFFER)
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    regionSize = (_regionSize + alignment - 1) / alignment * alignment;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &bufferID);
+    glNamedBufferStorage(bufferID, regionSize * REGION_N, nullptr, flags);
+    mapped = (u8 *)glMapNamedBufferRange(bufferID, 0, regionSize * REGION_N, flags);
+    if (!mapped)
+    {
+        std::cerr << "Failed to map ring buffer.\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+RingBuffer::~RingBuffer()
+{
+    for (GLsync &fence : fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    glUnmapNamedBuffer(bufferID);
+    glDeleteBuffers(1, &bufferID);
+}
+
+void RingBuffer::beginFrame()
+{
+    GLsync &fence = fences[region];
+    if (fence)
+    {
+        // the region is only reused every REGION_N frames, most of the time the fence is long signaled
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            stalls++;
+            do
+            {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            } while (result == GL_TIMEOUT_EXPIRED);
+        }
+        if (result == GL_WAIT_FAILED)
+            std::cerr << "Ring buffer fence wait failed.\n";
+
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    head = 0;
+    if (target == GL_UNIFORM_BUFFER || target == GL_SHADER_STORAGE_BUFFER)
+        glBindBufferRange(target, binding, bufferID, region * regionSize, regionSize);
+}
+
+void RingBuffer::endFrame()
+{
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % REGION_N;
+}
+
+i64 RingBuffer::allocate(u64 size, u64 alignment)
+{
+    u64 offset = (head + alignment - 1) / alignment * alignment;
+    if (offset + size > regionSize)
+        return -1;
+
+    head = offset + size;
+    return offset;
+}
+
+DrawDataBuffer &getDrawDataBuffer()
+{
+    static DrawDataBuffer drawDataBuffer;
+    return drawDataBuffer;
+}
+
+DrawDataBuffer::DrawDataBuffer()
+    : ring(GL_SHADER_STORAGE_BUFFER, BUFFER_OBJECT_BINDINGS::DRAW_DATA, MAX_DRAWS * sizeof(DrawData)),
+      commandRing(GL_DRAW_INDIRECT_BUFFER, 0, MAX_DRAWS * sizeof(DrawElementsIndirectCommand))
+{
+}
+
+void DrawDataBuffer::beginFrame()
+{
+    drawCount = 0;
+    multiDrawCount = 0;
+    ring.beginFrame();
+    commandRing.beginFrame();
+}
+
+void DrawDataBuffer::endFrame()
+{
+    lastDrawCount = drawCount;
+    lastMultiDrawCount = multiDrawCount;
+    ring.endFrame();
+    commandRing.endFrame();
+}
+
+u32 DrawDataBuffer::push(const DrawData &data)
+{
+    i64 offset = ring.allocate(sizeof(DrawData), sizeof(DrawData));
+    if (offset < 0)
+    {
+        std::cerr << "Too many draws in a frame (max " << MAX_DRAWS << ").\n";
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(ring.getPointer(offset), &data, sizeof(DrawData));
+    return drawCount++;
+}
+
+u64 DrawDataBuffer::pushCommands(const DrawElementsIndirectCommand *commands, u32 count)
+{
+    u64 size = count * sizeof(DrawElementsIndirectCommand);
+    i64 offset = commandRing.allocate(size, sizeof(u32));
+    if (offset < 0)
+    {
+        std::cerr << "Too many indirect draws in a frame (max " << MAX_DRAWS << ").\n";
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(commandRing.getPointer(offset), commands, size);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandRing.getBufferID());
+    multiDrawCount++;
+    return commandRing.getRegionOffset() + offset;
+}
@@ -1,6 +1,11 @@
 #include "scene.hpp"
 #include "AssetManager.hpp"
 #include "MeshManager.hpp"
+#include "cascadedShadowMap.hpp"
+#include "dynamicResolution.hpp"
+
+#include <chrono>
+#include <sstream>
 
 #include "glm/glm.hpp"
 
@@ -18,22 +23,18 @@ void Scene::addMaterial(std::string materialName, MaterialPtr material)
 
 Scene::Scene() : root(createGameObject("root"))
 {
-    glGenBuffers(1, &uboLights);
-    glBindBuffer(GL_UNIFORM_BUFFER, uboLights);
-    constexpr size_t uboSize = 368ULL; // cf shader
-    glBufferData(GL_UNIFORM_BUFFER, uboSize, nullptr, GL_STATIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, BUFFER_OBJECT_BINDINGS::LIGHTS, uboLights);
 }
 
 Scene::~Scene()
 {
-    glDeleteBuffers(1, &uboLights);
 }
 
 ScenePtr Scene::Load(std::string path)
 {
     using namespace rapidxml;
 
+    auto loadStart = std::chrono::steady_clock::now();
+
     std::ifstream file(path);
     if (!file.is_open())
     {
@@ -56,11 +57,12 @@ ScenePtr Scene::Load(std::string path)
 
     std::string sceneName = rootNode->first_attribute("name")->value();
     ScenePtr scene = std::make_shared<Scene>();
-    memset(scene->lights, 0, sizeof(lights));
 
     std::unordered_map<std::string, ShaderProgramPtr> &shaders = scene->shaders;
     std::unordered_map<std::string, TexturePtr> textures;
     std::unordered_map<std::string, std::string> modelPaths;
+    std::unordered_map<std::string, u32> modelLODCounts;
+    std::unordered_map<std::string, bool> modelQuantize;
     std::unordered_map<std::string, MaterialPtr> &materials = scene->materials;
 
     struct LodDef
@@ -84,8 +86,21 @@ ScenePtr Scene::Load(std::string path)
         return nullptr;
     }
 
+    // every skybox draws with the same program
+    ShaderProgramPtr skyboxShader;
+
+    // programs are only submitted while parsing, the driver compiles them while the other ressources load
+    std::vector<ShaderProgramPtr> pendingShaders;
+
     for (xml_node<> *child = ressourcesNode->first_node(); child; child = child->next_sibling())
     {
+        std::erase_if(pendingShaders, [](const ShaderProgramPtr &shader) {
+            if (!shader->isReady())
+                return false;
+            shader->finalize();
+            return true;
+        });
+
         std::string name = child->name();
         if (name == "shader")
         {
@@ -100,9 +115,19 @@ ScenePtr Scene::Load(std::string path)
                 enableFBO = std::string(attr->value()) == "true";
             }
 
-            ShaderProgramPtr shader = newShaderProgram(vertPath, fragPath, enableFBO);
+            // "A B=2", one permutation per combination, identical ones share a program
+            std::vector<std::string> defines;
+            if (auto definesAttr = child->first_attribute("defines"))
+            {
+                std::istringstream stream(definesAttr->value());
+                for (std::string define; stream >> define;)
+                    defines.push_back(define);
+            }
+
+            ShaderProgramPtr shader = newShaderProgram(vertPath, fragPath, enableFBO, defines);
 
             shaders[shaderName] = shader;
+            pendingShaders.push_back(shader);
         }
         else if (name == "texture")
         {
@@ -116,6 +141,16 @@ ScenePtr Scene::Load(std::string path)
             std::string modelName = child->first_attribute("name")->value();
             std::string modelPath = child->first_attribute("path")->value();
             modelPaths[modelName] = modelPath;
+
+            // simplified levels generated at load, on top of the model itself
+            auto lodAttr = child->first_attribute("lods");
+            if (lodAttr)
+                modelLODCounts[modelName] = std::stoi(lodAttr->value());
+
+            // 16 bit positions, for the meshes drawn with shader/3D.vert
+            auto quantizeAttr = child->first_attribute("quantize");
+            if (quantizeAttr)
+                modelQuantize[modelName] = std::string(quantizeAttr->value()) == "true";
         }
         else if (name == "LODmodel")
         {
@@ -147,71 +182,100 @@ ScenePtr Scene::Load(std::string path)
                 depthTest = std::string(depthTestAttr->value()) == "true";
             }
 
-            PostProcessLayerPtr postProcessLayer = nullptr;
+            // defaults to front to back for the layers writing depth, back to front for the others
+            RenderQueue::SortMode sortMode = depthWrite ? RenderQueue::FRONT_TO_BACK : RenderQueue::BACK_TO_FRONT;
+            auto sortAttr = child->first_attribute("sort");
+            if (sortAttr)
+            {
+                std::string sort = sortAttr->value();
+                if (sort == "none")
+                    sortMode = RenderQueue::NONE;
+                else if (sort == "frontToBack")
+                    sortMode = RenderQueue::FRONT_TO_BACK;
+                else if (sort == "backToFront")
+                    sortMode = RenderQueue::BACK_TO_FRONT;
+                else
+                    std::cerr << "Error: Unknown render layer sort mode " << sort << std::endl;
+            }
 
-            xml_node<> *postProcessLayerNode = child->first_node();
-            if (postProcessLayerNode)
+            if (layerID != 0)
             {
-                u8 inputMask = std::stoi(postProcessLayerNode->first_attribute("bindMask")->value(), nullptr, 2);
-                u32 outputID = std::stoi(postProcessLayerNode->first_attribute("mainFBO")->value());
-                bool clear = false;
+                scene->renderLayers.push_back(std::make_shared<RenderLayer>(layerID, depthWrite, depthTest));
+                scene->renderLayers.back()->setSortMode(sortMode);
+            }
+            else
+            {
+                RenderLayer::DEFAULT->setSortMode(sortMode);
+            }
+        }
+        else if (name == "renderGraph")
+        {
+            auto outputAttr = child->first_attribute("output");
+            if (outputAttr)
+                scene->renderGraph.setOutput(outputAttr->value());
+
+            auto depthAttr = child->first_attribute("depth");
+            if (depthAttr)
+                scene->renderGraph.setDepthTarget(depthAttr->value());
 
-                auto clearAttr = postProcessLayerNode->first_attribute("clear");
-                if (clearAttr)
+            auto velocityAttr = child->first_attribute("velocity");
+            if (velocityAttr)
+                scene->renderGraph.setVelocityTarget(velocityAttr->value());
+
+            for (xml_node<> *node = child->first_node(); node; node = node->next_sibling())
+            {
+                std::string nodeName = node->name();
+                if (nodeName == "target")
                 {
-                    clear = std::string(clearAttr->value()) == "true";
+                    scene->renderGraph.addTarget(
+                        {node->first_attribute("name")->value(),
+                         RenderGraph::parseFormat(node->first_attribute("format")->value())});
                 }
-
-                u32 blitMask = 0;
-                for (xml_node<> *blitMaskElement = postProcessLayerNode->first_node("blitMaskElement"); blitMaskElement;
-                     blitMaskElement = blitMaskElement->next_sibling())
+                else if (nodeName == "pass")
                 {
-                    std::string FBO_ID = blitMaskElement->first_attribute("FBO_ID")->value();
-                    int color = 0;
-                    int depth = 0;
-                    int stencil = 0;
-
-                    auto colorAttr = blitMaskElement->first_attribute("color");
-                    if (colorAttr)
-                        color = std::string(colorAttr->value()) == "true";
-
-                    auto depthAttr = blitMaskElement->first_attribute("depth");
-                    if (depthAttr)
-                        depth = std::string(depthAttr->value()) == "true";
-
-                    auto stencilAttr = blitMaskElement->first_attribute("stencil");
-                    if (stencilAttr)
-                        stencil = std::string(stencilAttr->value()) == "true";
-
-                    u32 mask = color + (depth << 1) + (stencil << 2);
-                    if (FBO_ID == "screen")
-                    {
-                        blitMask |= (mask << 24);
-                    }
-                    else
+                    RenderGraph::Pass pass;
+                    pass.name = node->first_attribute("name")->value();
+                    pass.layerID = std::stoi(node->first_attribute("layer")->value());
+                    for (xml_node<> *prop = node->first_node(); prop; prop = prop->next_sibling())
                     {
-                        u32 fboID = std::stoi(FBO_ID);
-                        blitMask |= (mask << (fboID * 3));
+                        std::string propName = prop->name();
+                        std::string target = prop->first_attribute("target")->value();
+                        auto clearAttr = prop->first_attribute("clear");
+                        bool clear = clearAttr && std::string(clearAttr->value()) == "true";
+
+                        if (propName == "input")
+                        {
+                            pass.inputs.push_back({target, std::stoi(prop->first_attribute("slot")->value())});
+                        }
+                        else if (propName == "color")
+                        {
+                            pass.color = target;
+                            pass.clearColor = clear;
+                            auto copyAttr = prop->first_attribute("copy");
+                            if (copyAttr)
+                                pass.colorSource = copyAttr->value();
+                        }
+                        else if (propName == "velocity")
+                        {
+                            pass.velocity = target;
+                            pass.clearVelocity = clear;
+                        }
+                        else if (propName == "depth")
+                        {
+                            pass.depth = target;
+                            pass.clearDepth = clear;
+                        }
                     }
+                    scene->renderGraph.addPass(pass);
                 }
-                postProcessLayer = std::make_shared<PostProcessLayer>(inputMask, outputID, blitMask, clear);
-            }
-
-            if (layerID != 0)
-            {
-                scene->renderLayers.push_back(
-                    std::make_shared<RenderLayer>(layerID, depthWrite, depthTest, postProcessLayer));
-            }
-            else
-            {
-                RenderLayer::DEFAULT->setPostProcessLayer(postProcessLayer);
             }
         }
         else if (name == "material")
         {
             std::string materialName = child->first_attribute("name")->value();
             std::string shaderName;
-            std::vector<std::string> textureNames;
+            // texture and slot name
+            std::vector<std::pair<std::string, std::string>> textureNames;
             for (xml_node<> *prop = child->first_node(); prop; prop = prop->next_sibling())
             {
                 std::string propName = prop->name();
@@ -221,13 +285,40 @@ ScenePtr Scene::Load(std::string path)
                 }
                 else if (propName == "textureRef")
                 {
-                    textureNames.push_back(prop->first_attribute("texture")->value());
+                    auto slotAttr = prop->first_attribute("slot");
+                    std::string textureName = prop->first_attribute("texture")->value();
+                    textureNames.push_back({textureName, slotAttr ? slotAttr->value() : ""});
                 }
             }
             MaterialPtr material = std::make_shared<Material>(shaders[shaderName]);
-            for (auto &textureName : textureNames)
+            for (auto &[textureName, slotName] : textureNames)
             {
-                material->addTexture(textures[textureName]);
+                material->addTexture(textures[textureName], slotName);
+            }
+
+            // parameter block, in the order the shader declares its members
+            MaterialParams &params = material->getParams();
+            for (xml_node<> *prop = child->first_node(); prop; prop = prop->next_sibling())
+            {
+                std::string propName = prop->name();
+                if (propName == "shaderRef" || propName == "textureRef")
+                    continue;
+
+                std::string paramName = prop->first_attribute("name")->value();
+                const char *value = prop->first_attribute("value")->value();
+                if (propName == "float")
+                    params.declare(paramName, (f32)atof(value));
+                else if (propName == "vec2")
+                    params.declare(paramName, vec2(parseVec4(value)));
+                else if (propName == "vec3")
+                    params.declare(paramName, parseVec3(value));
+                else if (propName == "vec4")
+                    params.declare(paramName, parseVec4(value));
+                else if (propName == "color")
+                    params.declare(paramName, parseColorRGBA(value), MaterialParamType::COLOR);
+                else
+                    std::cerr << "Error: Unknown material param type " << propName << " in material " << materialName
+                              << std::endl;
             }
 
             materials[materialName] = material;
@@ -265,9 +356,27 @@ ScenePtr Scene::Load(std::string path)
                         }
                     }
 
+                    bool isStatic = false;
+                    rapidxml::xml_attribute<char> *staticAttr = prop->first_attribute("static");
+                    if (staticAttr)
+                        isStatic = std::string(staticAttr->value()) == "true";
+
+                    // the meshes of lod models are shared between objects, they can't take a tint of their own
+                    vec4 tint(1.0f);
+                    rapidxml::xml_attribute<char> *tintAttr = prop->first_attribute("tint");
+                    if (tintAttr && lod)
+                        std::cerr << "Error: tint is ignored on the lod model " << modelName << std::endl;
+                    else if (tintAttr)
+                        tint = parseColorRGBA(tintAttr->value());
+
                     if (!lod)
                     {
-                        object->addComponent<Mesh>(materials[materialName], modelPaths[modelName], renderLayer);
+                        MeshPtr mesh = object->addComponent<Mesh>(materials[materialName], modelPaths[modelName],
+                                                                  renderLayer, modelQuantize[modelName]);
+                        if (modelLODCounts[modelName])
+                            mesh->generateLODs(modelLODCounts[modelName], 0.5f, isStatic);
+                        mesh->setMaterialOverride(tint);
+                        mesh->setStatic(isStatic);
                     }
                     else
                     {
@@ -366,12 +475,25 @@ ScenePtr Scene::Load(std::string path)
             std::string front = child->first_node("front")->first_attribute("path")->value();
             std::string back = child->first_node("back")->first_attribute("path")->value();
             CubeMapPtr cubeMap = loadCubeMap(std::array<std::string, 6>({right, left, top, bottom, front, back}));
-            ShaderProgramPtr skyboxShader = std::make_shared<ShaderProgram>("shader/skybox.vert", "shader/skybox.frag");
+            if (!skyboxShader)
+            {
+                skyboxShader = std::make_shared<ShaderProgram>("shader/skybox.vert", "shader/skybox.frag");
+                pendingShaders.push_back(skyboxShader);
+            }
             MaterialPtr skyboxMaterial = std::make_shared<Material>(skyboxShader);
             scene->skyboxes[skyboxName] = std::make_shared<Skybox>(skyboxMaterial, cubeMap);
         }
     }
 
+    // the textures sampled through arrays are grouped once every material is known
+    std::vector<TexturePtr> arrayTextures;
+    for (auto &[materialName, material] : materials)
+    {
+        if (material->usesTextureArrays())
+            arrayTextures.insert(arrayTextures.end(), material->getTextures().begin(), material->getTextures().end());
+    }
+    AssetManager::getInstance().buildTextureArrays(arrayTextures);
+
     xml_node<> *graphNode = rootNode->first_node("graph");
     if (!graphNode)
     {
@@ -426,11 +548,6 @@ ScenePtr Scene::Load(std::string path)
             }
             else if (type == "light")
             {
-                if (scene->lightCount >= MAX_LIGHTS)
-                {
-                    std::cerr << "Error: Maximum number of lights reached" << std::endl;
-                    continue;
-                }
                 Light light;
                 for (xml_attribute<> *attr = child->first_attribute(); attr; attr = attr->next_attribute())
                 {
@@ -449,8 +566,12 @@ ScenePtr Scene::Load(std::string path)
                     {
                         light.intensity = std::stof(attr->value());
                     }
+                    else if (name == "radius")
+                    {
+                        light.radius = std::stof(attr->value());
+                    }
                 }
-                scene->lights[scene->lightCount++] = light;
+                scene->lights.push_back(light);
             }
             else if (type == "skyboxRef")
             {
@@ -460,77 +581,27 @@ ScenePtr Scene::Load(std::string path)
         }
     }
 
-    // lights
-    glBindBuffer(GL_UNIFORM_BUFFER, scene->uboLights);
-    struct AllignedLight
-    {
-        vec3 position __attribute__((aligned(16)));
-        vec3 color __attribute__((aligned(16)));
-        f32 intensity __attribute__((aligned(4)));
-
-        AllignedLight(Light light)
-        {
-            position = light.position;
-            color = light.color;
-            intensity = light.intensity;
-        }
-
-        AllignedLight()
-        {
-        }
-    } __attribute__((aligned(16)));
-
-    struct AllignedDirectionalLight
-    {
-        vec3 direction __attribute__((aligned(16)));
-        vec3 color __attribute__((aligned(16)));
-        f32 intensity __attribute__((aligned(4)));
-
-        AllignedDirectionalLight(DirectionalLight light)
-        {
-            direction = light.direction;
-            color = light.color;
-            intensity = light.intensity;
-        }
-
-        AllignedDirectionalLight(ShadowMappedDirectionalLight light)
-        {
-            Transform3D transform = light.getTransform();
-            direction = transform.getForward();
-            color = light.getColor();
-            intensity = light.getIntensity();
-        }
-
-        AllignedDirectionalLight()
-        {
-        }
-    } __attribute__((aligned(16)));
-
-    struct LightBlock
-    {
-        AllignedLight __attribute__((aligned(16))) lights[MAX_LIGHTS];
-        AllignedDirectionalLight __attribute__((aligned(16))) directionalLight;
-        int lightCount __attribute__((aligned(4)));
-    } lightBlock;
-
-    lightBlock.lightCount = scene->lightCount;
-    for (size_t i = 0; i < scene->lightCount; i++)
-    {
-        lightBlock.lights[i] = AllignedLight(scene->lights[i]);
-    }
-
     // TODO: add directional light to scene file
-
-    lightBlock.directionalLight = AllignedDirectionalLight(*getSun());
-
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(lightBlock), &lightBlock);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    scene->lightClusters.setLights(scene->lights, *getSun());
 
     // scene->root->print();
 
     // sort render layers
     std::sort(scene->renderLayers.begin(), scene->renderLayers.end(),
               [](RenderLayerPtr a, RenderLayerPtr b) { return a->getID() < b->getID(); });
+    scene->renderGraph.compile(scene->renderLayers);
+
+    // whatever the driver hasn't finished yet, waiting on it is the only time compiles cost the load
+    auto waitStart = std::chrono::steady_clock::now();
+    for (const ShaderProgramPtr &shader : pendingShaders)
+    {
+        shader->finalize();
+    }
+    auto loadEnd = std::chrono::steady_clock::now();
+
+    using ms = std::chrono::duration<f32, std::milli>;
+    std::cout << "Loaded scene " << sceneName << " in " << ms(loadEnd - loadStart).count() << " ms ("
+              << ms(loadEnd - waitStart).count() << " ms waiting on shaders)" << std::endl;
 
     return scene;
 }
@@ -539,89 +610,37 @@ void Scene::Start()
 {
     EngineGlobals::camera = sceneCamera;
 
-    // glBindBuffer(GL_UNIFORM_BUFFER, EngineGlobals::clearVelocitySSBOID);
-    // glClearNamedBufferData(EngineGlobals::clearVelocitySSBOID, GL_RG32F, GL_RG, GL_FLOAT,
-    //                        EngineGlobals::clearVelocitySSBO.data());
-
     root->Start();
     root->LateStart();
 }
 
 void Scene::Update()
 {
-    // ShaderProgramPtr shadowMapShader = shaders["shadowMap"];
-    // if (shadowMapShader)
-    // {
-    //     shadowMapShader->use();
-    //     auto sun = getSun();
-    //     if (sun)
-    //     {
-    //         shadowMapShader->setUniform(UNIFORM_LOCATIONS::LIGHT_SPACE_MATRIX, sun->getLightSpaceMatrix());
-
-    //         sun->bind();
-
-    //         root->drawShadowMap();
-
-    //         sun->unbind();
-
-    //         static bool first = true;
-    //         if (first)
-    //         {
-    //             first = false;
-    //             sun->saveShadowMapToPPM("shadowMap.ppm");
-    //         }
-    //     }
-    // }
     auto meshManager = getMeshManager();
 
     InputManager::stepCallback(EngineGlobals::window, EngineGlobals::deltaTime);
 
+    // the size this frame is rendered at, before anything sized on it is updated
+    renderGraph.beginFrame();
+
     root->EarlyUpdate();
     root->Update();
 
-    // fbos[0]->bind();
-    // glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    // meshManager->Update(RenderLayer::DEFAULT);
-    // if (sceneSkybox)
-    // {
-    //     sceneSkybox->draw();
-    // }
-    // fbos[0]->blit(fbos[1]);
-    // fbos[0]->blit(GL_DEPTH_BUFFER_BIT);
-    // fbos[0]->unbind();
-
-    // fbos[1]->bind();
-    // glActiveTexture(GL_TEXTURE0 + 16);
-    // fbos[0]->bindTexture();
-    // meshManager->Update(renderLayers[1]);
-    // fbos[1]->blit(GL_COLOR_BUFFER_BIT);
-    // fbos[1]->unbind();
-
-    // // static bool first = true;
-    // // if (first)
-    // // {
-    // //     first = false;
-    // //     fbo->drawToPPM("fbo.ppm");
-    // //     fbo2->drawToPPM("fbo2.ppm");
-    // // }
-
-    // glDepthMask(GL_FALSE);
-    // meshManager->Update(renderLayers[2]);
-    // glDepthMask(GL_TRUE);
-
-    // meshManager->Update(renderLayers[3]);
-
-    for (auto &layer : renderLayers)
-    {
-        layer->render();
-        static bool first = true;
-        if (first)
-        {
-            fbos[0]->drawToPPM("fbo_0.ppm");
-            fbos[1]->drawToPPM("fbo_1.ppm");
-            first = false;
-        }
-    }
+    // light lists for this frame's camera, every lit shader reads them
+    lightClusters.update(EngineGlobals::getViewMatrix(), EngineGlobals::projectionMatrix);
+    // without the jitter of the upsampler, it would move the cascades every frame
+    getCascadedShadowMap().update(EngineGlobals::getViewMatrix(), getDynamicResolution().getUnjitteredProjection(),
+                                  getSun()->direction);
+
+    renderGraph.execute(renderLayers);
+
+    // back to the screen with the default pipeline state for whatever draws after the layers
+    GLState &gl = getGLState();
+    gl.bindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl.setViewport(0, 0, EngineGlobals::windowSize.x, EngineGlobals::windowSize.y);
+    gl.setDepthMask(true);
+    gl.setCapability(GL_DEPTH_TEST, true);
+    gl.setCapability(GL_CULL_FACE, true);
 
     root->LateUpdate();
     FixedUpdateWrapper();
@@ -1,6 +1,12 @@
 #include "shader.hpp"
+#include "GLState.hpp"
+#include "programCache.hpp"
+#include "shaderPreprocessor.hpp"
 #include "texture.hpp"
 
+#include <algorithm>
+#include <unordered_map>
+
 Shader::~Shader()
 {
 
@@ -29,6 +35,10 @@ Shader::Shader(std::string filename)
     {
         Shader(filename, ShaderType::GEOMETRY);
     }
+    else if (extension.compare("comp") == 0)
+    {
+        Shader(filename, ShaderType::COMPUTE);
+    }
     else
     {
         std::cerr << "Shader " << stripPath(filename)
@@ -53,6 +63,10 @@ ShaderPtr Shader::load(std::string filename)
     {
         return load(filename, ShaderType::GEOMETRY);
     }
+    else if (extension.compare("comp") == 0)
+    {
+        return load(filename, ShaderType::COMPUTE);
+    }
     else
     {
         std::cerr << "Shader " << stripPath(filename)
@@ -80,9 +94,12 @@ Shader::Shader(std::string filename, ShaderType _type)
     case ShaderType::GEOMETRY:
         this->typeID = GL_GEOMETRY_SHADER;
         break;
+    case ShaderType::COMPUTE:
+        this->typeID = GL_COMPUTE_SHADER;
+        break;
     default:
         std::cerr << "Invalid type provided for shader " << this->shaderName
-                  << ", (expected VERTEX or FRAGMENT or GEOMETRY).\n";
+                  << ", (expected VERTEX or FRAGMENT or GEOMETRY or COMPUTE).\n";
         exit(EXIT_FAILURE);
     }
 
@@ -96,38 +113,15 @@ ShaderPtr Shader::load(std::string filename, ShaderType _type)
     return shader;
 }
 
-std::string getFileContent(std::string filename)
+void Shader::preprocess(const std::vector<std::string> &defines)
 {
-    std::string output;
-    std::ifstream file(filename, std::ios::in);
-    if (!file.is_open())
-    {
-        std::cerr << "Could not open file " << filename << "\n";
-        exit(EXIT_FAILURE);
-    }
-
-    // parse content of shader file for #include directives
-    std::string line;
-    while (std::getline(file, line))
+    // resolve the #include directives, the included files come out of the preprocessor's cache
+    if (this->source.empty())
     {
-        // check if line is a #include directive
-        if (line.length() > 10 && line[0] == '#' && *(u64 *)(line.data() + 1) == *(u64 *)("include "))
-        {
-            constexpr char includePath[] = "shader/";
-            // extract filename from #include directive
-            std::string includeFilename = includePath + line.substr(10, line.size() - 11);
-
-            // std::cout << "Including file " << includeFilename << "\n";
-
-            output.append(getFileContent(includeFilename));
-        }
-        else
-        {
-            output.append(line + "\n");
-        }
+        PreprocessedShader preprocessed = getShaderPreprocessor().process(this->path, defines);
+        this->source = std::move(preprocessed.source);
+        this->sourceFiles = std::move(preprocessed.files);
     }
-
-    return output;
 }
 
 void Shader::compile()
@@ -139,34 +133,16 @@ void Shader::compile()
         exit(EXIT_FAILURE);
     }
 
-    // read shader file
-    // const size_t readSize = 4096;
-    std::ifstream file(this->path, std::ios::in);
-    if (!file.is_open())
-    {
-        std::cerr << "Could not open file " << this->path << "\n";
-        exit(EXIT_FAILURE);
-    }
-
-    // std::string buf = std::string(readSize, '\0');
-    // while (file.read(&buf[0], readSize))
-    // {
-    //     this->source.append(buf, 0, file.gcount());
-    // }
-    // this->source.append(buf, 0, file.gcount());
-
-    // parse content of shader file for #include directives
-    this->source = getFileContent(this->path);
-
-    // std::cout << "Shader Constructor: successfully read the content of " << this->shaderName << ".\n";
-
     // source shader from extracted content
     const GLchar *source = (const GLchar *)this->source.c_str();
     glShaderSource(this->ID, 1, &source, 0);
 
-    // compile shader
+    // compile shader, the driver may do it in the background, checkCompiled waits for it
     glCompileShader(this->ID);
+}
 
+void Shader::checkCompiled()
+{
     // check if shader compiled correctly
     glGetShaderiv(this->ID, GL_COMPILE_STATUS, (int *)&this->_isCompiled);
     if (this->_isCompiled == GL_FALSE)
@@ -188,6 +164,9 @@ void Shader::compile()
         for (auto c : infoLog)
             std::cerr << c;
         std::cerr << "\n";
+        // the first number of the log lines is the source string, one per file
+        for (u32 i = 0; i < this->sourceFiles.size(); i++)
+            std::cerr << i << ": " << this->sourceFiles[i] << "\n";
 
         // goodbye
         exit(EXIT_FAILURE);
@@ -207,6 +186,8 @@ std::string Shader::getType()
         return "FRAGMENT";
     case ShaderType::GEOMETRY:
         return "GEOMETRY";
+    case ShaderType::COMPUTE:
+        return "COMPUTE";
     default:
         return "INVALID TYPE";
     }
@@ -219,7 +200,9 @@ void Shader::_delete()
     this->ID = SHADER_NULL;
 }
 
-ShaderProgram::ShaderProgram(std::string vertPath, std::string fragPath, bool hasAccesstoFramebuffers)
+ShaderProgram::ShaderProgram(std::string vertPath, std::string fragPath, bool hasAccesstoFramebuffers,
+                             const std::vector<std::string> &defines)
+    : defines(defines)
 {
     // load shaders
     this->vert = Shader::load(vertPath, ShaderType::VERTEX);
@@ -229,20 +212,13 @@ ShaderProgram::ShaderProgram(std::string vertPath, std::string fragPath, bool ha
 
     this->ID = glCreateProgram();
 
-    // compile shaders
-    link();
-
-    if (this->hasAccesstoFramebuffers)
-    {
-        for (int i = 0; i < FBO_N; i++)
-        {
-            setUniform(UNIFORM_LOCATIONS::FRAMEBUFFER0 + i, 16 + i);
-        }
-    }
+    // compile shaders, the program finishes linking on first use or on finalize
+    submit();
 }
 
 ShaderProgram::ShaderProgram(std::string vertPath, std::string fragPath, std::string geomPath,
-                             bool hasAccesstoFramebuffers)
+                             bool hasAccesstoFramebuffers, const std::vector<std::string> &defines)
+    : defines(defines)
 {
     // load shaders
     this->vert = Shader::load(vertPath, ShaderType::VERTEX);
@@ -253,19 +229,35 @@ ShaderProgram::ShaderProgram(std::string vertPath, std::string fragPath, std::st
 
     this->ID = glCreateProgram();
 
-    // compile shaders
-    link();
+    // compile shaders, the program finishes linking on first use or on finalize
+    submit();
+}
 
-    if (this->hasAccesstoFramebuffers)
-    {
-        for (int i = 0; i < FBO_N; i++)
-        {
-            setUniform(UNIFORM_LOCATIONS::FRAMEBUFFER0 + i, 16 + i);
-        }
-    }
+ShaderProgram::ShaderProgram(std::string compPath, const std::vector<std::string> &defines) : defines(defines)
+{
+    this->comp = Shader::load(compPath, ShaderType::COMPUTE);
+
+    this->ID = glCreateProgram();
+
+    submit();
+}
+
+void ShaderProgram::enableParallelCompile()
+{
+    // let the driver spread compiles over as many threads as it likes
+    if (GLEW_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xffffffff);
+    else if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xffffffff);
 }
 
 void ShaderProgram::link()
+{
+    submit();
+    finalize();
+}
+
+void ShaderProgram::submit()
 {
 
     if (this->ID == PROGRAM_NULL)
@@ -274,24 +266,86 @@ void ShaderProgram::link()
         exit(EXIT_FAILURE);
     }
 
+    // a program is either vert + frag (+ geom) or a lone compute shader
+    Shader *shaders[] = {this->vert.get(), this->frag.get(), this->geom.get(), this->comp.get()};
+
+    // keyed on the sources with their includes resolved, editing an included file invalidates too,
+    // the file is named after the stages and defines so every permutation gets its own
+    std::vector<std::string> sources;
+    this->cachePaths.clear();
+    for (Shader *shader : shaders)
+    {
+        if (shader)
+        {
+            shader->preprocess(this->defines);
+            this->cachePaths.push_back(shader->path);
+            sources.push_back(shader->source);
+        }
+    }
+    this->cachePaths.insert(this->cachePaths.end(), this->defines.begin(), this->defines.end());
+
+    ProgramCache &cache = getProgramCache();
+    this->cacheKey = cache.key(sources);
+    if (cache.load(this->ID, this->cachePaths, this->cacheKey))
+    {
+        this->_isLinked = GL_TRUE;
+        for (Shader *shader : shaders)
+        {
+            if (shader)
+                shader->_delete();
+        }
+        onLinked();
+        return;
+    }
+
     // compile shaders
-    this->vert->compile();
-    this->frag->compile();
-    if (this->geom)
+    for (Shader *shader : shaders)
     {
-        this->geom->compile();
+        if (shader)
+            shader->compile();
     }
 
     // attach shaders
-    glAttachShader(this->ID, this->vert->getID());
-    glAttachShader(this->ID, this->frag->getID());
-    if (this->geom)
+    for (Shader *shader : shaders)
     {
-        glAttachShader(this->ID, this->geom->getID());
+        if (shader)
+            glAttachShader(this->ID, shader->getID());
     }
 
-    // link program
+    // link program, no status query here, it would wait for the driver
+    cache.prepare(this->ID);
     glLinkProgram(this->ID);
+    this->pending = true;
+}
+
+bool ShaderProgram::isReady()
+{
+    if (!this->pending)
+        return true;
+
+    // without the extension there is no way to ask without waiting
+    if (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile)
+        return false;
+
+    GLint completed = GL_FALSE;
+    glGetProgramiv(this->ID, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+}
+
+void ShaderProgram::finalize()
+{
+    if (!this->pending)
+        return;
+    this->pending = false;
+
+    Shader *shaders[] = {this->vert.get(), this->frag.get(), this->geom.get(), this->comp.get()};
+
+    // compile errors first, they say more than the link error that follows them
+    for (Shader *shader : shaders)
+    {
+        if (shader)
+            shader->checkCompiled();
+    }
 
     // check if program is linked
     glGetProgramiv(this->ID, GL_LINK_STATUS, (int *)&this->_isLinked);
@@ -308,11 +362,10 @@ void ShaderProgram::link()
 
         // delete program and shaders
         this->_delete();
-        this->vert->_delete();
-        this->frag->_delete();
-        if (this->geom)
+        for (Shader *shader : shaders)
         {
-            this->geom->_delete();
+            if (shader)
+                shader->_delete();
         }
 
         // print info log
@@ -326,29 +379,42 @@ void ShaderProgram::link()
     }
 
     // detach shaders
-    glDetachShader(this->ID, this->vert->getID());
-    glDetachShader(this->ID, this->frag->getID());
-    if (this->geom)
-    {
-        glDetachShader(this->ID, this->geom->getID());
-    }
-    this->vert->_delete();
-    this->frag->_delete();
-    if (this->geom)
+    for (Shader *shader : shaders)
     {
-        this->geom->_delete();
+        if (shader)
+        {
+            glDetachShader(this->ID, shader->getID());
+            shader->_delete();
+        }
     }
 
+    getProgramCache().store(this->ID, this->cachePaths, this->cacheKey);
+
+    onLinked();
+
     // std::cout << "Successfully linked program ID " << this->ID << ".\n";
 }
 
+void ShaderProgram::onLinked()
+{
+    if (this->hasAccesstoFramebuffers)
+    {
+        for (int i = 0; i < FBO_N; i++)
+        {
+            setUniform(UNIFORM_LOCATIONS::FRAMEBUFFER0 + i, 16 + i);
+        }
+    }
+}
+
 void ShaderProgram::use()
 {
 
+    finalize();
+
     if (this->ID != PROGRAM_NULL && this->_isLinked == GL_TRUE)
     {
 
-        glUseProgram(this->ID);
+        getGLState().useProgram(this->ID);
     }
     else
     {
@@ -361,7 +427,37 @@ void ShaderProgram::use()
 void ShaderProgram::stop()
 {
 
-    glUseProgram(0);
+    getGLState().useProgram(0);
+}
+
+void ShaderProgram::setTextureUnits(u32 count)
+{
+    // sampler uniforms are program state, they only need to be written once per unit
+    for (u32 i = textureUnitsSet; i < count; i++)
+    {
+        setUniform(UNIFORM_LOCATIONS::TEXTURE0 + i, (i32)i);
+    }
+    textureUnitsSet = std::max(textureUnitsSet, count);
+}
+
+void ShaderProgram::setTextureLayer(u32 unit, i32 layer)
+{
+    if (textureLayers.size() <= unit)
+        textureLayers.resize(unit + 1, -1);
+    if (textureLayers[unit] == layer)
+        return;
+    setUniform(UNIFORM_LOCATIONS::TEXTURE_LAYER0 + unit, (f32)layer);
+    textureLayers[unit] = layer;
+}
+
+bool ShaderProgram::hasDefine(const std::string &name) const
+{
+    for (const std::string &define : defines)
+    {
+        if (define.compare(0, name.size(), name) == 0 && (define.size() == name.size() || define[name.size()] == '='))
+            return true;
+    }
+    return false;
 }
 
 ShaderProgram::~ShaderProgram()
@@ -371,6 +467,7 @@ ShaderProgram::~ShaderProgram()
     {
 
         glDeleteProgram(this->ID);
+        getGLState().programDeleted(this->ID);
     }
 }
 
@@ -378,12 +475,13 @@ void ShaderProgram::_delete()
 {
 
     glDeleteProgram(this->ID);
+    getGLState().programDeleted(this->ID);
     this->ID = PROGRAM_NULL;
 }
 
 void ShaderProgram::setUniform(i32 location, const mat4 &value)
 {
-
+    finalize();
     if (this->ID != PROGRAM_NULL && this->_isLinked == GL_TRUE)
     {
         use();
@@ -399,6 +497,7 @@ void ShaderProgram::setUniform(i32 location, const mat4 &value)
 
 void ShaderProgram::setUniform(i32 location, const vec3 &value)
 {
+    finalize();
     if (this->ID != PROGRAM_NULL && this->_isLinked == GL_TRUE)
     {
         use();
@@ -414,6 +513,7 @@ void ShaderProgram::setUniform(i32 location, const vec3 &value)
 
 void ShaderProgram::setUniform(i32 location, const vec2 &value)
 {
+    finalize();
     if (this->ID != PROGRAM_NULL && this->_isLinked == GL_TRUE)
     {
         use();
@@ -429,6 +529,7 @@ void ShaderProgram::setUniform(i32 location, const vec2 &value)
 
 void ShaderProgram::setUniform(i32 location, const vec4 &value)
 {
+    finalize();
     if (this->ID != PROGRAM_NULL && this->_isLinked == GL_TRUE)
     {
         use();
@@ -442,8 +543,25 @@ void ShaderProgram::setUniform(i32 location, const vec4 &value)
     }
 }
 
+void ShaderProgram::setUniform(i32 location, const ivec2 &value)
+{
+    finalize();
+    if (this->ID != PROGRAM_NULL && this->_isLinked == GL_TRUE)
+    {
+        use();
+        glUniform2iv(location, 1, &value[0]);
+    }
+    else
+    {
+
+        std::cerr << "Can't set uniform for non initalized/linked shader program.\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
 void ShaderProgram::setUniform(i32 location, const f32 &value)
 {
+    finalize();
     if (this->ID != PROGRAM_NULL && this->_isLinked == GL_TRUE)
     {
         use();
@@ -459,6 +577,7 @@ void ShaderProgram::setUniform(i32 location, const f32 &value)
 
 void ShaderProgram::setUniform(i32 location, const i32 &value)
 {
+    finalize();
     if (this->ID != PROGRAM_NULL && this->_isLinked == GL_TRUE)
     {
         use();
@@ -474,6 +593,7 @@ void ShaderProgram::setUniform(i32 location, const i32 &value)
 
 void ShaderProgram::setUniform(i32 location, const u32 &value)
 {
+    finalize();
     if (this->ID != PROGRAM_NULL && this->_isLinked == GL_TRUE)
     {
         use();
@@ -486,9 +606,25 @@ void ShaderProgram::setUniform(i32 location, const u32 &value)
     }
 }
 
-ShaderProgramPtr newShaderProgram(std::string vertPath, std::string fragPath, bool hasAccesstoFramebuffers)
+ShaderProgramPtr newShaderProgram(std::string vertPath, std::string fragPath, bool hasAccesstoFramebuffers,
+                                  const std::vector<std::string> &defines)
 {
-    return std::make_shared<ShaderProgram>(vertPath, fragPath, hasAccesstoFramebuffers);
+    // one program per variant, whoever asks for the same one again shares it while it is alive
+    static std::unordered_map<std::string, std::weak_ptr<ShaderProgram>> registry;
+
+    std::string key = vertPath + "|" + fragPath + (hasAccesstoFramebuffers ? "|fbo" : "");
+    for (const std::string &define : defines)
+    {
+        key += "|" + define;
+    }
+
+    ShaderProgramPtr program = registry[key].lock();
+    if (!program)
+    {
+        program = std::make_shared<ShaderProgram>(vertPath, fragPath, hasAccesstoFramebuffers, defines);
+        registry[key] = program;
+    }
+    return program;
 }
 
 ShaderProgramPtr newShaderProgram()
@@ -0,0 +1,133 @@
+#include "shaderPreprocessor.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+// directive name of a line ("include", "pragma", ...) and what follows it, false if it isn't one
+bool parseDirective(const std::string &line, std::string &name, std::string &argument)
+{
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] != '#')
+        return false;
+
+    size_t nameStart = line.find_first_not_of(" \t", start + 1);
+    if (nameStart == std::string::npos)
+        return false;
+    size_t nameEnd = line.find_first_of(" \t", nameStart);
+    name = line.substr(nameStart, nameEnd - nameStart);
+
+    size_t argumentStart = nameEnd == std::string::npos ? std::string::npos : line.find_first_not_of(" \t", nameEnd);
+    argument = argumentStart == std::string::npos ? "" : line.substr(argumentStart);
+    while (!argument.empty() && (argument.back() == ' ' || argument.back() == '\t' || argument.back() == '\r'))
+        argument.pop_back();
+    return true;
+}
+} // namespace
+
+ShaderPreprocessor &getShaderPreprocessor()
+{
+    static ShaderPreprocessor preprocessor;
+    return preprocessor;
+}
+
+const ShaderPreprocessor::File &ShaderPreprocessor::getFile(const std::string &path)
+{
+    auto it = files.find(path);
+    if (it != files.end())
+        return it->second;
+
+    std::ifstream stream(path, std::ios::in);
+    if (!stream.is_open())
+    {
+        std::cerr << "Could not open file " << path << "\n";
+        exit(EXIT_FAILURE);
+    }
+
+    File file;
+    std::string line;
+    std::string name, argument;
+    while (std::getline(stream, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (parseDirective(line, name, argument) && name == "pragma" && argument == "once")
+        {
+            // not glsl, blanked so the line numbers don't move
+            file.once = true;
+            line.clear();
+        }
+        file.lines.push_back(line);
+    }
+
+    return files.emplace(path, std::move(file)).first->second;
+}
+
+void ShaderPreprocessor::expand(const std::string &path, std::vector<std::string> &included,
+                                PreprocessedShader &output, const std::vector<std::string> &defines)
+{
+    const File &file = getFile(path);
+    if (file.once)
+    {
+        if (std::find(included.begin(), included.end(), path) != included.end())
+            return;
+        included.push_back(path);
+    }
+
+    u32 sourceIndex = output.files.size();
+    output.files.push_back(path);
+    bool root = sourceIndex == 0;
+    // nothing but comments may come before #version, the root file only gets its #line after it
+    if (!root)
+        output.source += "#line 1 " + std::to_string(sourceIndex) + "\n";
+
+    std::string name, argument;
+    for (u32 i = 0; i < file.lines.size(); i++)
+    {
+        const std::string &line = file.lines[i];
+        if (!parseDirective(line, name, argument))
+        {
+            output.source += line + "\n";
+            continue;
+        }
+
+        if (name == "include")
+        {
+            if (argument.size() < 2 || (argument.front() != '"' && argument.front() != '<'))
+            {
+                std::cerr << "Malformed #include in " << path << " line " << i + 1 << "\n";
+                exit(EXIT_FAILURE);
+            }
+            expand(includeDirectory + argument.substr(1, argument.size() - 2), included, output, defines);
+            // back to this file, at the line after the #include
+            output.source += "#line " + std::to_string(i + 2) + " " + std::to_string(sourceIndex) + "\n";
+        }
+        else if (name == "version" && root)
+        {
+            output.source += line + "\n";
+            for (const std::string &define : defines)
+            {
+                size_t equal = define.find('=');
+                if (equal == std::string::npos)
+                    output.source += "#define " + define + "\n";
+                else
+                    output.source += "#define " + define.substr(0, equal) + " " + define.substr(equal + 1) + "\n";
+            }
+            output.source += "#line " + std::to_string(i + 2) + " 0\n";
+        }
+        else
+        {
+            output.source += line + "\n";
+        }
+    }
+}
+
+PreprocessedShader ShaderPreprocessor::process(const std::string &path, const std::vector<std::string> &defines)
+{
+    PreprocessedShader output;
+    std::vector<std::string> included;
+    expand(path, included, output, defines);
+    return output;
+}
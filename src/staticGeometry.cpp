@@ -0,0 +1,317 @@
+#include "staticGeometry.hpp"
+#include "GLState.hpp"
+#include "mesh.hpp"
+#include "occlusionCulling.hpp"
+#include "ringBuffer.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+StaticGeometry::~StaticGeometry()
+{
+    deleteBuffers();
+}
+
+void StaticGeometry::deleteBuffers()
+{
+    if (vaoID)
+    {
+        glDeleteVertexArrays(1, &vaoID);
+        getGLState().vertexArrayDeleted(vaoID);
+        vaoID = 0;
+    }
+
+    GLuint buffers[] = {positionBufferID, normalBufferID, uvBufferID, indexBufferID};
+    glDeleteBuffers(4, buffers);
+    positionBufferID = normalBufferID = uvBufferID = indexBufferID = 0;
+}
+
+bool StaticGeometry::isCompatible(const Mesh &mesh)
+{
+    return !mesh.wireframe && !mesh.indices.empty() && !mesh.vertices.empty() &&
+           mesh.normals.size() == mesh.vertices.size() && mesh.uvs.size() == mesh.vertices.size();
+}
+
+void StaticGeometry::build(const std::vector<MeshPtr> &meshes)
+{
+    dirty = false;
+    version++;
+    deleteBuffers();
+    ranges.clear();
+    buckets.clear();
+
+    // indices stay local to the meshes (baseVertex does the offsetting) so the biggest mesh decides
+    // the index size. Positions are only quantized if every mesh asked for it
+    u32 maxVertexCount = 0;
+    bool quantize = true;
+    for (const MeshPtr &mesh : meshes)
+    {
+        if (!mesh->isStatic())
+            continue;
+
+        maxVertexCount = max(maxVertexCount, (u32)mesh->vertices.size());
+        quantize = quantize && mesh->packed.format.quantizedPositions;
+    }
+    format = VertexFormat::choose(maxVertexCount, quantize);
+
+    std::vector<u8> positions;
+    std::vector<u8> normals;
+    std::vector<u8> uvs;
+    std::vector<u8> indices;
+    u32 vertexCount = 0;
+    u32 indexCount = 0;
+    u64 floatSize = 0;
+
+    for (const MeshPtr &mesh : meshes)
+    {
+        if (!mesh->isStatic())
+            continue;
+
+        const std::vector<uivec3> &meshIndices = mesh->clusters.empty() ? mesh->indices : mesh->lodIndices;
+        PackedVertices packed(format, meshIndices, mesh->vertices, mesh->normals, mesh->uvs);
+
+        ranges.push_back({mesh, indexCount, packed.indexCount, (i32)vertexCount, mesh->getBoundingSphere(),
+                          packed.positionScale, packed.positionOffset});
+
+        positions.insert(positions.end(), packed.positions.begin(), packed.positions.end());
+        normals.insert(normals.end(), packed.normals.begin(), packed.normals.end());
+        uvs.insert(uvs.end(), packed.uvs.begin(), packed.uvs.end());
+        indices.insert(indices.end(), packed.indices.begin(), packed.indices.end());
+        vertexCount += packed.vertexCount;
+        indexCount += packed.indexCount;
+        floatSize += packed.vertexCount * (sizeof(vec3) * 2 + sizeof(vec2)) + packed.indexCount * sizeof(u32);
+    }
+
+    if (ranges.empty())
+        return;
+
+    std::cout << "Static geometry: " << vertexCount << " vertices, " << indexCount / 3 << " triangles, "
+              << (positions.size() + normals.size() + uvs.size() + indices.size()) / 1024 << " KB ("
+              << floatSize / 1024 << " KB unpacked)\n";
+
+    // never written again, immutable storage lets the driver keep it in video memory
+    glCreateBuffers(1, &positionBufferID);
+    glNamedBufferStorage(positionBufferID, positions.size(), positions.data(), 0);
+    glCreateBuffers(1, &normalBufferID);
+    glNamedBufferStorage(normalBufferID, normals.size(), normals.data(), 0);
+    glCreateBuffers(1, &uvBufferID);
+    glNamedBufferStorage(uvBufferID, uvs.size(), uvs.data(), 0);
+    glCreateBuffers(1, &indexBufferID);
+    glNamedBufferStorage(indexBufferID, indices.size(), indices.data(), 0);
+
+    // same attribute locations as the meshes built from files
+    glCreateVertexArrays(1, &vaoID);
+    GLuint buffers[] = {positionBufferID, normalBufferID, uvBufferID};
+    std::array<VertexAttribute, 3> attributes = format.getAttributes();
+    for (GLuint location = 0; location < 3; location++)
+    {
+        const VertexAttribute &attribute = attributes[location];
+        glEnableVertexArrayAttrib(vaoID, location);
+        glVertexArrayVertexBuffer(vaoID, location, buffers[location], 0, attribute.stride);
+        glVertexArrayAttribFormat(vaoID, location, attribute.components, attribute.type, attribute.normalized, 0);
+        glVertexArrayAttribBinding(vaoID, location, location);
+    }
+    glVertexArrayElementBuffer(vaoID, indexBufferID);
+
+    for (u32 i = 0; i < ranges.size(); i++)
+    {
+        const MeshPtr &mesh = ranges[i].mesh;
+        u32 layerID = mesh->getRenderLayer()->getID();
+        MaterialParams *params = mesh->getParams();
+        auto it = std::find_if(buckets.begin(), buckets.end(), [&](const Bucket &bucket) {
+            return bucket.material == mesh->getMaterial() && bucket.params == params && bucket.layerID == layerID;
+        });
+        if (it == buckets.end())
+        {
+            buckets.push_back({mesh->getMaterial(), params, layerID, {}});
+            it = buckets.end() - 1;
+        }
+        it->ranges.push_back(i);
+    }
+}
+
+void StaticGeometry::draw(const RenderLayerPtr &renderLayer)
+{
+    if (!vaoID)
+        return;
+
+    using namespace EngineGlobals;
+    GLState &gl = getGLState();
+    DrawDataBuffer &drawData = getDrawDataBuffer();
+    DrawCuller &culler = getDrawCuller();
+    OcclusionCuller &occlusion = getOcclusionCuller();
+
+    // enabled meshes of the layer, sorted inside their bucket. With one multi-draw per bucket the
+    // order can't be exact across buckets, they go by their first mesh (and opaque ones by state)
+    RenderQueue::SortMode sortMode = renderLayer->getSortMode();
+    mat4 view = getViewMatrix();
+    std::vector<Bucket *> layerBuckets;
+    std::vector<u32> bucketStart;
+    sortedRanges.clear();
+    bucketQueue.clear();
+    for (Bucket &bucket : buckets)
+    {
+        if (bucket.layerID != renderLayer->getID())
+            continue;
+
+        rangeQueue.clear();
+        enabledRanges.clear();
+        rangeDepths.clear();
+        for (u32 i : bucket.ranges)
+        {
+            const Range &range = ranges[i];
+            if (!range.mesh->getGameObject()->getEnabled())
+                continue;
+
+            mat4 model = range.mesh->getGameObject()->getObjectMatrix();
+            vec3 boxMin, boxMax;
+            range.mesh->getBoundingBox(boxMin, boxMax);
+            if (!occlusion.isVisible(model, boxMin, boxMax))
+                continue;
+
+            range.mesh->requestTextureMips(view, model);
+            f32 depth = range.mesh->getViewDepth(view, model);
+            enabledRanges.push_back(i);
+            rangeDepths.push_back(depth);
+            rangeQueue.push(depth);
+        }
+
+        if (enabledRanges.empty())
+            continue;
+
+        const std::vector<u32> &order = rangeQueue.sort(sortMode);
+        bucketQueue.push(rangeDepths[order[0]], bucket.material->getStateKey());
+        bucketStart.push_back(sortedRanges.size());
+        for (u32 i : order)
+        {
+            sortedRanges.push_back(enabledRanges[i]);
+        }
+        layerBuckets.push_back(&bucket);
+    }
+    bucketStart.push_back(sortedRanges.size());
+
+    // Draw IDs of a bucket are consecutive and gl_BaseInstance + gl_DrawID finds them back,
+    // whatever gets culled in between
+    candidates.clear();
+    models.clear();
+    std::vector<Bucket *> drawBuckets;
+    std::vector<u32> bucketFirst;
+    for (u32 b : bucketQueue.sort(sortMode))
+    {
+        u32 first = candidates.size();
+        for (u32 k = bucketStart[b]; k < bucketStart[b + 1]; k++)
+        {
+            const Range &range = ranges[sortedRanges[k]];
+            Mesh &mesh = *range.mesh;
+            mat4 model = mesh.getGameObject()->getObjectMatrix();
+            DrawData data = mesh.makeDrawData(model);
+            data.positionScale = range.positionScale;
+            data.positionOffset = range.positionOffset;
+
+            if (mesh.clusters.empty())
+            {
+                u32 drawID = drawData.push(data);
+                candidates.push_back({range.sphere, range.indexCount, range.firstIndex, range.baseVertex, drawID,
+                                      (u32)drawBuckets.size(), first, (u32)candidates.size() - first, 0});
+                models.push_back(model);
+                continue;
+            }
+
+            // a candidate per cluster, culled on its own sphere and at its own level. Every slot
+            // needs its own draw data for gl_DrawID to find
+            for (u32 c = 0; c < mesh.clusters.size(); c++)
+            {
+                const MeshLOD &lod = mesh.clusters[c].lods[mesh.selectLOD(model, c)];
+                u32 drawID = drawData.push(data);
+                candidates.push_back({mesh.clusters[c].sphere, lod.indexCount, range.firstIndex + lod.firstIndex,
+                                      range.baseVertex, drawID, (u32)drawBuckets.size(), first,
+                                      (u32)candidates.size() - first, 0});
+                models.push_back(model);
+            }
+        }
+
+        drawBuckets.push_back(layerBuckets[b]);
+        bucketFirst.push_back(first);
+    }
+
+    if (candidates.empty())
+        return;
+
+    if (culler.mode != DrawCuller::OFF)
+    {
+        // compaction order depends on the atomics, blended layers keep every slot to stay sorted
+        culler.cull(candidates, drawBuckets.size(), projectionMatrix * view, models,
+                    sortMode == RenderQueue::BACK_TO_FRONT);
+    }
+
+    for (u32 b = 0; b < drawBuckets.size(); b++)
+    {
+        Bucket &bucket = *drawBuckets[b];
+        u32 first = bucketFirst[b];
+        u32 count = (b + 1 < bucketFirst.size() ? bucketFirst[b + 1] : candidates.size()) - first;
+
+        gl.setPolygonMode(GL_FILL);
+        bucket.material->use();
+        bucket.params->bind();
+        Mesh::setViewUniforms(bucket.material->getShader());
+        gl.bindVertexArray(vaoID);
+
+        if (culler.mode != DrawCuller::OFF)
+        {
+            culler.drawBucket(b, first, count, format.indexType);
+        }
+        else
+        {
+            commands.clear();
+            for (u32 i = first; i < first + count; i++)
+            {
+                const CullCandidate &c = candidates[i];
+                commands.push_back({c.count, 1, c.firstIndex, c.baseVertex, c.drawID - c.slot});
+            }
+
+            u64 offset = drawData.pushCommands(commands.data(), commands.size());
+            glMultiDrawElementsIndirect(GL_TRIANGLES, format.indexType, (void *)offset, commands.size(), 0);
+        }
+
+        bucket.material->stop();
+    }
+}
+
+void StaticGeometry::drawShadowCasters(const std::array<vec4, 6> &planes)
+{
+    if (!vaoID)
+        return;
+
+    DrawDataBuffer &drawData = getDrawDataBuffer();
+
+    // every caster in a single multi-draw, their draw IDs are consecutive from the first one
+    commands.clear();
+    u32 firstDrawID = 0;
+    for (const Range &range : ranges)
+    {
+        Mesh &mesh = *range.mesh;
+        if (!mesh.getCastShadows() || !mesh.getRenderLayer()->getDepthTest() || !mesh.getGameObject()->getEnabled())
+            continue;
+
+        mat4 model = mesh.getGameObject()->getObjectMatrix();
+        if (!DrawCuller::isVisible(planes, model, range.sphere))
+            continue;
+
+        // no previous MVP to roll over, nothing reads velocities in the depth pass
+        u32 drawID = drawData.push({model, mat4(1.0f), mesh.getMaterialOverride(), range.positionScale,
+                                    range.positionOffset});
+        if (commands.empty())
+            firstDrawID = drawID;
+
+        // the finest level of every cluster is the start of the range
+        u32 indexCount = mesh.clusters.empty() ? range.indexCount : mesh.getFullIndexCount();
+        commands.push_back({indexCount, 1, range.firstIndex, range.baseVertex, firstDrawID});
+    }
+
+    if (commands.empty())
+        return;
+
+    getGLState().bindVertexArray(vaoID);
+    u64 offset = drawData.pushCommands(commands.data(), commands.size());
+    glMultiDrawElementsIndirect(GL_TRIANGLES, format.indexType, (void *)offset, commands.size(), 0);
+}
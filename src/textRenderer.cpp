@@ -37,8 +37,9 @@ void TextRenderer::LateUpdate()
 {
     //// Render text
     // Activate corresponding render state
+    GLState &gl = getGLState();
     shader->use();
-    glActiveTexture(GL_TEXTURE0);
+    gl.activeTexture(0);
     shader->setUniform(UNIFORM_LOCATIONS::FONT_COLOR, params.solidColor);
     shader->setUniform(UNIFORM_LOCATIONS::FONT_BACKGROUND_COLOR, params.backgroundColor);
     shader->setUniform(UNIFORM_LOCATIONS::FONT_BOLD, params.bold);
@@ -47,8 +48,9 @@ void TextRenderer::LateUpdate()
     shader->setUniform(UNIFORM_LOCATIONS::FONT_STRIKETHROUGH, params.strikethrough);
     shader->setUniform(UNIFORM_LOCATIONS::FONT_OUTLINE, params.outline);
     shader->setUniform(UNIFORM_LOCATIONS::TIME, (float)glfwGetTime());
-    glBindVertexArray(VAO);
-    glDepthMask(GL_FALSE);
+    gl.bindVertexArray(VAO);
+    gl.setDepthMask(false);
+    gl.setPolygonMode(GL_FILL);
 
     // Get the font
     FontPtr font = params.font;
@@ -315,7 +317,7 @@ void TextRenderer::LateUpdate()
         };
 
         // Render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, glyph.TextureID);
+        gl.bindTexture(GL_TEXTURE_2D, glyph.TextureID);
         // Update content of VBO memory
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
@@ -329,9 +331,7 @@ void TextRenderer::LateUpdate()
         displayCharCounter++;
     }
 
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glDepthMask(GL_TRUE);
+    gl.setDepthMask(true);
 }
 
 std::vector<std::string> strSplit(std::string str, std::string delim)
@@ -1,64 +1,570 @@
 #include "texture.hpp"
+#include "bakedTexture.hpp"
 #include "inputManager.hpp"
+#include "mappedFile.hpp"
+#include "mipStreamer.hpp"
+#include "threadPool.hpp"
 
-void Texture::genTexture()
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+// header of a mapped .btex whose level table and data fit in the file, null otherwise
+const BakedTexture::Header *validateBaked(const MappedFile &file, const std::string &bakedPath)
 {
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    if (!file.isOpen() || file.size() < sizeof(BakedTexture::Header))
+    {
+        std::cerr << "Can't map " << bakedPath << std::endl;
+        return nullptr;
+    }
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const BakedTexture::Header *header = (const BakedTexture::Header *)file.data();
+    const BakedTexture::Level *levelTable = (const BakedTexture::Level *)(file.data() + sizeof(*header));
+    bool valid = header->magic == BakedTexture::MAGIC && header->version == BakedTexture::VERSION &&
+                 header->levelCount > 0 &&
+                 sizeof(*header) + header->levelCount * sizeof(BakedTexture::Level) <= file.size();
+    for (u32 i = 0; valid && i < header->levelCount; i++)
+    {
+        valid = levelTable[i].offset + levelTable[i].size <= file.size();
+    }
+    if (!valid)
+    {
+        std::cerr << bakedPath << " isn't a baked texture of this version, run make bake-textures" << std::endl;
+        return nullptr;
+    }
+    return header;
+}
+
+void setSampling(GLuint textureID)
+{
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+} // namespace
+
+GLuint getPlaceholderTexture()
+{
+    // mid grey, lit surfaces still read as surfaces while their textures stream in
+    static GLuint placeholderID = 0;
+    if (!placeholderID)
+    {
+        const u8 grey[4] = {128, 128, 128, 255};
+        glCreateTextures(GL_TEXTURE_2D, 1, &placeholderID);
+        glTextureStorage2D(placeholderID, 1, GL_RGBA8, 1, 1);
+        glTextureSubImage2D(placeholderID, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    }
+    return placeholderID;
+}
 
+GLenum Texture::internalFormat(i32 nrChannels)
+{
     switch (nrChannels)
     {
     case 1:
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-        break;
+        return GL_R8;
+    case 2:
+        return GL_RG8;
     case 3:
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        break;
-    case 4:
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        break;
+        return GL_RGB8;
     default:
+        return GL_RGBA8;
+    }
+}
+
+GLenum Texture::pixelFormat(i32 nrChannels)
+{
+    switch (nrChannels)
+    {
+    case 1:
+        return GL_RED;
+    case 2:
+        return GL_RG;
+    case 3:
+        return GL_RGB;
+    default:
+        return GL_RGBA;
+    }
+}
+
+i32 Texture::levelCount(i32 width, i32 height)
+{
+    i32 levels = 1;
+    while ((std::max(width, height) >> levels) > 0)
+        levels++;
+    return levels;
+}
+
+void Texture::genTexture()
+{
+    if (nrChannels < 1 || nrChannels > 4)
+    {
         std::cerr << "Unsupported number of channels: " << nrChannels << std::endl;
-        std::cerr << "Program will probably crash" << std::endl;
-        break;
+        return;
+    }
+
+    // immutable storage up front, the streamer only fills level 0 and the mips get generated
+    format = internalFormat(nrChannels);
+    levels = levelCount(width, height);
+    glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+    glTextureStorage2D(textureID, levels, format, width, height);
+    setSampling(textureID);
+}
+
+bool Texture::loadBaked(const std::string &path)
+{
+    std::string bakedFile = BakedTexture::bakedPath(path);
+    std::error_code error, sourceError;
+    if (!std::filesystem::exists(bakedFile, error))
+        return false;
+
+    // a baked file alone is fine, one older than its source isn't
+    auto bakedTime = std::filesystem::last_write_time(bakedFile, error);
+    auto sourceTime = std::filesystem::last_write_time(path, sourceError);
+    if (!error && !sourceError && bakedTime < sourceTime)
+    {
+        std::cerr << bakedFile << " is older than " << path << ", run make bake-textures" << std::endl;
+        return false;
+    }
+
+    MappedFile file(bakedFile);
+    const BakedTexture::Header *header = validateBaked(file, bakedFile);
+    if (!header)
+        return false;
+
+    bool s3tc = header->format == BakedTexture::FORMAT_BC1 || header->format == BakedTexture::FORMAT_BC3;
+    if (s3tc && !GLEW_EXT_texture_compression_s3tc)
+    {
+        std::cerr << "No S3TC support, " << path << " is loaded from its source" << std::endl;
+        return false;
     }
 
-    glGenerateMipmap(GL_TEXTURE_2D);
+    width = header->width;
+    height = header->height;
+    nrChannels = header->channels;
+    format = header->format;
+    levels = header->levelCount;
+    compressed = true;
+    bakedPath = bakedFile;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // only the small levels to start with, the mip streamer brings the others in when they're seen
+    MipStreamer &mipStreamer = getMipStreamer();
+    streamed = mipStreamer.enabled;
+    baseLevel = streamed ? mipStreamer.initialLevel(*this) : 0;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // straight from the mapping, the driver copies the blocks as they are
+    const BakedTexture::Level *levelTable = (const BakedTexture::Level *)(file.data() + sizeof(*header));
+    glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+    glTextureStorage2D(textureID, levels - baseLevel, format, levelTable[baseLevel].width,
+                       levelTable[baseLevel].height);
+    for (i32 level = baseLevel; level < levels; level++)
+    {
+        const BakedTexture::Level &entry = levelTable[level];
+        glCompressedTextureSubImage2D(textureID, level - baseLevel, 0, 0, entry.width, entry.height, format,
+                                      entry.size, file.data() + entry.offset);
+    }
+    setSampling(textureID);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    resident = true;
+    return true;
 }
 
-CubeMapPtr loadCubeMap(std::array<std::string, 6> faces_filenames)
+void Texture::setBaseLevel(i32 level)
 {
-    return std::make_shared<CubeMap>(faces_filenames);
+    level = std::clamp(level, 0, levels - 1);
+    if (level == baseLevel || bakedPath.empty())
+        return;
+
+    const BakedTexture::Level *levelTable = nullptr;
+    MappedFile file(bakedPath);
+    if (level < baseLevel)
+    {
+        const BakedTexture::Header *header = validateBaked(file, bakedPath);
+        if (!header || (i32)header->levelCount != levels || header->format != format)
+        {
+            std::cerr << bakedPath << " changed since it was loaded, keeping the levels in memory" << std::endl;
+            return;
+        }
+        levelTable = (const BakedTexture::Level *)(file.data() + sizeof(*header));
+    }
+
+    // a new texture holding levels from level on, the shaders don't see the difference with normalized uvs
+    GLuint newID;
+    glCreateTextures(GL_TEXTURE_2D, 1, &newID);
+    glTextureStorage2D(newID, levels - level, format, std::max(width >> level, 1), std::max(height >> level, 1));
+
+    // the finer levels come from the file, the ones both have are copied on the GPU
+    for (i32 l = level; l < baseLevel; l++)
+    {
+        const BakedTexture::Level &entry = levelTable[l];
+        glCompressedTextureSubImage2D(newID, l - level, 0, 0, entry.width, entry.height, format, entry.size,
+                                      file.data() + entry.offset);
+    }
+    for (i32 l = std::max(level, baseLevel); l < levels; l++)
+    {
+        glCopyImageSubData(textureID, GL_TEXTURE_2D, l - baseLevel, 0, 0, 0, newID, GL_TEXTURE_2D, l - level, 0, 0, 0,
+                           std::max(width >> l, 1), std::max(height >> l, 1), 1);
+    }
+    setSampling(newID);
+
+    glDeleteTextures(1, &textureID);
+    getGLState().textureDeleted(textureID);
+    textureID = newID;
+    baseLevel = level;
 }
-CubeMapPtr loadCubeMap(std::string filename)
+
+void Texture::pinLevels()
 {
-    return std::make_shared<CubeMap>(filename);
+    setBaseLevel(0);
+    streamed = false;
 }
 
-std::array<FBOPtr, 8> fbos;
+u64 Texture::residentBytes(i32 fromLevel)
+{
+    u64 bytes = 0;
+    for (i32 l = std::max(fromLevel, 0); l < levels; l++)
+    {
+        u64 w = std::max(width >> l, 1), h = std::max(height >> l, 1);
+        if (compressed)
+            bytes += ((w + 3) / 4) * ((h + 3) / 4) * BakedTexture::blockSize(format);
+        else
+            bytes += w * h * nrChannels;
+    }
+    return bytes;
+}
+
+void Texture::onUploaded(u8 *pixels)
+{
+    glGenerateTextureMipmap(textureID);
+    resident = true;
+
+    if (array)
+        array->copyLayer(layer, *this);
+
+    if (keepData)
+        data = pixels;
+    else
+        stbi_image_free(pixels);
+}
 
-void initializeFBOs()
+TextureArray::TextureArray(const std::vector<TexturePtr> &textures)
 {
-    for (size_t i = 0; i < fbos.size(); i++)
+    width = textures[0]->getWidth();
+    height = textures[0]->getHeight();
+    format = textures[0]->getFormat();
+    layerCount = textures.size();
+    levelCount = textures[0]->getLevelCount();
+
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &textureID);
+    glTextureStorage3D(textureID, levelCount, format, width, height, layerCount);
+
+    // same grey as the placeholder until the layers are copied in, compressed ones can't be cleared
+    // but baked textures are resident from the start anyway
+    if (!textures[0]->isCompressed())
     {
-        fbos[i] = std::make_shared<FBO>(EngineGlobals::windowSize.x, EngineGlobals::windowSize.y);
+        const u8 grey[4] = {128, 128, 128, 255};
+        for (i32 level = 0; level < levelCount; level++)
+        {
+            glClearTexImage(textureID, level, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        }
     }
 
-    InputManager::addWindowSizeCallback([](GLFWwindow *window, i32 width, i32 height) {
-        // might break everything or might not idk
-        for (size_t i = 0; i < fbos.size(); i++)
+    for (i32 i = 0; i < layerCount; i++)
+    {
+        if (textures[i]->isResident())
+            copyLayer(i, *textures[i]);
+    }
+
+    // same sampling as the 2D textures
+    setSampling(textureID);
+}
+
+TextureArray::~TextureArray()
+{
+    glDeleteTextures(1, &textureID);
+    getGLState().textureDeleted(textureID);
+}
+
+void TextureArray::copyLayer(i32 layer, Texture &texture)
+{
+    if (texture.getWidth() != width || texture.getHeight() != height || texture.getFormat() != format ||
+        texture.getLevelCount() != levelCount)
+    {
+        std::cerr << "Texture " << texture.getName() << " doesn't match the size or format of its array" << std::endl;
+        return;
+    }
+
+    for (i32 level = 0; level < levelCount; level++)
+    {
+        glCopyImageSubData(texture.getTextureID(), GL_TEXTURE_2D, level, 0, 0, 0, textureID, GL_TEXTURE_2D_ARRAY, level,
+                           0, 0, layer, std::max(width >> level, 1), std::max(height >> level, 1), 1);
+    }
+}
+
+namespace
+{
+constexpr u32 CUBE_CACHE_MAGIC = 0x45425543; // "CUBE"
+constexpr u32 CUBE_CACHE_VERSION = 1;
+
+// followed by every level, the 6 faces of a level packed one after the other
+struct CubeCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 size;
+    u32 nrChannels;
+    u32 levels;
+    u32 padding;
+};
+
+// fnv-1a
+u64 hashBytes(u64 h, const void *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        h ^= ((const u8 *)data)[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+constexpr u64 FNV_OFFSET = 0xcbf29ce484222325ull;
+
+u64 cubeLevelBytes(i32 size, i32 nrChannels, i32 level)
+{
+    u64 levelSize = std::max(size >> level, 1);
+    return levelSize * levelSize * nrChannels * 6;
+}
+} // namespace
+
+bool CubeMap::loadCached(const std::vector<std::string> &sources)
+{
+    // named after the sources, the key changes with their content on disk
+    u64 nameHash = FNV_OFFSET;
+    cacheKey = FNV_OFFSET;
+    for (const std::string &source : sources)
+    {
+        nameHash = hashBytes(nameHash, source.data(), source.size() + 1);
+
+        std::error_code error;
+        u64 fileSize = std::filesystem::file_size(source, error);
+        auto writeTime = std::filesystem::last_write_time(source, error).time_since_epoch().count();
+        cacheKey = hashBytes(cacheKey, &fileSize, sizeof(fileSize));
+        cacheKey = hashBytes(cacheKey, &writeTime, sizeof(writeTime));
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cube", (unsigned long long)nameHash);
+    cachePath = cacheDirectory + "/" + name;
+
+    MappedFile file(cachePath);
+    if (!file.isOpen() || file.size() < sizeof(CubeCacheHeader))
+        return false;
+
+    // stale entries are left in place, the rebuilt cube map overwrites them
+    const CubeCacheHeader &header = *(const CubeCacheHeader *)file.data();
+    if (header.magic != CUBE_CACHE_MAGIC || header.version != CUBE_CACHE_VERSION || header.key != cacheKey)
+        return false;
+    if (header.size == 0 || header.size > 16384 || header.nrChannels < 1 || header.nrChannels > 4 ||
+        (i32)header.levels != Texture::levelCount(header.size, header.size))
+        return false;
+
+    u64 total = sizeof(header);
+    for (u32 level = 0; level < header.levels; level++)
+    {
+        total += cubeLevelBytes(header.size, header.nrChannels, level);
+    }
+    if (total > file.size())
+        return false;
+
+    allocate(header.size, header.nrChannels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const u8 *data = file.data() + sizeof(header);
+    for (i32 level = 0; level < levels; level++)
+    {
+        i32 levelSize = std::max(size >> level, 1);
+        glTextureSubImage3D(textureID, level, 0, 0, 0, levelSize, levelSize, 6, Texture::pixelFormat(nrChannels),
+                            GL_UNSIGNED_BYTE, data);
+        data += cubeLevelBytes(size, nrChannels, level);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    return true;
+}
+
+void CubeMap::allocate(i32 faceSize, i32 channels)
+{
+    size = faceSize;
+    nrChannels = channels;
+    levels = Texture::levelCount(size, size);
+
+    glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &textureID);
+    glTextureStorage2D(textureID, levels, Texture::internalFormat(nrChannels), size, size);
+
+    glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
+void CubeMap::finish()
+{
+    glGenerateTextureMipmap(textureID);
+
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    if (error)
+    {
+        std::cerr << "Cube map cache: can't create " << cacheDirectory << ": " << error.message() << std::endl;
+        return;
+    }
+
+    // read back once, the next runs skip decoding and mip generation
+    std::vector<u8> pixels;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    std::string tmpPath = cachePath + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
         {
-            fbos[i] = std::make_shared<FBO>(width, height);
+            std::cerr << "Cube map cache: can't open " << tmpPath << std::endl;
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            return;
         }
+
+        CubeCacheHeader header = {CUBE_CACHE_MAGIC, CUBE_CACHE_VERSION, cacheKey, (u32)size, (u32)nrChannels,
+                                  (u32)levels, 0};
+        file.write((const char *)&header, sizeof(header));
+        for (i32 level = 0; level < levels; level++)
+        {
+            pixels.resize(cubeLevelBytes(size, nrChannels, level));
+            glGetTextureImage(textureID, level, Texture::pixelFormat(nrChannels), GL_UNSIGNED_BYTE, pixels.size(),
+                              pixels.data());
+            file.write((const char *)pixels.data(), pixels.size());
+        }
+        if (!file)
+            std::cerr << "Cube map cache: can't write " << tmpPath << std::endl;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    std::filesystem::rename(tmpPath, cachePath, error);
+    if (error)
+        std::cerr << "Cube map cache: can't write " << cachePath << ": " << error.message() << std::endl;
+}
+
+CubeMap::CubeMap(std::array<std::string, 6> faces_filenames)
+{
+    if (loadCached(std::vector<std::string>(faces_filenames.begin(), faces_filenames.end())))
+        return;
+
+    struct Face
+    {
+        u8 *pixels;
+        i32 width, height, nrChannels;
+    };
+    std::array<Face, 6> faces = {};
+
+    // stb_image keeps no state between loads, the six decodes run side by side
+    getThreadPool().parallelFor(6, [&](u32 i) {
+        Face &face = faces[i];
+        face.pixels = stbi_load(faces_filenames[i].c_str(), &face.width, &face.height, &face.nrChannels, 0);
     });
+
+    // the first face that loaded gives the size and format, the others have to match it
+    const Face *reference = nullptr;
+    for (const Face &face : faces)
+    {
+        if (face.pixels)
+        {
+            reference = &face;
+            break;
+        }
+    }
+
+    if (reference)
+    {
+        allocate(reference->width, reference->nrChannels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (u32 i = 0; i < 6; i++)
+        {
+            const Face &face = faces[i];
+            if (!face.pixels)
+                std::cerr << "Cubemap texture failed to load at path: " << faces_filenames[i] << std::endl;
+            else if (face.width != size || face.height != size || face.nrChannels != nrChannels)
+                std::cerr << "Cubemap face " << faces_filenames[i] << " doesn't match the other faces" << std::endl;
+            else
+                glTextureSubImage3D(textureID, 0, 0, 0, i, size, size, 1, Texture::pixelFormat(nrChannels),
+                                    GL_UNSIGNED_BYTE, face.pixels);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    else
+    {
+        std::cerr << "Cubemap failed to load, no face could be read" << std::endl;
+    }
+
+    for (Face &face : faces)
+    {
+        stbi_image_free(face.pixels);
+    }
+
+    if (reference)
+        finish();
+}
+
+CubeMap::CubeMap(std::string filename)
+{
+    if (loadCached({filename}))
+        return;
+
+    i32 width, height, channels;
+    u8 *pixels = stbi_load(filename.c_str(), &width, &height, &channels, 0);
+    if (!pixels)
+    {
+        std::cerr << "Cubemap texture failed to load at path: " << filename << std::endl;
+        return;
+    }
+
+    // horizontal cross: top, then left front right back, then bottom
+    i32 faceSize = width / 4;
+    if (faceSize == 0 || width != faceSize * 4 || height != faceSize * 3)
+    {
+        // the skip offsets would send the upload past the end of the image
+        std::cerr << "Cubemap " << filename << " isn't a 4x3 cross of square faces" << std::endl;
+        stbi_image_free(pixels);
+        return;
+    }
+    const ivec2 origins[6] = {{1, 1}, {3, 1}, {1, 0}, {1, 2}, {2, 1}, {0, 1}};
+
+    // each face read in place from the cross, the unpack state points at its rectangle
+    allocate(faceSize, channels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+    for (u32 i = 0; i < 6; i++)
+    {
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, origins[i].x * faceSize);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, origins[i].y * faceSize);
+        glTextureSubImage3D(textureID, 0, 0, 0, i, faceSize, faceSize, 1, Texture::pixelFormat(nrChannels),
+                            GL_UNSIGNED_BYTE, pixels);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    stbi_image_free(pixels);
+    finish();
+}
+
+CubeMapPtr loadCubeMap(std::array<std::string, 6> faces_filenames)
+{
+    return std::make_shared<CubeMap>(faces_filenames);
+}
+CubeMapPtr loadCubeMap(std::string filename)
+{
+    return std::make_shared<CubeMap>(filename);
 }
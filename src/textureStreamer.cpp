@@ -0,0 +1,204 @@
+#include "textureStreamer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+TextureStreamer &getTextureStreamer()
+{
+    // decoding is the slow part, a couple of threads keep a scene load from trickling in
+    static TextureStreamer textureStreamer(std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u));
+    return textureStreamer;
+}
+
+TextureStreamer::TextureStreamer(u32 decoderCount)
+{
+    for (u32 i = 0; i < decoderCount; i++)
+    {
+        decoders.emplace_back([this] { decoderLoop(); });
+    }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+        requests.clear();
+    }
+    wake.notify_all();
+    for (std::thread &decoder : decoders)
+    {
+        decoder.join();
+    }
+
+    for (Decoded &item : decoded)
+    {
+        stbi_image_free(item.pixels);
+    }
+    for (Decoded &item : ready)
+    {
+        stbi_image_free(item.pixels);
+    }
+
+    for (Staging &slot : ring)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (slot.bufferID)
+        {
+            glUnmapNamedBuffer(slot.bufferID);
+            glDeleteBuffers(1, &slot.bufferID);
+        }
+    }
+}
+
+void TextureStreamer::request(TexturePtr texture, const std::string &path)
+{
+    // the header couldn't be read, or the texture was baked and is already in
+    if (!texture->getTextureID() || texture->isResident())
+        return;
+
+    pending++;
+    {
+        std::lock_guard lock(mutex);
+        requests.push_back({std::move(texture), path});
+    }
+    wake.notify_one();
+}
+
+void TextureStreamer::decoderLoop()
+{
+    std::unique_lock lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [&] { return stopping || !requests.empty(); });
+        if (stopping)
+            return;
+
+        Request request = std::move(requests.front());
+        requests.pop_front();
+        lock.unlock();
+
+        // forced to the channel count of the header, the storage was allocated with it
+        Decoded item;
+        i32 channels;
+        item.pixels = stbi_load(request.path.c_str(), &item.width, &item.height, &channels,
+                                request.texture->getNrChannels());
+        item.texture = std::move(request.texture);
+        item.path = std::move(request.path);
+
+        // handed over under the lock, the texture is never released on this thread
+        lock.lock();
+        decoded.push_back(std::move(item));
+    }
+}
+
+TextureStreamer::Staging *TextureStreamer::acquire(u64 bytes)
+{
+    Staging &slot = ring[next];
+    if (slot.fence)
+    {
+        GLenum result = glClientWaitSync(slot.fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+            return nullptr;
+        if (result == GL_WAIT_FAILED)
+            std::cerr << "Texture streamer fence wait failed.\n";
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
+
+    if (slot.size < bytes)
+    {
+        if (slot.bufferID)
+        {
+            glUnmapNamedBuffer(slot.bufferID);
+            glDeleteBuffers(1, &slot.bufferID);
+        }
+        u64 size = std::max(bytes, INITIAL_STAGING_SIZE);
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &slot.bufferID);
+        glNamedBufferStorage(slot.bufferID, size, nullptr, flags);
+        slot.mapped = (u8 *)glMapNamedBufferRange(slot.bufferID, 0, size, flags);
+        slot.size = size;
+    }
+    return &slot;
+}
+
+void TextureStreamer::beginFrame()
+{
+    {
+        std::lock_guard lock(mutex);
+        while (!decoded.empty())
+        {
+            ready.push_back(std::move(decoded.front()));
+            decoded.pop_front();
+        }
+    }
+    if (ready.empty())
+        return;
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point start = clock::now();
+    Staging *slot = nullptr;
+    u64 offset = 0;
+    u32 count = 0;
+    while (!ready.empty())
+    {
+        Decoded &item = ready.front();
+        Texture &texture = *item.texture;
+
+        bool failed = !item.pixels || item.width != texture.getWidth() || item.height != texture.getHeight();
+        if (failed)
+            std::cerr << "Failed to load texture at path: " << item.path << std::endl;
+        // or nothing holds it anymore, no point uploading
+        if (failed || item.texture.use_count() == 1)
+        {
+            stbi_image_free(item.pixels);
+            ready.pop_front();
+            pending--;
+            continue;
+        }
+
+        if (count > 0 && std::chrono::duration<f32, std::milli>(clock::now() - start).count() > budgetMs)
+            break;
+
+        u64 bytes = (u64)item.width * item.height * texture.getNrChannels();
+        if (!slot)
+        {
+            slot = acquire(bytes);
+            if (!slot)
+            {
+                busyFrames++;
+                break;
+            }
+        }
+        else if (offset + bytes > slot->size)
+        {
+            break;
+        }
+
+        memcpy(slot->mapped + offset, item.pixels, bytes);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->bufferID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTextureSubImage2D(texture.getTextureID(), 0, 0, 0, item.width, item.height,
+                            Texture::pixelFormat(texture.getNrChannels()), GL_UNSIGNED_BYTE, (const void *)offset);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        // the pixels were copied to the staging buffer, the texture frees them unless it keeps them
+        texture.onUploaded(item.pixels);
+
+        offset = (offset + bytes + 15) / 16 * 16;
+        ready.pop_front();
+        pending--;
+        uploaded++;
+        count++;
+    }
+
+    if (slot)
+    {
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        next = (next + 1) % RING_N;
+    }
+}
@@ -0,0 +1,87 @@
+#include "threadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool &getThreadPool()
+{
+    static ThreadPool threadPool(std::clamp(std::thread::hardware_concurrency(), 2u, 8u) - 1);
+    return threadPool;
+}
+
+ThreadPool::ThreadPool(u32 threadCount)
+{
+    for (u32 i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::runJobs()
+{
+    for (u32 i = next.fetch_add(1); i < jobCount; i = next.fetch_add(1))
+    {
+        (*job)(i);
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    u64 seen = 0;
+    std::unique_lock lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping)
+            return;
+
+        // a late wake up can land in a newer loop than the one it was woken for, that's fine
+        seen = generation;
+        active++;
+        lock.unlock();
+        runJobs();
+        lock.lock();
+        if (--active == 0)
+            done.notify_all();
+    }
+}
+
+void ThreadPool::parallelFor(u32 count, const std::function<void(u32)> &fn)
+{
+    if (count <= 1 || workers.empty())
+    {
+        for (u32 i = 0; i < count; i++)
+        {
+            fn(i);
+        }
+        return;
+    }
+
+    {
+        std::unique_lock lock(mutex);
+        // stragglers of the previous loop still read job and jobCount
+        done.wait(lock, [&] { return active == 0; });
+        job = &fn;
+        jobCount = count;
+        next = 0;
+        generation++;
+    }
+    wake.notify_all();
+
+    runJobs();
+
+    std::unique_lock lock(mutex);
+    done.wait(lock, [&] { return active == 0; });
+}
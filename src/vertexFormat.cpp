@@ -0,0 +1,114 @@
+#include "vertexFormat.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <cstring>
+
+std::array<VertexAttribute, 3> VertexFormat::getAttributes() const
+{
+    // quantized positions get a 4th component so every vertex stays 4 byte aligned
+    VertexAttribute position = quantizedPositions ? VertexAttribute{3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(u16)}
+                                                  : VertexAttribute{3, GL_FLOAT, GL_FALSE, sizeof(vec3)};
+    VertexAttribute normal = packedNormals ? VertexAttribute{4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(u32)}
+                                           : VertexAttribute{3, GL_FLOAT, GL_FALSE, sizeof(vec3)};
+    VertexAttribute uv = halfUVs ? VertexAttribute{2, GL_HALF_FLOAT, GL_FALSE, sizeof(u32)}
+                                 : VertexAttribute{2, GL_FLOAT, GL_FALSE, sizeof(vec2)};
+    return {position, normal, uv};
+}
+
+VertexFormat VertexFormat::choose(u32 vertexCount, bool quantizePositions)
+{
+    VertexFormat format;
+    format.indexType = vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    format.quantizedPositions = quantizePositions;
+    return format;
+}
+
+PackedVertices::PackedVertices(const VertexFormat &_format, const std::vector<uivec3> &_indices,
+                               const std::vector<vec3> &vertices, const std::vector<vec3> &_normals,
+                               const std::vector<vec2> &_uvs)
+    : format(_format), vertexCount(vertices.size())
+{
+    if (format.quantizedPositions && !vertices.empty())
+    {
+        vec3 boxMin = vertices[0];
+        vec3 boxMax = vertices[0];
+        for (const vec3 &v : vertices)
+        {
+            boxMin = min(boxMin, v);
+            boxMax = max(boxMax, v);
+        }
+        vec3 extent = max(boxMax - boxMin, vec3(1e-6f));
+        positionScale = vec4(extent, 1.0f);
+        positionOffset = vec4(boxMin, 0.0f);
+
+        positions.resize(vertices.size() * 4 * sizeof(u16));
+        u16 *quantized = (u16 *)positions.data();
+        for (const vec3 &v : vertices)
+        {
+            vec3 q = round(clamp((v - boxMin) / extent, 0.0f, 1.0f) * 65535.0f);
+            *quantized++ = (u16)q.x;
+            *quantized++ = (u16)q.y;
+            *quantized++ = (u16)q.z;
+            *quantized++ = 0;
+        }
+    }
+    else
+    {
+        positions.resize(vertices.size() * sizeof(vec3));
+        memcpy(positions.data(), vertices.data(), positions.size());
+    }
+
+    if (format.packedNormals)
+    {
+        normals.resize(_normals.size() * sizeof(u32));
+        u32 *packed = (u32 *)normals.data();
+        for (const vec3 &n : _normals)
+        {
+            *packed++ = packSnorm3x10_1x2(vec4(n, 0.0f));
+        }
+    }
+    else
+    {
+        normals.resize(_normals.size() * sizeof(vec3));
+        memcpy(normals.data(), _normals.data(), normals.size());
+    }
+
+    if (format.halfUVs)
+    {
+        uvs.resize(_uvs.size() * sizeof(u32));
+        u32 *packed = (u32 *)uvs.data();
+        for (const vec2 &uv : _uvs)
+        {
+            *packed++ = packHalf2x16(uv);
+        }
+    }
+    else
+    {
+        uvs.resize(_uvs.size() * sizeof(vec2));
+        memcpy(uvs.data(), _uvs.data(), uvs.size());
+    }
+
+    setIndices(_indices);
+}
+
+void PackedVertices::setIndices(const std::vector<uivec3> &_indices)
+{
+    indexCount = _indices.size() * 3;
+    if (format.indexType == GL_UNSIGNED_SHORT)
+    {
+        indices.resize(indexCount * sizeof(u16));
+        u16 *packed = (u16 *)indices.data();
+        for (const uivec3 &tri : _indices)
+        {
+            *packed++ = (u16)tri.x;
+            *packed++ = (u16)tri.y;
+            *packed++ = (u16)tri.z;
+        }
+    }
+    else
+    {
+        indices.resize(indexCount * sizeof(u32));
+        memcpy(indices.data(), _indices.data(), indices.size());
+    }
+}
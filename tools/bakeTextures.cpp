@@ -0,0 +1,377 @@
+// Offline texture baking, see include/bakedTexture.hpp for the format. Built and run over res/ by
+// make bake-textures, or by hand: bakeTextures [-f] images...
+// Images whose .btex is newer than them are skipped unless -f is given.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bakedTexture.hpp"
+#include "stb_image.h"
+#include "typedef.hpp"
+
+namespace
+{
+struct Level
+{
+    u32 width, height;
+    std::vector<u8> pixels; // channels interleaved, like stb_image gives them
+};
+
+// 2x2 box filter, the last row/column is reused for odd sizes
+Level downsample(const Level &level, u32 channels)
+{
+    Level result;
+    result.width = std::max(level.width / 2, 1u);
+    result.height = std::max(level.height / 2, 1u);
+    result.pixels.resize(result.width * result.height * channels);
+    for (u32 y = 0; y < result.height; y++)
+    {
+        for (u32 x = 0; x < result.width; x++)
+        {
+            u32 x0 = std::min(x * 2, level.width - 1), x1 = std::min(x * 2 + 1, level.width - 1);
+            u32 y0 = std::min(y * 2, level.height - 1), y1 = std::min(y * 2 + 1, level.height - 1);
+            for (u32 c = 0; c < channels; c++)
+            {
+                u32 sum = level.pixels[(y0 * level.width + x0) * channels + c] +
+                          level.pixels[(y0 * level.width + x1) * channels + c] +
+                          level.pixels[(y1 * level.width + x0) * channels + c] +
+                          level.pixels[(y1 * level.width + x1) * channels + c];
+                result.pixels[(y * result.width + x) * channels + c] = (u8)((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+// 4x4 texels starting at (bx, by), edges clamped, always 4 channels (missing ones are 0/255)
+void fetchBlock(const Level &level, u32 channels, u32 bx, u32 by, u8 block[16][4])
+{
+    for (u32 i = 0; i < 16; i++)
+    {
+        u32 x = std::min(bx + i % 4, level.width - 1);
+        u32 y = std::min(by + i / 4, level.height - 1);
+        const u8 *texel = &level.pixels[(y * level.width + x) * channels];
+        for (u32 c = 0; c < 4; c++)
+        {
+            block[i][c] = c < channels ? texel[c] : (c == 3 ? 255 : 0);
+        }
+    }
+}
+
+u16 to565(const f32 color[3])
+{
+    u32 r = (u32)std::clamp(std::lround(color[0] * 31.0f / 255.0f), 0l, 31l);
+    u32 g = (u32)std::clamp(std::lround(color[1] * 63.0f / 255.0f), 0l, 63l);
+    u32 b = (u32)std::clamp(std::lround(color[2] * 31.0f / 255.0f), 0l, 31l);
+    return (u16)(r << 11 | g << 5 | b);
+}
+
+void from565(u16 color, i32 out[3])
+{
+    i32 r = color >> 11 & 31, g = color >> 5 & 63, b = color & 31;
+    out[0] = r << 3 | r >> 2;
+    out[1] = g << 2 | g >> 4;
+    out[2] = b << 3 | b >> 2;
+}
+
+// endpoints along the principal axis of the colors, the four color mode only
+void encodeBC1(const u8 block[16][4], u8 *out)
+{
+    f32 mean[3] = {};
+    for (u32 i = 0; i < 16; i++)
+    {
+        for (u32 c = 0; c < 3; c++)
+            mean[c] += block[i][c] / 16.0f;
+    }
+
+    f32 cov[6] = {}; // rr rg rb gg gb bb
+    for (u32 i = 0; i < 16; i++)
+    {
+        f32 d[3] = {block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2]};
+        cov[0] += d[0] * d[0];
+        cov[1] += d[0] * d[1];
+        cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1];
+        cov[4] += d[1] * d[2];
+        cov[5] += d[2] * d[2];
+    }
+
+    // a few power iterations are plenty for a 3x3
+    f32 axis[3] = {1.0f, 1.0f, 1.0f};
+    for (u32 iteration = 0; iteration < 8; iteration++)
+    {
+        f32 next[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                       cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                       cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+        f32 length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f)
+            break;
+        for (u32 c = 0; c < 3; c++)
+            axis[c] = next[c] / length;
+    }
+
+    f32 minT = 1e9f, maxT = -1e9f;
+    for (u32 i = 0; i < 16; i++)
+    {
+        f32 t = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] +
+                (block[i][2] - mean[2]) * axis[2];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+
+    f32 end0[3], end1[3];
+    for (u32 c = 0; c < 3; c++)
+    {
+        end0[c] = mean[c] + axis[c] * maxT;
+        end1[c] = mean[c] + axis[c] * minT;
+    }
+    u16 color0 = to565(end0), color1 = to565(end1);
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    i32 palette[4][3];
+    from565(color0, palette[0]);
+    from565(color1, palette[1]);
+    for (u32 c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    u32 indices = 0;
+    if (color0 != color1)
+    {
+        for (u32 i = 0; i < 16; i++)
+        {
+            u32 best = 0;
+            i32 bestDistance = INT32_MAX;
+            for (u32 p = 0; p < 4; p++)
+            {
+                i32 dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+                i32 distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+    }
+
+    memcpy(out, &color0, 2);
+    memcpy(out + 2, &color1, 2);
+    memcpy(out + 4, &indices, 4);
+}
+
+// one channel, eight value mode between the min and max
+void encodeBC4(const u8 block[16][4], u32 channel, u8 *out)
+{
+    u8 maxValue = 0, minValue = 255;
+    for (u32 i = 0; i < 16; i++)
+    {
+        maxValue = std::max(maxValue, block[i][channel]);
+        minValue = std::min(minValue, block[i][channel]);
+    }
+
+    i32 palette[8] = {maxValue, minValue};
+    for (i32 p = 2; p < 8; p++)
+    {
+        palette[p] = ((8 - p) * maxValue + (p - 1) * minValue + 3) / 7;
+    }
+
+    u64 indices = 0;
+    if (maxValue != minValue)
+    {
+        for (u32 i = 0; i < 16; i++)
+        {
+            u64 best = 0;
+            i32 bestDistance = INT32_MAX;
+            for (u32 p = 0; p < 8; p++)
+            {
+                i32 distance = std::abs(block[i][channel] - palette[p]);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (i * 3);
+        }
+    }
+
+    out[0] = maxValue;
+    out[1] = minValue;
+    for (u32 b = 0; b < 6; b++)
+    {
+        out[2 + b] = (u8)(indices >> (b * 8));
+    }
+}
+
+std::vector<u8> encode(const Level &level, u32 channels, u32 format)
+{
+    u32 blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+    u32 blockSize = BakedTexture::blockSize(format);
+    std::vector<u8> data(blocksX * blocksY * blockSize);
+
+    u8 block[16][4];
+    for (u32 by = 0; by < blocksY; by++)
+    {
+        for (u32 bx = 0; bx < blocksX; bx++)
+        {
+            fetchBlock(level, channels, bx * 4, by * 4, block);
+            u8 *out = &data[(by * blocksX + bx) * blockSize];
+            switch (format)
+            {
+            case BakedTexture::FORMAT_BC1:
+                encodeBC1(block, out);
+                break;
+            case BakedTexture::FORMAT_BC3:
+                encodeBC4(block, 3, out);
+                encodeBC1(block, out + 8);
+                break;
+            case BakedTexture::FORMAT_BC4:
+                encodeBC4(block, 0, out);
+                break;
+            case BakedTexture::FORMAT_BC5:
+                encodeBC4(block, 0, out);
+                encodeBC4(block, 1, out + 8);
+                break;
+            }
+        }
+    }
+    return data;
+}
+
+const char *formatName(u32 format)
+{
+    switch (format)
+    {
+    case BakedTexture::FORMAT_BC1:
+        return "BC1";
+    case BakedTexture::FORMAT_BC3:
+        return "BC3";
+    case BakedTexture::FORMAT_BC4:
+        return "BC4";
+    default:
+        return "BC5";
+    }
+}
+
+bool bake(const std::string &path, const std::string &outPath)
+{
+    i32 width, height, channels;
+    u8 *pixels = stbi_load(path.c_str(), &width, &height, &channels, 0);
+    if (!pixels)
+    {
+        std::cerr << "Can't load " << path << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+
+    Level level = {(u32)width, (u32)height, std::vector<u8>(pixels, pixels + width * height * channels)};
+    stbi_image_free(pixels);
+
+    u32 format = BakedTexture::formatFor(channels);
+    std::vector<BakedTexture::Level> levels;
+    std::vector<std::vector<u8>> levelData;
+    while (true)
+    {
+        levelData.push_back(encode(level, channels, format));
+        levels.push_back({0, levelData.back().size(), level.width, level.height});
+        if (level.width == 1 && level.height == 1)
+            break;
+        level = downsample(level, channels);
+    }
+
+    BakedTexture::Header header = {
+        BakedTexture::MAGIC, BakedTexture::VERSION, format, (u32)width, (u32)height, (u32)channels,
+        (u32)levels.size(), 0};
+
+    // level data 16 byte aligned after the tables
+    u64 offset = sizeof(header) + levels.size() * sizeof(BakedTexture::Level);
+    for (BakedTexture::Level &entry : levels)
+    {
+        offset = (offset + 15) / 16 * 16;
+        entry.offset = offset;
+        offset += entry.size;
+    }
+
+    std::string tmpPath = outPath + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cerr << "Can't open " << tmpPath << std::endl;
+            return false;
+        }
+        file.write((const char *)&header, sizeof(header));
+        file.write((const char *)levels.data(), levels.size() * sizeof(BakedTexture::Level));
+        for (u32 i = 0; i < levels.size(); i++)
+        {
+            // zero padding up to the level
+            while ((u64)file.tellp() < levels[i].offset)
+                file.put(0);
+            file.write((const char *)levelData[i].data(), levelData[i].size());
+        }
+        if (!file)
+        {
+            std::cerr << "Can't write " << tmpPath << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmpPath, outPath, error);
+    if (error)
+    {
+        std::cerr << "Can't write " << outPath << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    // what the runtime used to keep in VRAM, uncompressed with generated mips
+    u64 rawSize = (u64)width * height * channels * 4 / 3;
+    std::cout << path << " -> " << outPath << " (" << width << "x" << height << " " << formatName(format) << ", "
+              << levels.size() << " levels, " << offset / 1024 << " KB instead of " << rawSize / 1024 << " KB)"
+              << std::endl;
+    return true;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool force = false;
+    std::vector<std::string> paths;
+    for (i32 i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "-f")
+            force = true;
+        else
+            paths.push_back(argv[i]);
+    }
+
+    if (paths.empty())
+    {
+        std::cerr << "usage: bakeTextures [-f] images..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool failed = false;
+    for (const std::string &path : paths)
+    {
+        std::string outPath = BakedTexture::bakedPath(path);
+        std::error_code error;
+        if (!force && std::filesystem::exists(outPath, error) &&
+            std::filesystem::last_write_time(outPath, error) >= std::filesystem::last_write_time(path, error))
+            continue;
+
+        failed |= !bake(path, outPath);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}